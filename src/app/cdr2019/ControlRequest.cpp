@@ -0,0 +1,84 @@
+#include "ControlRequest.hpp"
+#include "DataSocket.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static const char* const FORMAT_NAMES[] = { "text", "cartesian", "compressed" };
+
+ControlRequest::ControlRequest()
+{
+	scan_mode = -1;
+	measure_modes = -1;
+	motor_speed = -1;
+	motor_hz = -1;
+	format = -1;
+	delta_frames = -1;
+	sort = -1;
+}
+
+bool ControlRequest::empty() const
+{
+	return scan_mode < 0 && measure_modes < 0 && motor_speed < 0 && motor_hz < 0
+		&& format < 0 && delta_frames < 0 && sort < 0;
+}
+
+bool ControlRequest::parse(const char* message)
+{
+	char line[256];
+	strncpy(line, message, sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+
+	char* save = NULL;
+	char* token = strtok_r(line, " \t\r\n", &save);
+	if (!token || strcmp(token, "CONFIG") != 0) return false;
+
+	ControlRequest parsed;
+	char name[16];
+	while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		if (sscanf(token, "mode=%d", &parsed.scan_mode) == 1 && parsed.scan_mode >= 0) continue;
+		if (strcmp(token, "mode=auto") == 0) {
+			parsed.measure_modes = 1;
+			continue;
+		}
+		if (sscanf(token, "motor=%f", &parsed.motor_speed) == 1 && parsed.motor_speed > 0 && parsed.motor_speed <= 100) continue;
+		if (sscanf(token, "hz=%f", &parsed.motor_hz) == 1 && parsed.motor_hz >= 0) continue;
+		if (sscanf(token, "delta=%d", &parsed.delta_frames) == 1 && parsed.delta_frames >= 0) continue;
+		if (sscanf(token, "sort=%d", &parsed.sort) == 1 && parsed.sort >= 0) continue;
+		if (sscanf(token, "format=%15s", name) == 1) {
+			int format = DataSocket::FORMAT_COMPRESSED;
+			while (format >= 0 && strcmp(name, FORMAT_NAMES[format]) != 0) format--;
+			parsed.format = format;
+			if (format >= 0) continue;
+		}
+		return false;
+	}
+	*this = parsed;
+	return true;
+}
+
+void ControlRequest::merge(const ControlRequest& later)
+{
+	if (later.scan_mode >= 0) scan_mode = later.scan_mode;
+	if (later.measure_modes >= 0) measure_modes = later.measure_modes;
+	if (later.motor_speed >= 0) motor_speed = later.motor_speed;
+	if (later.motor_hz >= 0) motor_hz = later.motor_hz;
+	if (later.format >= 0) format = later.format;
+	if (later.delta_frames >= 0) delta_frames = later.delta_frames;
+	if (later.sort >= 0) sort = later.sort;
+}
+
+void ControlRequest::describe(char* buffer, size_t size) const
+{
+	// only the settings changed
+	size_t len = 0;
+	buffer[0] = '\0';
+	if (scan_mode >= 0 && len < size) len += snprintf(buffer + len, size - len, " mode=%d", scan_mode);
+	if (measure_modes > 0 && len < size) len += snprintf(buffer + len, size - len, " mode=auto");
+	if (motor_speed >= 0 && len < size) len += snprintf(buffer + len, size - len, " motor=%g", motor_speed);
+	if (motor_hz >= 0 && len < size) len += snprintf(buffer + len, size - len, " hz=%g", motor_hz);
+	if (format >= 0 && len < size) len += snprintf(buffer + len, size - len, " format=%s", FORMAT_NAMES[format]);
+	if (delta_frames >= 0 && len < size) len += snprintf(buffer + len, size - len, " delta=%d", delta_frames);
+	if (sort >= 0 && len < size) len += snprintf(buffer + len, size - len, " sort=%d", sort);
+}
@@ -0,0 +1,35 @@
+#ifndef CONTROL_REQUEST_HPP
+#define CONTROL_REQUEST_HPP
+
+#include <stdlib.h>
+
+/*
+    Settings of the lidar and of the output changed at runtime by a control message on the data socket:
+        CONFIG mode=<id>|auto motor=<duty> hz=<target> format=text|cartesian|compressed delta=0|1 sort=0|1
+    Each key is optional, the settings not given are unchanged. The scan mode is switched without
+    stopping the acquisition, mode=auto measures the modes again and restarts the scan in the best
+    one. motor is the duty of the motor (% of the maximum speed), hz the rotation speed held by the
+    speed control (0 => open loop), delta enables the delta frames of the compressed format and sort
+    the ordering of the points by angle.
+*/
+struct ControlRequest
+{
+	int scan_mode;		// -1 => unchanged, and so on for the other settings
+	int measure_modes;	// 1 => mode=auto
+	float motor_speed;
+	float motor_hz;
+	int format;			// DataSocket::FORMAT_*
+	int delta_frames;
+	int sort;
+
+	ControlRequest();
+	bool empty() const;
+
+	// Parse a control message, false if it is not one
+	bool parse(const char* message);
+	// Take the settings given by a later request
+	void merge(const ControlRequest& later);
+	void describe(char* buffer, size_t size) const;
+};
+
+#endif
@@ -4,20 +4,46 @@
 #include <stdlib.h>
 #include <cstring>
 #include <iostream>
+#include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+using namespace rp::standalone::rplidar;
+
+static double monotonic_time()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
 
 
 DataSocket::DataSocket()
 {
 	server_socket = 0;
+	local_socket = 0;
+	format = FORMAT_TEXT;
+	delta_config = ScanEncoder::DefaultDeltaConfig();
+	delta_config.bin_count = 0;
 	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
 		clients_socket[i] = 0;
+		clients_type[i] = CLIENT_STREAM;
+		clients_group[i] = 0;
+		clients_sent_bytes[i] = 0;
+		clients_dropped[i] = 0;
+		groups[i].subscribers = 0;
+		groups[i].last_sent = 0;
 	}
 }
 
 DataSocket::~DataSocket()
 {
 	shutdown(server_socket, SHUT_RDWR);
+	close_local();
 	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
 		shutdown(clients_socket[i], SHUT_RDWR);
 	}
@@ -71,14 +97,113 @@ int DataSocket::open(const char *address_string, uint16_t server_port)
 	return 0;
 }
 
+// Whether path can be bound: absent, or a socket file left by an instance which is gone
+static bool is_stale_socket(const char *path, const sockaddr_un &address)
+{
+	struct stat info;
+	if (lstat(path, &info) < 0) return errno == ENOENT;
+	if (!S_ISSOCK(info.st_mode)) {
+		fprintf(stderr, "%s exists and is not a socket\n", path);
+		return false;
+	}
+
+	int probe = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (probe < 0) return false;
+	bool served = connect(probe, (const sockaddr*)(&address), sizeof(address)) == 0;
+	close(probe);
+	if (served) {
+		fprintf(stderr, "%s is served by another process\n", path);
+		return false;
+	}
+	return true;
+}
+
+int DataSocket::open_local(const char *path)
+{
+	// Address configuration
+	sockaddr_un local_address;
+	memset(&local_address, 0, sizeof(local_address));
+	local_address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(local_address.sun_path)) {
+		fprintf(stderr, "Local socket path too long\n");
+		return -1;
+	}
+	strcpy(local_address.sun_path, path);
+
+	// Replace the socket file left by a previous instance, but never a live one
+	if (!is_stale_socket(path, local_address)) {
+		return -1;
+	}
+	unlink(path);
+
+	// Create socket: message boundaries are kept, no marker is needed between the revolutions
+	local_socket = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (local_socket <= 0) {
+		perror("Error at local socket creation");
+		local_socket = 0;
+		return -1;
+	}
+
+	// Set socket as NON-BLOCKING
+	if (fcntl(local_socket, F_SETFL, O_NONBLOCK) < 0) {
+		perror("Error at set non-blocking");
+		close_local();
+		return -1;
+	}
+
+	// Bind socket to address
+	if (bind(local_socket, (sockaddr*)(&local_address), sizeof(local_address)) < 0) {
+		perror("Error at local bind");
+		close_local();
+		return -1;
+	}
+	local_path = path;
+
+	// Start listening
+	if (listen(local_socket, DATA_SOCKET_MAX_CLIENT) < 0) {
+		perror("Error at local listen");
+		close_local();
+		return -1;
+	}
+
+	return 0;
+}
+
+void DataSocket::close_local()
+{
+	if (local_socket > 0) {
+		close(local_socket);
+		if (!local_path.empty()) unlink(local_path.c_str());
+	}
+	local_socket = 0;
+	local_path.clear();
+}
+
 bool DataSocket::accept_client()
 {
-	int new_client = accept(server_socket, NULL, NULL);
+	bool accepted = accept_from(server_socket, CLIENT_STREAM);
+	if (local_socket > 0) {
+		accepted |= accept_from(local_socket, CLIENT_PACKET);
+	}
+	return accepted;
+}
+
+bool DataSocket::accept_from(int server, int client_type)
+{
+	int new_client = accept(server, NULL, NULL);
 	if (new_client > 0) {
 		for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
 			if (clients_socket[i] <= 0) {
 				clients_socket[i] = new_client;
-				printf("Client #%u connected\n", i);
+				clients_type[i] = client_type;
+				clients_request[i].clear();
+				join_group(i, Subscription());
+				if (client_type == CLIENT_PACKET) {
+					// a whole revolution must fit in one message
+					int buffer_size = 1024 * 1024;
+					setsockopt(new_client, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+				}
+				printf("Client #%u connected%s\n", i, client_type == CLIENT_PACKET ? " (local)" : "");
 				return true;
 			}
 		}
@@ -89,12 +214,223 @@ bool DataSocket::accept_client()
 }
 
 int DataSocket::send_data(const char* data)
+{
+	return send_data(data, strlen(data));
+}
+
+int DataSocket::send_data(const void* data, size_t size)
+{
+	return send_to_clients(data, size, CLIENT_STREAM);
+}
+
+int DataSocket::send_keepalive()
+{
+	if (format == FORMAT_COMPRESSED) {
+		// an empty self-contained frame: a "M" would be stray bytes in the binary stream
+		rp::standalone::rplidar::ScanEncoder encoder;
+		_u8 frame[16];
+		size_t size = encoder.encode(NULL, 0, frame);
+		return send_to_clients(frame, size, CLIENT_STREAM);
+	}
+	return send_data("M");
+}
+
+void DataSocket::set_format(int output_format)
+{
+	format = output_format;
+}
+
+void DataSocket::set_delta_frames(bool enable)
+{
+	delta_config = ScanEncoder::DefaultDeltaConfig();
+	if (!enable) delta_config.bin_count = 0;
+	for (size_t g = 0; g < DATA_SOCKET_MAX_CLIENT; g++) {
+		groups[g].encoder.setDeltaConfig(delta_config);
+	}
+}
+
+void DataSocket::drop_client(size_t client)
+{
+	shutdown(clients_socket[client], SHUT_RDWR);
+	clients_socket[client] = 0;
+	leave_group(client);
+}
+
+void DataSocket::join_group(size_t client, const Subscription& subscription)
+{
+	// there are as many groups as clients: a free one always exists
+	size_t g = 0;
+	while (g < DATA_SOCKET_MAX_CLIENT && !(groups[g].subscribers > 0 && groups[g].subscription == subscription)) g++;
+	if (g == DATA_SOCKET_MAX_CLIENT) {
+		g = 0;
+		while (groups[g].subscribers > 0) g++;
+		groups[g].subscription = subscription;
+		groups[g].last_sent = 0;
+		groups[g].encoder.setDeltaConfig(delta_config);
+	}
+	else {
+		// the new subscriber cannot use the deltas sent so far
+		groups[g].encoder.requestKeyframe();
+	}
+	groups[g].subscribers++;
+	clients_group[client] = g;
+}
+
+void DataSocket::leave_group(size_t client)
+{
+	groups[clients_group[client]].subscribers--;
+}
+
+void DataSocket::poll_requests()
+{
+	char request[256];
+	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
+		while (clients_socket[i] > 0) {
+			int len = recv(clients_socket[i], request, sizeof(request), MSG_DONTWAIT);
+			if (len <= 0) break;
+			for (int pos = 0; pos < len; pos++) {
+				if (request[pos] == SCAN_STREAM_KEYFRAME_REQUEST && clients_request[i].empty()) {
+					groups[clients_group[i]].encoder.requestKeyframe();
+				}
+				else if (request[pos] == '\n') {
+					handle_request(i);
+				}
+				else if (clients_request[i].size() < sizeof(request)) {
+					clients_request[i] += request[pos];
+				}
+			}
+			// the local clients send one message per request
+			if (clients_type[i] == CLIENT_PACKET && !clients_request[i].empty()) {
+				handle_request(i);
+			}
+		}
+	}
+}
+
+bool DataSocket::poll_control(ControlRequest& request)
+{
+	poll_requests();
+	if (pending_control.empty()) return false;
+	request = pending_control;
+	pending_control = ControlRequest();
+	return true;
+}
+
+void DataSocket::handle_request(size_t client)
+{
+	Subscription subscription = groups[clients_group[client]].subscription;
+	ControlRequest control;
+	char description[200];
+	if (subscription.parse(clients_request[client].c_str())) {
+		leave_group(client);
+		join_group(client, subscription);
+		subscription.describe(description, sizeof(description));
+		printf("Client #%u subscribed to %s\n", (unsigned)client, description);
+	}
+	else if (control.parse(clients_request[client].c_str())) {
+		// applied by the main loop, the latest value of each setting wins
+		pending_control.merge(control);
+		control.describe(description, sizeof(description));
+		printf("Client #%u requested%s\n", (unsigned)client, description);
+	}
+	else {
+		fprintf(stderr, "Invalid request from client #%u\n", (unsigned)client);
+	}
+	clients_request[client].clear();
+}
+
+int DataSocket::send_scan(const rplidar_response_measurement_node_hq_t* nodes, size_t count)
+{
+	poll_requests();
+
+	double now = monotonic_time();
+	int ret_code = 0;
+	for (size_t g = 0; g < DATA_SOCKET_MAX_CLIENT; g++) {
+		SubscriptionGroup& group = groups[g];
+		if (group.subscribers <= 0) continue;
+		// a little slack so that the rate is not divided by the jitter of the revolutions
+		if (group.subscription.max_rate > 0 && now - group.last_sent < 0.95 / group.subscription.max_rate) continue;
+		group.last_sent = now;
+
+		if (send_group(group, nodes, count) < 0) {
+			ret_code = -1;
+		}
+	}
+	return ret_code;
+}
+
+int DataSocket::send_group(SubscriptionGroup& group, const rplidar_response_measurement_node_hq_t* nodes, size_t count)
+{
+	// computed once for all the clients of the group
+	filtered_nodes.resize(count + 1);
+	size_t kept = group.subscription.filter(nodes, count, &filtered_nodes[0]);
+
+	if (format == FORMAT_COMPRESSED) {
+		// the whole revolution goes in a single frame
+		frame_buffer.resize(ScanEncoder::MaxFrameSize(kept));
+		size_t size = group.encoder.encode(&filtered_nodes[0], kept, &frame_buffer[0]);
+		return send_to_clients(&frame_buffer[0], size, CLIENT_STREAM | CLIENT_PACKET, &group);
+	}
+
+	// the TCP clients get the "M" delimiter, the local ones a message
+	format_text(&filtered_nodes[0], kept);
+	int ret_code = send_to_clients(scan_text.data(), scan_text.size(), CLIENT_PACKET, &group);
+	scan_text += 'M';
+	if (send_to_clients(scan_text.data(), scan_text.size(), CLIENT_STREAM, &group) < 0) {
+		ret_code = -1;
+	}
+	return ret_code;
+}
+
+void DataSocket::format_text(const rplidar_response_measurement_node_hq_t* nodes, size_t count)
+{
+	char output_buffer[100];
+	if (format == FORMAT_TEXT_CARTESIAN) {
+		points.resize(count + 1);
+		ConvertToCartesian(nodes, count, &points[0]);
+	}
+
+	scan_text.clear();
+	for (size_t pos = 0; pos < count ; pos++)
+	{
+		float angle_deg = nodes[pos].angle_z_q14 * 90.f / 16384.0f;
+		float dist_mm = nodes[pos].dist_mm_q2 / 4.0f;
+		uint8_t quality = nodes[pos].quality;
+		int ret;
+		if (format == FORMAT_TEXT_CARTESIAN) {
+			ret = snprintf(output_buffer, sizeof(output_buffer),
+				"%.4f:%.2f:%u:%.1f:%.1f;", angle_deg, dist_mm, quality,
+				points[pos].x_mm, points[pos].y_mm);
+		}
+		else {
+			ret = snprintf(output_buffer, sizeof(output_buffer),
+				"%.4f:%.2f:%u;", angle_deg, dist_mm, quality);
+		}
+		if (ret < 0) {
+			fprintf(stderr, "Failed format output\n");
+			continue;
+		}
+		if (ret >= (int)sizeof(output_buffer)) {
+			fprintf(stderr, "Output buffer is too small\n");
+			continue;
+		}
+		scan_text.append(output_buffer, ret);
+	}
+}
+
+int DataSocket::send_to_clients(const void* data, size_t size, int client_types, const SubscriptionGroup* group)
 {
 	int ret_code = 0;
 	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
 		if (clients_socket[i] <= 0) continue;
-		int ret = send(clients_socket[i], data, strlen(data), MSG_NOSIGNAL);
-		if (ret < 0) {
+		if (!(clients_type[i] & client_types)) continue;
+		if (group && &groups[clients_group[i]] != group) continue;
+		int ret = send(clients_socket[i], data, size, MSG_NOSIGNAL);
+		if (ret >= 0) {
+			metricAdd(clients_sent_bytes[i], ret);
+		}
+		else {
+			metricAdd(clients_dropped[i], 1);
 			if (errno==EPIPE || errno==ECONNRESET) {
 				printf("Client #%u disconnected\n", i);
 			}
@@ -102,9 +438,40 @@ int DataSocket::send_data(const char* data)
 				ret_code = -1;
 				fprintf(stderr, "Failed to send data to client #%u\n", i);
 			}
-			shutdown(clients_socket[i], SHUT_RDWR);
-			clients_socket[i] = 0;
+			drop_client(i);
 		}
 	}
     return ret_code;
 }
+
+void DataSocket::append_metrics(std::string& out)
+{
+	char labels[64];
+	size_t connected = 0;
+	size_t active_groups = 0;
+	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
+		if (clients_socket[i] > 0) connected++;
+		if (groups[i].subscribers > 0) active_groups++;
+	}
+	appendMetric(out, "rplidar_clients_connected", "gauge", "Connected output clients", connected);
+	appendMetric(out, "rplidar_subscription_groups", "gauge", "Distinct subscriptions among the clients", active_groups);
+
+	appendMetricHeader(out, "rplidar_client_sent_bytes_total", "counter", "Bytes sent to the client slot");
+	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
+		snprintf(labels, sizeof(labels), "client=\"%u\"", (unsigned)i);
+		appendMetricSample(out, "rplidar_client_sent_bytes_total", metricLoad(clients_sent_bytes[i]), labels);
+	}
+	appendMetricHeader(out, "rplidar_client_drops_total", "counter", "Clients of the slot dropped on a send failure");
+	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
+		snprintf(labels, sizeof(labels), "client=\"%u\"", (unsigned)i);
+		appendMetricSample(out, "rplidar_client_drops_total", metricLoad(clients_dropped[i]), labels);
+	}
+	// the send queues are only looked at when scraped
+	appendMetricHeader(out, "rplidar_client_queued_bytes", "gauge", "Bytes waiting in the send queue of the client");
+	for (size_t i = 0; i < DATA_SOCKET_MAX_CLIENT; i++) {
+		int queued = 0;
+		if (clients_socket[i] <= 0 || ioctl(clients_socket[i], SIOCOUTQ, &queued) < 0) continue;
+		snprintf(labels, sizeof(labels), "client=\"%u\"", (unsigned)i);
+		appendMetricSample(out, "rplidar_client_queued_bytes", queued, labels);
+	}
+}
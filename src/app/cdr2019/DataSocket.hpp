@@ -8,20 +8,86 @@
 #include <winsock2.h>
 #else
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #endif
 
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "rplidar.h"
+#include "Subscription.hpp"
+#include "ControlRequest.hpp"
+
 class DataSocket
 {
 public:
+	enum {
+		FORMAT_TEXT = 0,			// "angle:dist:quality;" per point, "M" after each revolution
+		FORMAT_TEXT_CARTESIAN = 1,	// "angle:dist:quality:x:y;" per point, "M" after each revolution
+		FORMAT_COMPRESSED = 2,		// one binary frame per revolution, see rplidar_codec.h
+	};
+
 	DataSocket();
 	~DataSocket();
 	int open(const char *address_string, uint16_t server_port);
+	int open_local(const char *path);
 	int send_data(const char* data);
+	int send_data(const void* data, size_t size);
+	// Probe the TCP clients, in the output format: releases the slots of the clients which are gone
+	int send_keepalive();
+	// Send one revolution to each client, in the part it subscribed to
+	int send_scan(const rplidar_response_measurement_node_hq_t* nodes, size_t count);
+	void set_format(int output_format);
+	void set_delta_frames(bool enable);
     bool accept_client();
+	// Take the CONFIG messages received from the clients since the last call, false if none
+	bool poll_control(ControlRequest& request);
+	// Append the counters of the clients in the Prometheus text format
+	void append_metrics(std::string& out);
 private:
+	enum {
+		CLIENT_STREAM = 1,	// TCP clients, the revolutions are delimited in the byte stream
+		CLIENT_PACKET = 2,	// local SOCK_SEQPACKET clients, one message per revolution
+	};
+
+	// The clients with identical subscriptions share the filtering, the formatting and the encoder
+	struct SubscriptionGroup {
+		Subscription subscription;
+		int subscribers;
+		double last_sent;
+		rp::standalone::rplidar::ScanEncoder encoder;
+	};
+
+	void close_local();
+	bool accept_from(int server, int client_type);
+	void drop_client(size_t client);
+	void join_group(size_t client, const Subscription& subscription);
+	void leave_group(size_t client);
+	void poll_requests();
+	void handle_request(size_t client);
+	int send_group(SubscriptionGroup& group, const rplidar_response_measurement_node_hq_t* nodes, size_t count);
+	int send_to_clients(const void* data, size_t size, int client_types, const SubscriptionGroup* group = NULL);
+	void format_text(const rplidar_response_measurement_node_hq_t* nodes, size_t count);
+
 	int server_socket;
+	int local_socket;
+	std::string local_path;
+	int format;
+	rp::standalone::rplidar::ScanDeltaConfig delta_config;
 	int clients_socket[DATA_SOCKET_MAX_CLIENT];
+	int clients_type[DATA_SOCKET_MAX_CLIENT];
+	int clients_group[DATA_SOCKET_MAX_CLIENT];
+	std::string clients_request[DATA_SOCKET_MAX_CLIENT];
+	// per client slot, not reset when the slot is reused
+	_u64 clients_sent_bytes[DATA_SOCKET_MAX_CLIENT];
+	_u64 clients_dropped[DATA_SOCKET_MAX_CLIENT];
+	SubscriptionGroup groups[DATA_SOCKET_MAX_CLIENT];
+	ControlRequest pending_control;
+	std::vector<rplidar_response_measurement_node_hq_t> filtered_nodes;
+	std::vector<rp::standalone::rplidar::CartesianPoint> points;
+	std::string scan_text;
+	std::vector<uint8_t> frame_buffer;
 };
 
 #endif
@@ -0,0 +1,195 @@
+#include "StatsSocket.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define STATS_CLIENT_TIMEOUT  1000 // ms, a scraper slower than this to send its request or read the reply is dropped
+#define STATS_REQUEST_MAX_SIZE 8192
+
+static double monotonic_time()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+StatsSocket::StatsSocket()
+{
+	server_socket = 0;
+	client_socket = 0;
+	client_since = 0;
+	response_sent = 0;
+}
+
+StatsSocket::~StatsSocket()
+{
+	close_client();
+	if (server_socket > 0) close(server_socket);
+}
+
+int StatsSocket::open(const char *address_string, uint16_t server_port)
+{
+	// Create socket
+	server_socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (server_socket <= 0) {
+		perror("Error at stats socket creation");
+		return -1;
+	}
+
+	// Set socket as NON-BLOCKING
+	if (fcntl(server_socket, F_SETFL, O_NONBLOCK) < 0) {
+		perror("Error at set non-blocking");
+		close(server_socket);
+		server_socket = 0;
+		return -1;
+	}
+
+	// Address configuration
+	sockaddr_in server_address;
+	memset(&server_address, 0, sizeof(server_address));
+	server_address.sin_family = AF_INET;
+	server_address.sin_port = htons(server_port);
+	if (inet_pton(AF_INET, address_string, &server_address.sin_addr) != 1) {
+		perror("Error at address conversion");
+		close(server_socket);
+		server_socket = 0;
+		return -1;
+	}
+
+	int option_value = 1;
+	if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &option_value, sizeof(option_value)) < 0) {
+		perror("Error at setsockopt");
+		close(server_socket);
+		server_socket = 0;
+		return -1;
+	}
+
+	if (bind(server_socket, (sockaddr*)(&server_address), sizeof(server_address)) < 0) {
+		perror("Error at stats bind");
+		close(server_socket);
+		server_socket = 0;
+		return -1;
+	}
+
+	if (listen(server_socket, 4) < 0) {
+		perror("Error at stats listen");
+		close(server_socket);
+		server_socket = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+bool StatsSocket::poll_request()
+{
+	if (server_socket <= 0) return false;
+
+	// the previous reply is still being sent
+	if (client_socket > 0 && !response.empty()) {
+		send_response();
+		return false;
+	}
+
+	if (client_socket <= 0) {
+		client_socket = accept(server_socket, NULL, NULL);
+		if (client_socket <= 0) {
+			client_socket = 0;
+			return false;
+		}
+		if (fcntl(client_socket, F_SETFL, O_NONBLOCK) < 0) {
+			close_client();
+			return false;
+		}
+		client_since = monotonic_time();
+		request.clear();
+	}
+
+	if (!read_request()) return false;
+
+	// "GET /metrics HTTP/1.1"
+	size_t path_start = request.find(' ');
+	size_t path_end = (path_start == std::string::npos) ? path_start : request.find_first_of(" \r\n", path_start + 1);
+	if (path_end == std::string::npos) {
+		request_path.clear();
+	}
+	else {
+		request_path = request.substr(path_start + 1, path_end - path_start - 1);
+	}
+	return true;
+}
+
+bool StatsSocket::read_request()
+{
+	// read the whole request before answering: closing with unread data would reset the connection
+	char buffer[512];
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < STATS_REQUEST_MAX_SIZE) {
+		int ret = recv(client_socket, buffer, sizeof(buffer), 0);
+		if (ret > 0) {
+			request.append(buffer, ret);
+			continue;
+		}
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (monotonic_time() - client_since > STATS_CLIENT_TIMEOUT / 1000.0) close_client();
+		}
+		else {
+			close_client();
+		}
+		return false;
+	}
+	return true;
+}
+
+const std::string& StatsSocket::path() const
+{
+	return request_path;
+}
+
+void StatsSocket::reply(const std::string& body, const char* content_type)
+{
+	if (client_socket <= 0) return;
+
+	char header[200];
+	snprintf(header, sizeof(header),
+		"HTTP/1.0 200 OK\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %u\r\n"
+		"Connection: close\r\n\r\n", content_type, (unsigned)body.size());
+	response = header;
+	response += body;
+	response_sent = 0;
+	client_since = monotonic_time();
+	send_response();
+}
+
+void StatsSocket::send_response()
+{
+	while (response_sent < response.size()) {
+		int ret = send(client_socket, response.data() + response_sent, response.size() - response_sent, MSG_NOSIGNAL);
+		if (ret > 0) {
+			response_sent += ret;
+			continue;
+		}
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)
+			&& monotonic_time() - client_since <= STATS_CLIENT_TIMEOUT / 1000.0) {
+			return;
+		}
+		break;
+	}
+	close_client();
+}
+
+void StatsSocket::close_client()
+{
+	if (client_socket > 0) close(client_socket);
+	client_socket = 0;
+	request.clear();
+	response.clear();
+	response_sent = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef STATS_SOCKET_HPP
+#define STATS_SOCKET_HPP
+
+#include <stdint.h>
+#include <string>
+
+/*
+    Serves the metrics in the Prometheus text format over HTTP, e.g.
+        curl http://127.0.0.1:17688/metrics
+    The sockets are non-blocking: when nobody scrapes, the cost is one accept() per call to
+    poll_request(), and the metrics are only formatted for a waiting scraper. A request or a reply
+    which does not fit in one call is carried over to the next calls, one scraper at a time.
+    The path of the request (e.g. "/metrics") tells the caller what to reply.
+*/
+class StatsSocket
+{
+public:
+	StatsSocket();
+	~StatsSocket();
+	int open(const char *address_string, uint16_t server_port);
+	// Accept a pending scraper and read its request, true once it is complete and waits for reply()
+	bool poll_request();
+	// Path of the request accepted by poll_request()
+	const std::string& path() const;
+	// Send the body to the scraper accepted by poll_request(), its connection is closed once sent
+	void reply(const std::string& body, const char* content_type = "text/plain; version=0.0.4");
+private:
+	bool read_request();
+	void send_response();
+	void close_client();
+
+	int server_socket;
+	int client_socket;
+	double client_since;
+	std::string request;
+	std::string request_path;
+	std::string response;
+	size_t response_sent;
+};
+
+#endif
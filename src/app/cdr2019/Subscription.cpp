@@ -0,0 +1,83 @@
+#include "Subscription.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+
+Subscription::Subscription()
+{
+	angle_min = 0;
+	angle_max = 360;
+	dist_min = 0;
+	dist_max = 0;
+	min_quality = 0;
+	decimation = 1;
+	max_rate = 0;
+}
+
+bool Subscription::operator==(const Subscription& other) const
+{
+	return angle_min == other.angle_min && angle_max == other.angle_max
+		&& dist_min == other.dist_min && dist_max == other.dist_max
+		&& min_quality == other.min_quality && decimation == other.decimation
+		&& max_rate == other.max_rate;
+}
+
+bool Subscription::parse(const char* message)
+{
+	char line[256];
+	strncpy(line, message, sizeof(line) - 1);
+	line[sizeof(line) - 1] = '\0';
+
+	char* save = NULL;
+	char* token = strtok_r(line, " \t\r\n", &save);
+	if (!token) return false;
+	if (strcmp(token, "UNSUBSCRIBE") == 0) {
+		*this = Subscription();
+		return true;
+	}
+	if (strcmp(token, "SUBSCRIBE") != 0) return false;
+
+	Subscription parsed;
+	while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		if (sscanf(token, "angle=%f:%f", &parsed.angle_min, &parsed.angle_max) == 2) continue;
+		if (sscanf(token, "dist=%f:%f", &parsed.dist_min, &parsed.dist_max) == 2) continue;
+		if (sscanf(token, "quality=%d", &parsed.min_quality) == 1) continue;
+		if (sscanf(token, "decimation=%d", &parsed.decimation) == 1) continue;
+		if (sscanf(token, "rate=%f", &parsed.max_rate) == 1) continue;
+		return false;
+	}
+	if (parsed.decimation < 1) parsed.decimation = 1;
+	if (parsed.max_rate < 0) parsed.max_rate = 0;
+	*this = parsed;
+	return true;
+}
+
+void Subscription::describe(char* buffer, size_t size) const
+{
+	snprintf(buffer, size, "angle=%g:%g dist=%g:%g quality=%d decimation=%d rate=%g",
+		angle_min, angle_max, dist_min, dist_max, min_quality, decimation, max_rate);
+}
+
+size_t Subscription::filter(const rplidar_response_measurement_node_hq_t* nodes, size_t count,
+	rplidar_response_measurement_node_hq_t* out) const
+{
+	// the window and the range in the units of the nodes
+	bool full_turn = angle_max - angle_min >= 360;
+	int window_start = (int)(angle_min * 16384 / 90) & 0xFFFF;
+	int window_size = (int)(angle_max * 16384 / 90 - angle_min * 16384 / 90) & 0xFFFF;
+	uint32_t dist_min_q2 = (uint32_t)(dist_min * 4);
+	uint32_t dist_max_q2 = dist_max > 0 ? (uint32_t)(dist_max * 4) : 0xFFFFFFFF;
+
+	size_t kept = 0;
+	int in_window = 0;
+	for (size_t pos = 0; pos < count; pos++) {
+		const rplidar_response_measurement_node_hq_t& node = nodes[pos];
+		if (!full_turn && ((node.angle_z_q14 - window_start) & 0xFFFF) > window_size) continue;
+		if (in_window++ % decimation) continue;
+		if (node.dist_mm_q2 < dist_min_q2 || node.dist_mm_q2 > dist_max_q2) continue;
+		if (node.quality < min_quality) continue;
+		out[kept++] = node;
+	}
+	return kept;
+}
@@ -0,0 +1,37 @@
+#ifndef SUBSCRIPTION_HPP
+#define SUBSCRIPTION_HPP
+
+#include <stdlib.h>
+#include "rplidar.h"
+
+/*
+    Part of the scan a client wants to receive, set by a control message on the data socket:
+        SUBSCRIBE angle=<min>:<max> dist=<min>:<max> quality=<min> decimation=<n> rate=<hz>
+        UNSUBSCRIBE
+    Each key is optional. The angular window goes clockwise from min to max (degrees) and may
+    wrap around 0, distances are in mm (max 0 => no limit), decimation keeps one point out of n
+    in the window and rate limits the revolutions per second (0 => every revolution).
+*/
+struct Subscription
+{
+	float angle_min;
+	float angle_max;
+	float dist_min;
+	float dist_max;
+	int min_quality;
+	int decimation;
+	float max_rate;
+
+	Subscription();
+	bool operator==(const Subscription& other) const;
+
+	// Parse a control message, false if it is not one
+	bool parse(const char* message);
+	void describe(char* buffer, size_t size) const;
+
+	// Keep the points of the subscription, returns their count
+	size_t filter(const rplidar_response_measurement_node_hq_t* nodes, size_t count,
+		rplidar_response_measurement_node_hq_t* out) const;
+};
+
+#endif
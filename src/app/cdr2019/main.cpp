@@ -8,21 +8,49 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
-#include <pigpio.h>
+#include <time.h>
 
 #include "rplidar.h" //RPLIDAR standard sdk, all-in-one header
 #include "DataSocket.hpp"
+#include "StatsSocket.hpp"
 #include "delay.h"
 
+/* Motor backends */
+#define MOTOR_PIGPIO        0       // hardware PWM of GPIO 12 through pigpio: root, needs the pigpio library (USE_PIGPIO=1, the default)
+#define MOTOR_SYSFS_PWM     1       // PWM channel of the kernel, see SysfsPwmMotorDriver: needs the pwm overlay on the Pi
+#define MOTOR_LIDAR_CMD     2       // MOTOR_PWM command of the lidar
+#define MOTOR_MOCK          3       // no motor, the duty is recorded by a MockMotorDriver
+
 /* Settings */
 #define SERVER_ADDRESS      "172.24.1.1"
 #define SERVER_PORT         17685
+#define LOCAL_SOCKET_PATH   "/tmp/rplidar.sock" // AF_UNIX SOCK_SEQPACKET endpoint for the clients of the same host, "" to disable
+#define STATS_ADDRESS       "127.0.0.1" // metrics in the Prometheus text format, "" to disable
+#define STATS_PORT          17688
+#define TRACE_AT_STARTUP    0       // 1 => record the hot path spans from the start, else GET /trace/on or SIGUSR2
+#define TRACE_DUMP_PATH     "/tmp/rplidar_trace.json" // written on SIGUSR1, also served as GET /trace (Chrome trace-event JSON)
+#define CAPABILITY_CACHE_PATH "/var/tmp/rplidar_capabilities" // scan modes of the lidars met so far, "" to keep them in memory only
 #define DEFAULT_SERIAL_PORT "/dev/ttyAMA0"
 #define DEFAULT_BAUDRATE    256000
 #define DEFAULT_MOTOR_SPEED 65.0    // % of the maximum speed
-#define MAX_FAILURE_COUNT   0       // maximum consecutive scan failures allowed before restarting the lidar
+#define MOTOR_TARGET_HZ     0       // revolutions per second held by adjusting the motor duty from DEFAULT_MOTOR_SPEED, 0 => open loop
+#define MOTOR_BACKEND       MOTOR_PIGPIO
+#define MOTOR_PWM_CHIP      "/sys/class/pwm/pwmchip0" // GPIO 12 is its channel 0 with dtoverlay=pwm,pin=12,func=4
+#define MOTOR_PWM_CHANNEL   0
+#define MOTOR_PWM_FREQUENCY 25000
+#define READY_TIMEOUT       5000    // ms allowed to the lidar to answer after a reset, and to the scan to become stable
+#define START_RETRY_MIN_DELAY 100   // ms before starting the scan again after a failed start, doubled on each consecutive failure
+#define START_RETRY_MAX_DELAY 5000
+#define MAX_FAILURE_COUNT   0       // maximum consecutive scan failures the driver could not recover before restarting the lidar
 #define SORT_OUTPUT_DATA    1       // 1 => output data will be sorted by angle; 0 => output unsorted
-#define OUTPUT_BUFFER_SIZE  100
+#define OUTPUT_CARTESIAN    0       // 1 => each point also carries its x:y position (mm) in the lidar frame
+#define OUTPUT_COMPRESSED   0       // 1 => one binary frame per revolution (see rplidar_codec.h) instead of the text output
+#define OUTPUT_DELTA_FRAMES 0       // with OUTPUT_COMPRESSED: 1 => periodic keyframes, then only the angle bins which changed
+#define OUTPUT_MULTICAST    0       // 1 => each revolution is also published on the multicast group (see rplidar_multicast.h)
+#define MULTICAST_GROUP     "239.255.76.68"
+#define OUTPUT_SHARED_MEMORY 0      // 1 => each revolution is also published to the local processes (see rplidar_shm.h)
+#define SHARED_MEMORY_NAME  "/rplidar_scan"
+#define FILTER_SCAN_DATA    0       // 1 => temporal median and outlier rejection, rejected points are sent with a null distance
 
 /*
     Mode 0 (Standard) 3.96825 kHz
@@ -30,8 +58,11 @@
     Mode 2 (Boost) 15.873 kHz
     Mode 3 (Sensitivity) 15.873 kHz
     Mode 4 (Stability) 10 kHz
+    The scan mode, the motor and the output can be changed at runtime by a client, see ControlRequest.hpp
 */
 #define LIDAR_SCAN_MODE     2
+#define AUTO_SCAN_MODE      0       // 1 => the modes are measured once per lidar and baudrate, and the best one for SCAN_MODE_OBJECTIVE replaces LIDAR_SCAN_MODE
+#define SCAN_MODE_OBJECTIVE SCAN_MODE_OBJECTIVE_DENSITY // see rplidar_capabilities.h
 
 #ifndef _countof
 #define _countof(_Array) (int)(sizeof(_Array) / sizeof(_Array[0]))
@@ -46,6 +77,233 @@ void ctrlc(int)
     ctrl_c_pressed = true;
 }
 
+#if MOTOR_BACKEND == MOTOR_PIGPIO
+#ifndef USE_PIGPIO
+#error "MOTOR_PIGPIO requires pigpio, do not build with make USE_PIGPIO=0"
+#endif
+#include <pigpio.h>
+
+/* Motor driven by the hardware PWM of GPIO 12 */
+class GpioMotorDriver : public MotorDriver
+{
+public:
+    virtual u_result setDuty(float duty)
+    {
+        unsigned long _pwm = (float)PI_HW_PWM_RANGE * (duty / 100.0);
+        return gpioHardwarePWM(12, MOTOR_PWM_FREQUENCY, _pwm) == 0 ? RESULT_OK : RESULT_OPERATION_FAIL;
+    }
+};
+#endif
+
+MotorDriver * motor = NULL;
+MotorSpeedController * speed_controller = NULL;
+
+/* Settings, changed by the CONFIG messages of the clients */
+int scan_mode = LIDAR_SCAN_MODE;
+float motor_speed = DEFAULT_MOTOR_SPEED;
+float motor_target_hz = MOTOR_TARGET_HZ;
+bool sort_output = SORT_OUTPUT_DATA;
+bool scan_mode_chosen = !AUTO_SCAN_MODE;
+bool scan_modes_measure_requested = false;
+
+/* Set the rotation speed of the Lidar */
+void runMotor(float pwm)
+{
+    printf("run motor: %g\n", pwm);
+    motor->setDuty(pwm);
+}
+
+/* Print the state changes of the speed control */
+void reportMotorSpeed()
+{
+    static int last_state = MOTOR_SPEED_IDLE;
+    MotorSpeedStatus status;
+    speed_controller->getStatus(status);
+    if (status.state == last_state) return;
+    last_state = status.state;
+    printf("Motor speed %s: %.2f Hz for %.2f Hz at %.1f%%\n", MotorSpeedController::StateName(status.state),
+        status.measured_hz, status.target_hz, status.duty);
+}
+
+/* Choose the scan mode from the measurements cached with the capabilities of the lidar, measured first if needed */
+void chooseScanMode(RPlidarDriver * drv, LidarCapabilityCache * capability_cache,
+    const rplidar_response_device_info_t & devinfo, _u32 baudrate, bool remeasure)
+{
+    // loads the capabilities in the cache if they are not there yet
+    std::vector<RplidarScanMode> modes;
+    LidarCapabilities capabilities;
+    if (IS_FAIL(drv->getAllSupportedScanModes(modes)) || !capability_cache->find(devinfo, capabilities)) {
+        fprintf(stderr, "Scan modes unknown, keeping the mode %d\n", scan_mode);
+        return;
+    }
+
+    if (remeasure || capabilities.measured_baudrate != baudrate) {
+        printf("Measuring the scan modes\n");
+        drv->stop();
+        if (IS_FAIL(MeasureScanModes(drv, capabilities.measurements))) {
+            fprintf(stderr, "Failed to measure the scan modes, keeping the mode %d\n", scan_mode);
+            return;
+        }
+        capabilities.measured_baudrate = baudrate;
+        capability_cache->store(capabilities);
+    }
+    for (size_t i = 0; i < capabilities.measurements.size(); i++) {
+        const ScanModeMeasurement & measure = capabilities.measurements[i];
+        printf("Mode %u: %.0f/%.0f samples/s, %.1f%% valid, %.2f%% checksum errors, %.1f%% decoding\n",
+            measure.id, measure.measured_sps, measure.nominal_sps, measure.valid_ratio * 100,
+            measure.checksum_error_ratio * 100, measure.decode_load * 100);
+    }
+
+    _u16 best_mode;
+    if (IS_FAIL(SelectScanMode(capabilities, SCAN_MODE_OBJECTIVE, best_mode))) {
+        fprintf(stderr, "No usable scan mode measured, keeping the mode %d\n", scan_mode);
+        return;
+    }
+    scan_mode = best_mode;
+    printf("Scan mode %d chosen\n", scan_mode);
+}
+
+/* Apply a CONFIG message: the scan mode is switched without stopping the acquisition */
+void applyControl(const ControlRequest & control, RPlidarDriver * drv, DataSocket & output_socket)
+{
+    // the main loop restarts the scan once the modes are measured
+    if (control.measure_modes > 0) {
+        scan_mode_chosen = false;
+        scan_modes_measure_requested = true;
+    }
+    if (control.scan_mode >= 0) {
+        RplidarScanMode scanmode;
+        u_result ans = drv->switchScanMode(control.scan_mode, 0, &scanmode);
+        if (IS_OK(ans)) {
+            scan_mode = control.scan_mode;
+            printf("Scan mode switched to %u (%s) at %g kHz\n", scanmode.id, scanmode.scan_mode,
+                1000.0 / scanmode.us_per_sample);
+        }
+        else if (ans == RESULT_OPERATION_NOT_SUPPORT) {
+            fprintf(stderr, "Unknown scan mode %d\n", control.scan_mode);
+        }
+        else if (ans != RESULT_ALREADY_DONE) {
+            // the scan is restarted in the new mode by the recovery
+            scan_mode = control.scan_mode;
+            fprintf(stderr, "Failed to switch to the scan mode %d: %x\n", control.scan_mode, ans);
+        }
+    }
+
+    if (control.motor_speed >= 0 || control.motor_hz >= 0) {
+        if (control.motor_speed >= 0) motor_speed = control.motor_speed;
+        if (control.motor_hz >= 0) motor_target_hz = control.motor_hz;
+        if (motor_target_hz > 0) {
+            if (!speed_controller) {
+                speed_controller = MotorSpeedController::CreateController(motor);
+                drv->setSpeedController(speed_controller);
+            }
+            speed_controller->start(MotorSpeedController::DefaultConfig(motor_target_hz), motor_speed);
+        }
+        else {
+            if (speed_controller) speed_controller->stop();
+            runMotor(motor_speed);
+        }
+    }
+
+    if (control.format >= 0) output_socket.set_format(control.format);
+    if (control.delta_frames >= 0) output_socket.set_delta_frames(control.delta_frames);
+    if (control.sort >= 0) sort_output = control.sort;
+}
+
+/* Signal handler for SIGUSR1: the trace is written by the main loop */
+bool trace_dump_requested = false;
+void dumptrace(int)
+{
+    trace_dump_requested = true;
+}
+
+/* Signal handler for SIGUSR2 */
+void toggletrace(int)
+{
+    Tracer::Enable(!Tracer::IsEnabled());
+}
+
+/* Counters of the main loop, served with those of the driver and of the clients */
+_u64 revolutions_published = 0;
+_u64 grab_failures = 0;
+_u64 lidar_restarts = 0;
+_u64 time_to_first_scan_us = 0;
+const _u64 publish_bounds_us[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000 };
+MetricHistogram publish_duration_us(publish_bounds_us, _countof(publish_bounds_us));
+
+_u64 monotonicTimeUs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (_u64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Answer a pending scraper, the metrics are only formatted on request */
+void serveStats(StatsSocket & stats_socket, RPlidarDriver * drv, DataSocket & output_socket)
+{
+    if (trace_dump_requested) {
+        trace_dump_requested = false;
+        if (IS_OK(Tracer::DumpChromeTrace(TRACE_DUMP_PATH))) {
+            printf("Trace written to %s\n", TRACE_DUMP_PATH);
+        }
+        else {
+            fprintf(stderr, "Failed to write the trace to %s\n", TRACE_DUMP_PATH);
+        }
+    }
+
+    if (!stats_socket.poll_request()) return;
+
+    if (stats_socket.path() == "/trace/on" || stats_socket.path() == "/trace/off") {
+        Tracer::Enable(stats_socket.path() == "/trace/on");
+        stats_socket.reply(Tracer::IsEnabled() ? "tracing on\n" : "tracing off\n");
+        return;
+    }
+    if (stats_socket.path() == "/trace") {
+        std::string trace;
+        Tracer::DumpChromeTrace(trace);
+        stats_socket.reply(trace, "application/json");
+        return;
+    }
+
+    std::string metrics;
+    drv->getMetrics().append(metrics);
+    appendMetric(metrics, "rplidar_revolutions_published_total", "counter",
+        "Revolutions sent to the outputs", revolutions_published);
+    appendMetric(metrics, "rplidar_grab_failures_total", "counter",
+        "Revolutions not received in time from the driver", grab_failures);
+    appendMetric(metrics, "rplidar_lidar_restarts_total", "counter",
+        "Scans stopped and started again after a failure", lidar_restarts);
+    appendMetric(metrics, "rplidar_scan_mode", "gauge", "Scan mode requested", scan_mode);
+    appendMetric(metrics, "rplidar_time_to_first_scan_us", "gauge",
+        "Time from the start or the last lidar failure to the first revolution published, in microseconds", time_to_first_scan_us);
+    publish_duration_us.append(metrics, "rplidar_publish_duration_us",
+        "Time to sort and send a revolution to the outputs, in microseconds");
+    if (speed_controller) {
+        MotorSpeedStatus status;
+        speed_controller->getStatus(status);
+        appendGauge(metrics, "rplidar_motor_target_hz", "Rotation speed held by the speed control", status.target_hz);
+        appendGauge(metrics, "rplidar_motor_measured_hz", "Rotation speed measured from the revolution periods", status.measured_hz);
+        appendGauge(metrics, "rplidar_motor_duty_percent", "Duty of the motor set by the speed control", status.duty);
+        appendMetric(metrics, "rplidar_motor_control_state", "gauge",
+            "Speed control state: 0 idle, 1 spinup, 2 tracking, 3 locked, 4 saturated", status.state);
+        appendMetric(metrics, "rplidar_motor_command_errors_total", "counter",
+            "Duty changes rejected by the motor driver", status.command_errors);
+    }
+    output_socket.append_metrics(metrics);
+    stats_socket.reply(metrics);
+}
+
+/* Wait before the next attempt, the clients and the scrapers are still served */
+void waitRetry(unsigned int delay_ms, StatsSocket & stats_socket, RPlidarDriver * drv, DataSocket & output_socket)
+{
+    _u64 deadline_us = monotonicTimeUs() + (_u64)delay_ms * 1000;
+    while (!ctrl_c_pressed && monotonicTimeUs() < deadline_us) {
+        output_socket.accept_client();
+        serveStats(stats_socket, drv, output_socket);
+        delay((unsigned long long)10);
+    }
+}
+
 /* Check the operational status of the Lidar */
 bool checkRPLIDARHealth(RPlidarDriver * drv)
 {
@@ -69,32 +327,47 @@ bool checkRPLIDARHealth(RPlidarDriver * drv)
     }
 }
 
-/* Set the rotation speed of the Lidar */
-void runMotor(float pwm)
-{
-    unsigned long _pwm = (float)PI_HW_PWM_RANGE * (pwm / 100.0);
-    printf("run motor: %g\n", pwm);
-    gpioHardwarePWM(12, 25000, _pwm);
-}
-
 int main(int argc, const char * argv[])
 {
     signal(SIGINT, ctrlc);
+#if MOTOR_BACKEND == MOTOR_PIGPIO
+    // pigpio replaces the signal handlers
     gpioInitialise();
     gpioSetSignalFunc(SIGINT, ctrlc);
+    gpioSetSignalFunc(SIGUSR1, dumptrace);
+    gpioSetSignalFunc(SIGUSR2, toggletrace);
     gpioSetMode(12, PI_ALT0);
-    runMotor(0);
+    GpioMotorDriver gpio_motor;
+    motor = &gpio_motor;
+#else
+    signal(SIGUSR1, dumptrace);
+    signal(SIGUSR2, toggletrace);
+#endif
+#if MOTOR_BACKEND == MOTOR_SYSFS_PWM
+    SysfsPwmMotorDriver pwm_motor;
+    u_result pwm_result = pwm_motor.open(MOTOR_PWM_CHIP, MOTOR_PWM_CHANNEL, MOTOR_PWM_FREQUENCY);
+    if (IS_FAIL(pwm_result)) {
+        fprintf(stderr, "Error, cannot open the PWM channel %d of %s: %x (is dtoverlay=pwm,pin=12,func=4 set?)\n",
+            MOTOR_PWM_CHANNEL, MOTOR_PWM_CHIP, pwm_result);
+        exit(-9);
+    }
+    motor = &pwm_motor;
+#elif MOTOR_BACKEND == MOTOR_MOCK
+    MockMotorDriver mock_motor;
+    motor = &mock_motor;
+#endif
+    Tracer::SetThreadName("main");
+    Tracer::Enable(TRACE_AT_STARTUP);
     printf("SDK Version: %s\n", RPLIDAR_SDK_VERSION);
 
 	DataSocket output_socket;
+    StatsSocket stats_socket;
     const char * opt_com_path = DEFAULT_SERIAL_PORT;
     _u32 opt_com_baudrate = DEFAULT_BAUDRATE;
-    unsigned long motor_speed = DEFAULT_MOTOR_SPEED;
     u_result op_result;
     rplidar_response_device_info_t devinfo;
     RplidarScanMode scanmode;
     rplidar_response_measurement_node_hq_t nodes[8192];
-    char output_buffer[100] = { '\0', };
 
     // create the driver instance
 	RPlidarDriver * drv = RPlidarDriver::CreateDriver(DRIVER_TYPE_SERIALPORT);
@@ -102,6 +375,23 @@ int main(int argc, const char * argv[])
         fprintf(stderr, "insufficent memory, exit\n");
         exit(-2);
     }
+    // reconnections, and restarts once persisted, skip the scan mode queries
+    LidarCapabilityCache * capability_cache = LidarCapabilityCache::CreateCache(CAPABILITY_CACHE_PATH[0] ? CAPABILITY_CACHE_PATH : NULL);
+    drv->setCapabilityCache(capability_cache);
+#if MOTOR_BACKEND == MOTOR_LIDAR_CMD
+    LidarMotorDriver lidar_motor(drv);
+    motor = &lidar_motor;
+#else
+    runMotor(0);
+#endif
+    if (motor_target_hz > 0) {
+        speed_controller = MotorSpeedController::CreateController(motor);
+        drv->setSpeedController(speed_controller);
+    }
+#if FILTER_SCAN_DATA
+    static ScanFilter scan_filter;
+    drv->setScanFilter(&scan_filter);
+#endif
 
     // read serial port from the command line if specified...
     if (argc > 1)
@@ -156,11 +446,64 @@ int main(int argc, const char * argv[])
         exit(ret);
     }
     printf("Socket opened on %s:%u\n", SERVER_ADDRESS, SERVER_PORT);
+    if (LOCAL_SOCKET_PATH[0]) {
+        // optional endpoint: the TCP clients are served without it
+        if (output_socket.open_local(LOCAL_SOCKET_PATH) != 0) {
+            fprintf(stderr, "Warning, cannot open the local socket %s, continuing without it\n", LOCAL_SOCKET_PATH);
+        } else {
+            printf("Local socket opened on %s\n", LOCAL_SOCKET_PATH);
+        }
+    }
+    if (STATS_ADDRESS[0]) {
+        // the metrics are optional, the scan goes on without them
+        if (stats_socket.open(STATS_ADDRESS, STATS_PORT) != 0) {
+            fprintf(stderr, "Warning, cannot open the stats socket %s:%u, continuing without it\n", STATS_ADDRESS, STATS_PORT);
+        } else {
+            printf("Metrics served on http://%s:%u/metrics\n", STATS_ADDRESS, STATS_PORT);
+        }
+    }
+#if OUTPUT_COMPRESSED
+    output_socket.set_format(DataSocket::FORMAT_COMPRESSED);
+#if OUTPUT_DELTA_FRAMES
+    output_socket.set_delta_frames(true);
+#endif
+#elif OUTPUT_CARTESIAN
+    output_socket.set_format(DataSocket::FORMAT_TEXT_CARTESIAN);
+#endif
+#if OUTPUT_MULTICAST
+    ScanMulticastPublisher * publisher = ScanMulticastPublisher::CreatePublisher();
+    if (IS_FAIL(publisher->open(MULTICAST_GROUP))) {
+        fprintf(stderr, "Error, cannot publish on %s, exit\n", MULTICAST_GROUP);
+        ScanMulticastPublisher::DisposePublisher(publisher);
+        RPlidarDriver::DisposeDriver(drv);
+        drv = NULL;
+        exit(-5);
+    }
+#if OUTPUT_DELTA_FRAMES
+    publisher->setDeltaConfig(ScanEncoder::DefaultDeltaConfig());
+#endif
+    printf("Publishing on %s:%u\n", MULTICAST_GROUP, ScanMulticastPublisher::DEFAULT_PORT);
+#endif
+#if OUTPUT_SHARED_MEMORY
+    ScanShmPublisher * shm_publisher = ScanShmPublisher::CreatePublisher();
+    if (IS_FAIL(shm_publisher->open(SHARED_MEMORY_NAME))) {
+        fprintf(stderr, "Error, cannot create the shared memory %s, exit\n", SHARED_MEMORY_NAME);
+        ScanShmPublisher::DisposePublisher(shm_publisher);
+        RPlidarDriver::DisposeDriver(drv);
+        drv = NULL;
+        exit(-6);
+    }
+    printf("Publishing in the shared memory %s\n", SHARED_MEMORY_NAME);
+#endif
 
+    // measures the time to the first valid scan, at startup and after each failure
+    _u64 outage_start_us = monotonicTimeUs();
+    unsigned int start_retry_delay = 0;
     while (!ctrl_c_pressed)
     {
-        output_socket.send_data("M"); // Release unused client slots and show that program is up
+        output_socket.send_keepalive(); // Release unused client slots and show that program is up
         output_socket.accept_client();
+        serveStats(stats_socket, drv, output_socket);
 
         // Try to get S/N from the lidar
         printf("getDeviceInfo\n");
@@ -186,81 +529,138 @@ int main(int argc, const char * argv[])
         // check health...
         if (!checkRPLIDARHealth(drv)) {
             drv->reset();
-            delay((unsigned long long)1000);
+            if (IS_FAIL(drv->waitDeviceReady(READY_TIMEOUT))) {
+                fprintf(stderr, "No answer from the lidar %d ms after its reset\n", READY_TIMEOUT);
+            }
             continue;
         }
 
         // spin motor...
         runMotor(motor_speed);
+        if (!scan_mode_chosen) {
+            chooseScanMode(drv, capability_cache, devinfo, opt_com_baudrate, scan_modes_measure_requested);
+            scan_mode_chosen = true;
+            scan_modes_measure_requested = false;
+        }
         // start scan...
         printf("startScanExpress\n");
-        op_result = drv->startScanExpress(false, LIDAR_SCAN_MODE, 0, &scanmode);
+        op_result = drv->startScanExpress(false, scan_mode, 0, &scanmode);
         if (IS_FAIL(op_result)) {
             drv->stop();
             runMotor(0);
-            fprintf(stderr, "Failed to start scan\n");
-            delay((unsigned long long)1000);
+            drv->waitDeviceReady(READY_TIMEOUT);
+            // a lidar which keeps refusing the scan is not flooded with requests
+            start_retry_delay = start_retry_delay ? start_retry_delay * 2 : START_RETRY_MIN_DELAY;
+            if (start_retry_delay > START_RETRY_MAX_DELAY) start_retry_delay = START_RETRY_MAX_DELAY;
+            fprintf(stderr, "Failed to start scan, retrying in %u ms\n", start_retry_delay);
+            waitRetry(start_retry_delay, stats_socket, drv, output_socket);
             continue;
         }
+        start_retry_delay = 0;
         printf("Scan mode: %u (%s) at %g kHz\n", scanmode.id, scanmode.scan_mode,
             1000.0 / scanmode.us_per_sample);
+        if (speed_controller && motor_target_hz > 0) {
+            speed_controller->start(MotorSpeedController::DefaultConfig(motor_target_hz), motor_speed);
+        }
+        // the revolutions of the spin-up are not published
+        if (IS_FAIL(drv->waitScanReady(READY_TIMEOUT))) {
+            fprintf(stderr, "Scan not stable after %d ms\n", READY_TIMEOUT);
+        }
 
         // fetch results and print them out...
         int fail_count = 0;
-        while (!ctrl_c_pressed && fail_count <= MAX_FAILURE_COUNT)
+        while (!ctrl_c_pressed && fail_count <= MAX_FAILURE_COUNT && scan_mode_chosen)
         {
             output_socket.accept_client();
+            serveStats(stats_socket, drv, output_socket);
+            ControlRequest control;
+            if (output_socket.poll_control(control)) {
+                applyControl(control, drv, output_socket);
+            }
             size_t count = _countof(nodes);
-            op_result = drv->grabScanDataHq(nodes, count);
+            _u64 timestamp_us;
+            op_result = drv->grabScanDataHqWithTimeStamp(nodes, count, timestamp_us);
             if (IS_FAIL(op_result)) {
-                fail_count++;
-                printf("grabScanDataHq FAILED %d\n", fail_count);
-                continue;
-            }
+                grab_failures++;
+                printf("grabScanDataHq FAILED\n");
 
-#if SORT_OUTPUT_DATA
-            op_result = drv->ascendScanData(nodes, count);
-            if (IS_FAIL(op_result)) {
+                // resync, then restart the scan, then reset the lidar, the motor keeps spinning
+                static const char * const recovery_names[SCAN_RECOVERY_LEVELS] = { "resync", "restart", "reset" };
+                int recovery_level;
+                _u64 recovery_start_us = monotonicTimeUs();
+                if (IS_OK(drv->recoverScan(recovery_level, READY_TIMEOUT))) {
+                    printf("Scan recovered by %s in %llu ms\n", recovery_names[recovery_level],
+                        (unsigned long long)((monotonicTimeUs() - recovery_start_us) / 1000));
+                    continue;
+                }
                 fail_count++;
-                printf("ascendScanData FAILED %d\n", fail_count);
+                printf("Scan recovery FAILED %d\n", fail_count);
                 continue;
             }
-#endif
-            for (size_t pos = 0; pos < count ; pos++)
-            {
-                float angle_deg = nodes[pos].angle_z_q14 * 90.f / 16384.0f;
-                float dist_mm = nodes[pos].dist_mm_q2 / 4.0f;
-                uint8_t quality = nodes[pos].quality;
-                //printf("Theta: %03.2f Dist: %08.2f Q: %u\n", angle_deg, dist_mm, quality);
-                int ret = snprintf(output_buffer, OUTPUT_BUFFER_SIZE,
-                    "%.4f:%.2f:%u;", angle_deg, dist_mm, quality);
-                if (ret < 0) {
-                    fprintf(stderr, "Failed format output\n");
-                    continue;
-                }
-                if (ret >= OUTPUT_BUFFER_SIZE) {
-                    fprintf(stderr, "Output buffer is too small\n");
+            _u64 publish_start_us = monotonicTimeUs();
+
+            if (sort_output) {
+                op_result = drv->ascendScanData(nodes, count);
+                if (IS_FAIL(op_result)) {
+                    fail_count++;
+                    printf("ascendScanData FAILED %d\n", fail_count);
                     continue;
                 }
-                output_socket.send_data(output_buffer);
             }
-            output_socket.send_data("M");
+#if OUTPUT_MULTICAST
+            TraceScope multicast_span("publish_multicast");
+            publisher->publishScan(nodes, count);
+            multicast_span.end();
+#endif
+#if OUTPUT_SHARED_MEMORY
+            TraceScope shm_span("publish_shm");
+            shm_publisher->publishScan(nodes, count, timestamp_us);
+            shm_span.end();
+#endif
+            TraceScope send_span("send_scan");
+            output_socket.send_scan(nodes, count);
+            send_span.end();
+            revolutions_published++;
+            if (outage_start_us) {
+                time_to_first_scan_us = monotonicTimeUs() - outage_start_us;
+                outage_start_us = 0;
+                printf("First scan published after %llu ms\n", (unsigned long long)(time_to_first_scan_us / 1000));
+            }
+            publish_duration_us.observe(monotonicTimeUs() - publish_start_us);
+            if (speed_controller) reportMotorSpeed();
             delay((unsigned long long)10);
             fail_count = 0;
         }
-        if (!ctrl_c_pressed) {
+        if (speed_controller) speed_controller->stop();
+        if (!scan_mode_chosen) {
+            // mode=auto from a client
+            drv->stop();
+        }
+        else if (!ctrl_c_pressed) {
             drv->stop();
             runMotor(0);
+            lidar_restarts++;
+            outage_start_us = monotonicTimeUs();
             fprintf(stderr, "Lidar disconnected\n");
         }
     }
 
     printf("End of program\n");
     drv->stop();
-    drv->disconnect();
     runMotor(0);
+    drv->disconnect();
     RPlidarDriver::DisposeDriver(drv);
     drv = NULL;
+    LidarCapabilityCache::DisposeCache(capability_cache);
+    if (speed_controller) MotorSpeedController::DisposeController(speed_controller);
+#if OUTPUT_MULTICAST
+    ScanMulticastPublisher::DisposePublisher(publisher);
+#endif
+#if OUTPUT_SHARED_MEMORY
+    ScanShmPublisher::DisposePublisher(shm_publisher);
+#endif
+#if MOTOR_BACKEND == MOTOR_PIGPIO
     gpioTerminate();
+#endif
     return 0;
 }
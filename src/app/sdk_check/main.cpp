@@ -0,0 +1,297 @@
+/*
+ *  RPLIDAR A3
+ *  SDK checks
+ *  Runs the parts of the SDK which do not need a lidar against known
+ *  inputs, prints the failed checks and exits with a non-zero status when
+ *  one of them failed. Run it after a change of the SDK:
+ *  ./output/Linux/Release/sdk_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+#include "rplidar.h"
+
+using namespace rp::standalone::rplidar;
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static bool check(bool cond, const char * text, const char * file, int line)
+{
+    if (!cond) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+        ++failures;
+    }
+    return cond;
+}
+
+/* One revolution of NODE_COUNT nodes, the nodes in [skip_begin, skip_end) are left out */
+#define NODE_COUNT 1600
+static size_t make_revolution(rplidar_response_measurement_node_hq_t * nodes, size_t skip_begin, size_t skip_end)
+{
+    size_t count = 0;
+    for (size_t pos = 0; pos < NODE_COUNT; ++pos) {
+        if (pos >= skip_begin && pos < skip_end) continue;
+        rplidar_response_measurement_node_hq_t & node = nodes[count++];
+        node.angle_z_q14 = (_u16)((pos << 16) / NODE_COUNT);
+        node.dist_mm_q2 = (_u32)(1000 + pos) << 2;
+        node.quality = 188;
+        node.flag = 0;
+    }
+    return count;
+}
+
+/* Whether a decoded revolution holds a node in the angle range [angle_begin, angle_end) */
+static bool has_node_in(const rplidar_response_measurement_node_hq_t * nodes, size_t count, _u16 angle_begin, _u16 angle_end)
+{
+    for (size_t pos = 0; pos < count; ++pos) {
+        if (nodes[pos].angle_z_q14 >= angle_begin && nodes[pos].angle_z_q14 < angle_end) return true;
+    }
+    return false;
+}
+
+static void check_codec_delta()
+{
+    ScanEncoder encoder;
+    ScanDecoder decoder;
+    encoder.setDeltaConfig(ScanEncoder::DefaultDeltaConfig());
+
+    std::vector<rplidar_response_measurement_node_hq_t> nodes(NODE_COUNT), decoded(65536);
+    std::vector<_u8> frame(ScanEncoder::MaxFrameSize(NODE_COUNT));
+    const _u16 removed_begin = (_u16)((100 << 16) / NODE_COUNT);
+    const _u16 removed_end = (_u16)((200 << 16) / NODE_COUNT);
+
+    // keyframe, then a delta where the nodes [100, 200) vanished, then a delta where they are back
+    const size_t skips[][2] = {{0, 0}, {100, 200}, {0, 0}};
+    const _u8 types[] = {SCAN_FRAME_TYPE_KEY, SCAN_FRAME_TYPE_DELTA, SCAN_FRAME_TYPE_DELTA};
+    for (size_t step = 0; step < 3; ++step) {
+        size_t count = make_revolution(&nodes[0], skips[step][0], skips[step][1]);
+        size_t size = encoder.encode(&nodes[0], count, &frame[0]);
+        CHECK(frame[2] == types[step]);
+
+        size_t decodedCount = decoded.size(), consumed;
+        if (!CHECK(IS_OK(decoder.decode(&frame[0], size, &decoded[0], decodedCount, consumed)))) return;
+        CHECK(consumed == size);
+        CHECK(decodedCount == count);
+        CHECK(has_node_in(&decoded[0], decodedCount, removed_begin, removed_end) == (skips[step][0] == skips[step][1]));
+    }
+
+    // more bins vanish than the revolution has nodes: a keyframe is sent instead
+    size_t count = make_revolution(&nodes[0], 0, NODE_COUNT - 10);
+    size_t size = encoder.encode(&nodes[0], count, &frame[0]);
+    CHECK(frame[2] == SCAN_FRAME_TYPE_KEY);
+    size_t decodedCount = decoded.size(), consumed;
+    CHECK(IS_OK(decoder.decode(&frame[0], size, &decoded[0], decodedCount, consumed)));
+    CHECK(decodedCount == count);
+}
+
+static void check_scan_copy()
+{
+    std::vector<rplidar_response_measurement_node_hq_t> nodes(NODE_COUNT), copied(NODE_COUNT);
+    size_t count = make_revolution(&nodes[0], 0, 0);
+    // quarters of mm as measured by the standard and HQ modes, down to the smallest distance
+    for (size_t pos = 0; pos < count; ++pos) nodes[pos].dist_mm_q2 = (_u32)pos * 37 + 1;
+
+    Scan scan;
+    scan.assign(&nodes[0], count);
+    scan.copyTo(&copied[0], count);
+    CHECK(count == NODE_COUNT);
+    CHECK(copied[0].flag == RPLIDAR_RESP_MEASUREMENT_SYNCBIT);
+    CHECK(copied[1].flag == RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT);
+    CHECK(copied[count - 1].flag == RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT);
+
+    size_t changed = 0;
+    for (size_t pos = 0; pos < count; ++pos) {
+        if (copied[pos].dist_mm_q2 != nodes[pos].dist_mm_q2) ++changed;
+    }
+    CHECK(changed == 0);
+    CHECK(copied[0].dist_mm_q2 == 1);
+
+    // both layouts convert to the same points, the quarters of mm included
+    std::vector<CartesianPoint> fromNodes(count), fromScan(count);
+    ConvertToCartesian(&nodes[0], count, &fromNodes[0]);
+    ConvertToCartesian(scan, &fromScan[0]);
+    size_t moved = 0;
+    for (size_t pos = 0; pos < count; ++pos) {
+        if (fabsf(fromNodes[pos].x_mm - fromScan[pos].x_mm) > 0.01f || fabsf(fromNodes[pos].y_mm - fromScan[pos].y_mm) > 0.01f) ++moved;
+    }
+    CHECK(moved == 0);
+
+    Scan pushed;
+    pushed.push_back(nodes[1]);
+    CHECK(pushed.size() == 1 && pushed.distances()[0] == 38);
+}
+
+static void check_client_resync()
+{
+    // a server on a loopback port of the system's choice
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    if (!CHECK(server >= 0)) return;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (!CHECK(bind(server, (sockaddr *)&addr, sizeof(addr)) == 0 && listen(server, 1) == 0
+            && getsockname(server, (sockaddr *)&addr, &addrLen) == 0)) {
+        close(server);
+        return;
+    }
+
+    ScanClient * client = ScanClient::CreateClient();
+    int peer = -1;
+    if (CHECK(IS_OK(client->connect("127.0.0.1", ntohs(addr.sin_port))))) peer = accept(server, NULL, NULL);
+    if (CHECK(peer >= 0)) {
+        ScanEncoder encoder;
+        std::vector<rplidar_response_measurement_node_hq_t> nodes(NODE_COUNT);
+        std::vector<_u8> frame(ScanEncoder::MaxFrameSize(NODE_COUNT));
+        size_t count = make_revolution(&nodes[0], 0, 0);
+
+        // frame, text probe and damaged header in between, frame: the second frame is not lost
+        std::vector<_u8> stream;
+        size_t size = encoder.encode(&nodes[0], count, &frame[0]);
+        stream.insert(stream.end(), frame.begin(), frame.begin() + size);
+        const _u8 junk[] = {'M', 0x10, SCAN_FRAME_SYNC_BYTE1, 0x00, 'M', 0x20};
+        stream.insert(stream.end(), junk, junk + sizeof(junk));
+        size = encoder.encode(&nodes[0], count, &frame[0]);
+        stream.insert(stream.end(), frame.begin(), frame.begin() + size);
+        CHECK(send(peer, &stream[0], stream.size(), 0) == (ssize_t)stream.size());
+
+        ScanFrameView view;
+        for (int pos = 0; pos < 2; ++pos) {
+            if (!CHECK(IS_OK(client->waitFrame(view, 1000)))) break;
+            CHECK(!view.is_text);
+            CHECK(view.count == count);
+        }
+        close(peer);
+    }
+    ScanClient::DisposeClient(client);
+    close(server);
+}
+
+static void write_file(const char * path, const char * value)
+{
+    FILE * file = fopen(path, "w");
+    if (!file) return;
+    fputs(value, file);
+    fclose(file);
+}
+
+static long read_file(const char * path)
+{
+    long value = -1;
+    FILE * file = fopen(path, "r");
+    if (!file) return value;
+    if (fscanf(file, "%ld", &value) != 1) value = -1;
+    fclose(file);
+    return value;
+}
+
+static void check_sysfs_pwm_motor()
+{
+    // a temporary directory laid out like /sys/class/pwm/pwmchip0 with channel 0 exported
+    char chip[] = "/tmp/sdk_check_pwmXXXXXX";
+    if (!CHECK(mkdtemp(chip) != NULL)) return;
+    std::string channel = std::string(chip) + "/pwm0";
+    std::string period = channel + "/period", duty = channel + "/duty_cycle", enable = channel + "/enable";
+    std::string missing = std::string(chip) + "/missing";
+
+    mkdir(channel.c_str(), 0700);
+    write_file(period.c_str(), "0");
+    write_file(duty.c_str(), "0");
+    write_file(enable.c_str(), "0");
+
+    {
+        // no such chip, e.g. the pwm overlay is not loaded
+        SysfsPwmMotorDriver motor;
+        CHECK(IS_FAIL(motor.open(missing.c_str(), 0, 25000)));
+        CHECK(!motor.isOpened());
+        CHECK(IS_FAIL(motor.setDuty(50)));
+    }
+
+    {
+        SysfsPwmMotorDriver motor;
+        CHECK(IS_OK(motor.open(chip, 0, 25000)));
+        CHECK(read_file(period.c_str()) == 40000);
+        CHECK(read_file(duty.c_str()) == 0);
+        CHECK(read_file(enable.c_str()) == 1);
+
+        CHECK(IS_OK(motor.setDuty(50)));
+        CHECK(read_file(duty.c_str()) == 20000);
+        CHECK(IS_OK(motor.setDuty(150)));
+        CHECK(read_file(duty.c_str()) == 40000);
+
+        motor.close();
+        CHECK(read_file(duty.c_str()) == 0);
+        CHECK(read_file(enable.c_str()) == 0);
+    }
+
+    unlink(period.c_str());
+    unlink(duty.c_str());
+    unlink(enable.c_str());
+    rmdir(channel.c_str());
+    rmdir(chip);
+}
+
+static void check_capability_cache_load()
+{
+    // lidar 01.. is complete, the next lidar line is malformed: its measurements must not land on 01..
+    char path[] = "/tmp/sdk_check_capsXXXXXX";
+    int fd = mkstemp(path);
+    if (!CHECK(fd >= 0)) return;
+    close(fd);
+    write_file(path,
+        "rplidar-capabilities 1\n"
+        "lidar 01000000000000000000000000000000 293 6 97 2 1\n"
+        "mode 2 31.25 25 130 Boost\n"
+        "measured 256000 1\n"
+        "measure 2 32000 31800 0.99 0 0.1\n"
+        "lidar 0200 293 6 97 2 1\n"
+        "mode 2 31.25 25 130 Boost\n"
+        "measured 115200 1\n"
+        "measure 2 32000 1000 0.1 0.5 0.9\n");
+
+    LidarCapabilityCache * cache = LidarCapabilityCache::CreateCache(path);
+    CHECK(cache->size() == 1);
+
+    rplidar_response_device_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.serialnum[0] = 1;
+    info.firmware_version = 293;
+    LidarCapabilities capabilities;
+    if (CHECK(cache->find(info, capabilities))) {
+        CHECK(capabilities.measured_baudrate == 256000);
+        CHECK(capabilities.measurements.size() == 1);
+        CHECK(capabilities.measurements.size() == 1 && capabilities.measurements[0].measured_sps == 31800);
+    }
+
+    LidarCapabilityCache::DisposeCache(cache);
+    unlink(path);
+}
+
+int main()
+{
+    check_codec_delta();
+    check_scan_copy();
+    check_client_resync();
+    check_sysfs_pwm_motor();
+    check_capability_cache_load();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return -1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ *  RPLIDAR A3
+ *  Serial to TCP bridge
+ *  Reads the raw byte stream of the lidar UART and forwards it, untouched,
+ *  to every connected TCP client so that the decoding can run elsewhere
+ *  (RPlidarDriver::CreateDriver(DRIVER_TYPE_TCP) on another machine, or
+ *  several local processes sharing the same sensor).
+ *  One client controls the lidar: the first one connected while there is
+ *  no controller, e.g. an RPlidarDriverTCP. The others are passive
+ *  listeners which decode the stream only: the answers are not routed, so
+ *  a listener sending a command is disconnected rather than left waiting
+ *  for an answer, or breaking the queries of the controller.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "sdkcommon.h"
+#include "hal/abs_rxtx.h"
+#include "hal/socket.h"
+#include "rplidar_protocol.h"
+
+/* Settings */
+#define BRIDGE_PORT         17686
+#define DEFAULT_SERIAL_PORT "/dev/ttyAMA0"
+#define DEFAULT_BAUDRATE    256000
+#define MAX_CLIENTS         4
+#define READ_BUFFER_SIZE    4096
+#define POLL_INTERVAL       5       // ms, upper bound of the command forwarding latency
+#define REQUEST_BUFFER_SIZE 512     // a request takes at most 4 + 255 bytes
+
+using namespace rp::net;
+using namespace rp::hal;
+
+/* Signal handler for CTRL+C */
+bool ctrl_c_pressed = false;
+void ctrlc(int)
+{
+    ctrl_c_pressed = true;
+}
+
+struct Client
+{
+    StreamSocket * socket;
+    _u8 request[REQUEST_BUFFER_SIZE];   // bytes received, up to the end of the last complete request
+    size_t request_len;
+};
+
+Client clients[MAX_CLIENTS];
+int controller = -1;
+
+void drop_client(int slot)
+{
+    printf("Client %d disconnected\n", slot);
+    clients[slot].socket->dispose();
+    clients[slot].socket = NULL;
+    if (slot == controller) controller = -1;
+}
+
+void accept_clients(StreamSocket * server)
+{
+    while (server->waitforIncomingConnection(0) == RESULT_OK) {
+        StreamSocket * client = server->accept();
+        if (!client) return;
+
+        int slot = 0;
+        while (slot < MAX_CLIENTS && clients[slot].socket) slot++;
+        if (slot == MAX_CLIENTS) {
+            fprintf(stderr, "Too many clients, connection refused\n");
+            client->dispose();
+            continue;
+        }
+
+        // a client which does not keep up is dropped, the UART is never held up by it
+        client->enableNonBlocking(true);
+        client->enableNoDelay(true);
+        clients[slot].socket = client;
+        clients[slot].request_len = 0;
+        if (controller == -1) controller = slot;
+        printf("Client %d connected%s\n", slot, slot == controller ? " (controller)" : " (listener)");
+    }
+}
+
+/* Size of the request starting at data, 0 if it is not complete yet */
+size_t request_size(const _u8 * data, size_t len)
+{
+    if (len < 2) return 0;
+    if (!(data[1] & RPLIDAR_CMDFLAG_HAS_PAYLOAD)) return 2;
+    // sync byte, command, payload size, payload, checksum
+    if (len < 3 || len < (size_t)data[2] + 4) return 0;
+    return (size_t)data[2] + 4;
+}
+
+/* Forward the complete requests of the controller to the lidar */
+void forward_commands(serial_rxtx * serial, int slot)
+{
+    Client & client = clients[slot];
+    while (client.socket->waitforData(0) == RESULT_OK) {
+        size_t len = 0;
+        u_result ans = client.socket->recv(client.request + client.request_len, sizeof(client.request) - client.request_len, len);
+        if (ans == RESULT_OPERATION_TIMEOUT) break;
+        if (IS_FAIL(ans) || len == 0) {
+            drop_client(slot);
+            return;
+        }
+        if (slot != controller) {
+            fprintf(stderr, "Client %d is a listener, its commands are rejected\n", slot);
+            drop_client(slot);
+            return;
+        }
+        client.request_len += len;
+
+        size_t pos = 0;
+        while (pos < client.request_len) {
+            if (client.request[pos] != RPLIDAR_CMD_SYNC_BYTE) {
+                // not the start of a request
+                pos++;
+                continue;
+            }
+            size_t size = request_size(client.request + pos, client.request_len - pos);
+            if (!size) break;
+            // whole requests only, a new controller does not complete the request of the previous one
+            serial->senddata(client.request + pos, size);
+            pos += size;
+        }
+        client.request_len -= pos;
+        memmove(client.request, client.request + pos, client.request_len);
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    signal(SIGINT, ctrlc);
+    signal(SIGPIPE, SIG_IGN);
+
+    const char * opt_com_path = DEFAULT_SERIAL_PORT;
+    _u32 opt_com_baudrate = DEFAULT_BAUDRATE;
+    int opt_port = BRIDGE_PORT;
+    // the same buffer is handed to every client: nothing is copied per client
+    static _u8 buffer[READ_BUFFER_SIZE];
+
+    // read serial port from the command line if specified...
+    if (argc > 1)
+    {
+        opt_com_path = argv[1];
+    }
+
+    // read baud rate from the command line if specified...
+    if (argc > 2)
+    {
+        unsigned long bd = strtoul(argv[2], NULL, 10);
+        if (bd > 0) {
+            opt_com_baudrate = bd;
+        }
+        else {
+            fprintf(stderr, "invalid baudrate provided, ignored\n");
+        }
+    }
+
+    // read listening port from the command line if specified...
+    if (argc > 3)
+    {
+        unsigned long port = strtoul(argv[3], NULL, 10);
+        if (port > 0 && port < 65536) {
+            opt_port = port;
+        }
+        else {
+            fprintf(stderr, "invalid port provided, ignored\n");
+        }
+    }
+
+    serial_rxtx * serial = serial_rxtx::CreateRxTx();
+    if (!serial->bind(opt_com_path, opt_com_baudrate) || !serial->open()) {
+        fprintf(stderr, "Error, cannot bind to the specified serial port %s, exit\n"
+            , opt_com_path);
+        serial_rxtx::ReleaseRxTx(serial);
+        exit(-3);
+    }
+    printf("Serial port %s opened with baudrate %u\n", opt_com_path, opt_com_baudrate);
+
+    StreamSocket * server = StreamSocket::CreateSocket();
+    SocketAddress address;
+    address.setAnyAddress();
+    address.setPort(opt_port);
+    if (!server || IS_FAIL(server->bind(address)) || IS_FAIL(server->listen())) {
+        fprintf(stderr, "Error, cannot listen on port %d, exit\n", opt_port);
+        if (server) server->dispose();
+        serial_rxtx::ReleaseRxTx(serial);
+        exit(-4);
+    }
+    printf("Listening on port %d\n", opt_port);
+
+    while (!ctrl_c_pressed)
+    {
+        accept_clients(server);
+        for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+            if (clients[slot].socket) forward_commands(serial, slot);
+        }
+
+        size_t available = 0;
+        int ans = serial->waitfordata(1, POLL_INTERVAL, &available);
+        if (ans == serial_rxtx::ANS_DEV_ERR && !ctrl_c_pressed) {
+            fprintf(stderr, "Serial port error, exit\n");
+            break;
+        }
+        if (ans != serial_rxtx::ANS_OK) continue;
+
+        if (available > sizeof(buffer)) available = sizeof(buffer);
+        int len = serial->recvdata(buffer, available);
+        if (len <= 0) continue;
+
+        for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+            if (clients[slot].socket && IS_FAIL(clients[slot].socket->send(buffer, len))) {
+                // its socket buffer is full: a partial send would break the framing for this client anyway
+                drop_client(slot);
+            }
+        }
+    }
+
+    printf("End of program\n");
+    for (int slot = 0; slot < MAX_CLIENTS; slot++) {
+        if (clients[slot].socket) clients[slot].socket->dispose();
+    }
+    server->dispose();
+    serial->close();
+    serial_rxtx::ReleaseRxTx(serial);
+    return 0;
+}
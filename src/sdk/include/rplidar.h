@@ -40,5 +40,18 @@
 #include "rplidar_cmd.h"
 
 #include "rplidar_driver.h"
+#include "rplidar_metrics.h"
+#include "rplidar_trace.h"
+#include "rplidar_motor.h"
+#include "rplidar_capabilities.h"
+#include "rplidar_scan.h"
+#include "rplidar_cartesian.h"
+#include "rplidar_filter.h"
+#include "rplidar_codec.h"
+#include "rplidar_multicast.h"
+#include "rplidar_shm.h"
+#include "rplidar_client.h"
+#include "rplidar_manager.h"
+#include "rplidar_fusion.h"
 
 #define RPLIDAR_SDK_VERSION  "1.10.0"
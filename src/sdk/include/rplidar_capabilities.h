@@ -0,0 +1,122 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// How a scan mode performed on this host, see MeasureScanModes()
+struct ScanModeMeasurement {
+    _u16    id;
+    float   nominal_sps;            // samples per second given by us_per_sample
+    float   measured_sps;           // samples per second received, lower when the channel is too slow for the mode
+    float   valid_ratio;            // share of the samples with a distance
+    float   checksum_error_ratio;   // share of the measurement units dropped on a checksum or CRC mismatch
+    float   decode_load;            // share of the time the acquisition spent decoding
+};
+
+/// What the configuration queries of a lidar returned, for one serial number and firmware version
+struct LidarCapabilities {
+    _u8     serialnum[16];
+    _u16    firmware_version;
+    _u8     hardware_version;
+    _u8     model;
+
+    _u16    typical_mode;
+    std::vector<RplidarScanMode> modes;     // as returned by getAllSupportedScanModes
+
+    // filled by the application after MeasureScanModes(), the checksum errors depend on the baudrate
+    _u32    measured_baudrate;              // 0 when the modes were not measured
+    std::vector<ScanModeMeasurement> measurements;
+
+    LidarCapabilities() : measured_baudrate(0) {}
+};
+
+/// What SelectScanMode() looks for
+enum ScanModeObjective {
+    SCAN_MODE_OBJECTIVE_DENSITY = 0,        // most valid samples per second
+    SCAN_MODE_OBJECTIVE_RANGE = 1,          // longest max_distance, then density
+    SCAN_MODE_OBJECTIVE_QUALITY = 2,        // highest share of valid samples, then density
+};
+
+enum {
+    DEFAULT_MODE_MEASURE_DURATION = 1000,   // ms of scan measured per mode
+};
+
+/// Run each supported scan mode in turn and measure it, for SelectScanMode().
+/// The motor must be spinning, the scan of the last mode is stopped on return.
+///
+/// \param drv            A connected driver, which is not scanning
+/// \param measurements   One per mode which could be started
+/// \param durationMs     Time measured in each mode, after its spin-up
+u_result MeasureScanModes(RPlidarDriver * drv, std::vector<ScanModeMeasurement> & measurements, _u32 durationMs = DEFAULT_MODE_MEASURE_DURATION);
+
+/// Choose the best measured mode for the objective. A mode is only considered when the channel keeps up
+/// with it, its checksum errors are rare and its decoding leaves most of the CPU to the application.
+///
+/// The interface will return RESULT_OPERATION_FAIL when no measured mode is usable.
+u_result SelectScanMode(const LidarCapabilities & capabilities, int objective, _u16 & outMode);
+
+/// Capabilities of the lidars met so far, shared by the drivers (see RPlidarDriver::setCapabilityCache).
+/// Once a lidar is known, the driver answers the scan mode queries (getAllSupportedScanModes,
+/// getTypicalScanMode, getLidarSampleDuration...) from the cache, and starting a scan takes a single
+/// command. The cache may be persisted to a file, so that the next process starts as fast.
+/// A firmware update changes the key, the capabilities of the previous firmware are then unused.
+class LidarCapabilityCache {
+public:
+    /// \param path           File loaded now and rewritten when a lidar is added, NULL to keep the cache in memory
+    static LidarCapabilityCache * CreateCache(const char * path = NULL);
+    static void DisposeCache(LidarCapabilityCache * cache);
+
+    /// Look up the lidar described by the device info
+    virtual bool find(const rplidar_response_device_info_t & info, LidarCapabilities & capabilities) = 0;
+
+    /// Add or replace the capabilities of a lidar, and persist the cache if it has a file
+    virtual void store(const LidarCapabilities & capabilities) = 0;
+
+    /// Forget every lidar, e.g. when a cached answer turned out to be wrong
+    virtual void clear() = 0;
+
+    virtual size_t size() = 0;
+
+    virtual ~LidarCapabilityCache() {}
+protected:
+    LidarCapabilityCache() {}
+};
+
+}}}
@@ -0,0 +1,66 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// A node in the lidar frame: x along the 0 degree direction, y to its left
+/// (the lidar angles grow clockwise, so a node at 90 degrees has a negative y)
+struct CartesianPoint {
+    float   x_mm;
+    float   y_mm;
+};
+
+/// Convert a batch of nodes to the lidar frame.
+/// The sine and cosine are read from a table indexed by angle_z_q14 itself, a full turn
+/// being the 65536 values of the field, and the products are vectorised with SSE2 or NEON
+/// when the target supports them. Nodes without measurement give the (0, 0) point.
+///
+/// \param nodes          The nodes to convert, e.g. retrieved with grabScanDataHq
+/// \param count          The number of nodes
+/// \param points         Buffer provided by the caller, of at least count points
+void ConvertToCartesian(const rplidar_response_measurement_node_hq_t * nodes, size_t count, CartesianPoint * points);
+
+/// Same for a revolution in structure-of-arrays layout, whose distances are loaded four at a time
+///
+/// \param scan           The revolution to convert
+/// \param points         Buffer provided by the caller, of at least scan.size() points
+void ConvertToCartesian(const Scan & scan, CartesianPoint * points);
+
+}}}
@@ -0,0 +1,106 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+struct ScanClientStats {
+    _u32    frames;             // revolutions delivered
+    _u32    lost_frames;        // deltas which could not be applied, and frames which could not be parsed
+    _u32    reconnections;
+    _u32    last_transfer_us;   // from the first to the last byte of the last frame
+    _u32    max_transfer_us;
+    _u32    last_period_us;     // between the completion of the last two frames
+    _u32    max_period_us;
+};
+
+/// One revolution, valid until the next call to ScanClient::waitFrame()
+struct ScanFrameView {
+    const _u8 * data;           // the frame as received, in the receive buffer of the client
+    size_t      size;
+    bool        is_text;        // "angle:distance:quality;" records, else a binary frame (see rplidar_codec.h)
+    const rplidar_response_measurement_node_hq_t * nodes;   // decoded once, owned by the client
+    size_t      count;
+    _u64        timestamp_us;   // reception of the last byte, getus() clock
+};
+
+/// Client of the scan stream served over TCP by the cdr2019 application.
+/// The text and the binary frames are told apart on their first byte, so the same client reads
+/// both output formats; once a binary frame was received, damaged or stray bytes are skipped up
+/// to the next frame header. The connection is opened again when it breaks, the subscription (if any)
+/// being sent again, and a keyframe is requested when a delta is lost.
+class ScanClient {
+public:
+    enum {
+        DEFAULT_PORT = 17685,
+        DEFAULT_TIMEOUT = 2000,         //2000 ms
+        RECONNECT_INTERVAL = 1000,      //1000 ms
+        DEFAULT_BUFFER_SIZE = 256 * 1024,
+    };
+
+    static ScanClient * CreateClient();
+    static void DisposeClient(ScanClient * client);
+
+    /// \param host           IPv4 address of the server
+    ///
+    /// The address is remembered for the reconnections, which happen within waitFrame().
+    virtual u_result connect(const char * host, int port = DEFAULT_PORT) = 0;
+    virtual void disconnect() = 0;
+    virtual bool isConnected() = 0;
+
+    /// Send a request line to the server, e.g. "SUBSCRIBE angle=-90:90".
+    /// The last request is sent again after each reconnection.
+    virtual u_result subscribe(const char * request) = 0;
+
+    /// Wait for the next complete revolution, reconnecting if needed.
+    /// The empty revolutions the server sends to probe its clients are skipped.
+    ///
+    /// \param timeout        Max duration allowed to wait for a revolution
+    ///
+    /// The interface will return RESULT_OPERATION_TIMEOUT when no revolution is completed within the given timeout duration.
+    virtual u_result waitFrame(ScanFrameView & frame, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    virtual void getStats(ScanClientStats & stats) = 0;
+
+    virtual ~ScanClient() {}
+protected:
+    ScanClient() {}
+};
+
+}}}
@@ -141,6 +141,7 @@ typedef struct _rplidar_response_acc_board_flag_t {
 #define RPLIDAR_STATUS_ERROR              0x2
 
 #define RPLIDAR_RESP_MEASUREMENT_SYNCBIT        (0x1<<0)
+#define RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT (0x1<<1)
 #define RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT  2
 
 #define RPLIDAR_RESP_HQ_FLAG_SYNCBIT               (0x1<<0)
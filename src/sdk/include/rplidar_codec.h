@@ -0,0 +1,163 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// Compact binary encoding of complete revolutions, for the links with a limited bandwidth.
+///
+/// A frame is made of a fixed header followed by three sections, the integers being
+/// LEB128 varints and the signed ones zig-zag mapped first:
+///   header     sync bytes (0xA5 0x3C), frame type (u8), size of the rest of the frame (u32, little endian)
+///   count      number of nodes
+///   angles     first angle_z_q14, then for each following node the difference between its angle step
+///              and the previous step, modulo 2^16 (a constant sample rate gives a stream of zeros)
+///   distances  for each node 0 when there is no measurement, else 1 + the difference in dist_mm_q2
+///              with the previous measured node
+///   qualities  runs of identical quality: run length, then the quality (u8)
+/// The encoding is lossless, except for the flags: the first node of a frame gets the sync bit.
+///
+/// In delta mode, both ends keep the last node sent in each of bin_count angular bins. Keyframes
+/// and deltas start with the sequence number of the frame and bin_count:
+///   keyframe   the three sections above, holding the content of the non-empty bins
+///   delta      number of cleared bins and their indices (gap to the previous cleared bin), then the
+///              number of changed bins, their indices, the angles (offset to the start of the bin), the
+///              distances (0 when there is no measurement, else 1 + the difference with the previous
+///              content of the bin) and the quality runs
+/// A bin is cleared when no node fell in it during the revolution. A bin changes when its distance moved
+/// by more than threshold_mm or its measurement appeared or vanished. A keyframe is sent instead of a
+/// delta which would clear more bins than the revolution has nodes.
+/// A receiver which misses a delta asks for a keyframe by sending SCAN_STREAM_KEYFRAME_REQUEST.
+enum {
+    SCAN_FRAME_SYNC_BYTE1 = 0xA5,
+    SCAN_FRAME_SYNC_BYTE2 = 0x3C,
+    SCAN_FRAME_HEADER_SIZE = 7,
+    SCAN_STREAM_KEYFRAME_REQUEST = 'K',
+};
+
+enum {
+    SCAN_FRAME_TYPE_FULL = 0,   // self-contained revolution
+    SCAN_FRAME_TYPE_KEY = 1,    // content of every bin, resets the receiver
+    SCAN_FRAME_TYPE_DELTA = 2,  // changed bins only, relative to the previous frame
+};
+
+struct ScanDeltaConfig {
+    size_t  bin_count;          // angular bins compared between revolutions, 0 disables the delta mode
+    _u32    threshold_mm;       // smaller distance changes are not sent
+    _u32    keyframe_interval;  // frames between two keyframes
+};
+
+class ScanEncoder {
+public:
+    ScanEncoder();
+
+    /// Upper bound of the size of a frame holding count nodes
+    static size_t MaxFrameSize(size_t count);
+
+    static ScanDeltaConfig DefaultDeltaConfig();
+
+    /// Send keyframes and deltas instead of self-contained frames, the next frame is a keyframe
+    void setDeltaConfig(const ScanDeltaConfig & config);
+
+    /// Make the next frame a keyframe, e.g. when a receiver connects or asks for it
+    void requestKeyframe();
+
+    /// Encode one revolution, in a single pass over the nodes.
+    ///
+    /// \param buffer         Buffer provided by the caller, of at least MaxFrameSize(count) bytes
+    ///
+    /// \return the size of the frame written to buffer
+    size_t encode(const rplidar_response_measurement_node_hq_t * nodes, size_t count, _u8 * buffer);
+
+protected:
+    _u8 * _encodeKeyframe(_u8 * out);
+    _u8 * _encodeDelta(_u8 * out);
+    size_t _collectCleared();
+
+    ScanDeltaConfig     _config;
+    _u32                _sequence;
+    _u32                _framesSinceKeyframe;
+    bool                _keyframeRequested;
+
+    // content of the bins as known by the receivers, and the bins of the revolution being encoded
+    std::vector<rplidar_response_measurement_node_hq_t> _bins;
+    std::vector<_u8>    _binUsed;
+    std::vector<rplidar_response_measurement_node_hq_t> _current;
+    std::vector<_u8>    _currentUsed;
+    // bins sent in the frame being encoded
+    std::vector<_u32>   _cleared;
+    std::vector<_u32>   _changed;
+    std::vector<rplidar_response_measurement_node_hq_t> _frame;
+};
+
+class ScanDecoder {
+public:
+    ScanDecoder();
+
+    /// Decode the frame at the beginning of a received byte stream.
+    /// Keyframes and deltas give the content of every non-empty bin, in the order of the bins.
+    ///
+    /// \param data           The received bytes, starting with the sync bytes of a frame
+    /// \param size           The number of received bytes
+    /// \param nodes          Buffer provided by the caller to hold the decoded nodes
+    /// \param count          The size of the node buffer. Once the interface returns, this parameter will store the actual decoded node count.
+    /// \param consumed       Once the interface returns RESULT_OK or RESULT_OPERATION_FAIL, this parameter will store the size of the frame.
+    ///
+    /// The interface will return RESULT_OPERATION_TIMEOUT when the frame is not fully received yet,
+    /// RESULT_INSUFFICIENT_MEMORY when the node buffer is too small, and RESULT_INVALID_DATA when the
+    /// bytes are not a valid frame: the caller should then skip one byte to resynchronize on the next frame.
+    /// It will return RESULT_OPERATION_FAIL for a delta which does not follow the previous frame: the
+    /// deltas are then skipped until the next keyframe (see isKeyframeNeeded).
+    u_result decode(const _u8 * data, size_t size, rplidar_response_measurement_node_hq_t * nodes, size_t & count, size_t & consumed);
+
+    /// Whether the deltas cannot be applied: the sender should be asked for a keyframe
+    bool isKeyframeNeeded();
+
+protected:
+    bool                _hasReference;
+    bool                _keyframeNeeded;
+    _u32                _sequence;
+    std::vector<rplidar_response_measurement_node_hq_t> _bins;
+    std::vector<_u8>    _binUsed;
+    std::vector<rplidar_response_measurement_node_hq_t> _changes;
+    std::vector<_u32>   _cleared;
+    std::vector<_u32>   _changed;
+};
+
+}}}
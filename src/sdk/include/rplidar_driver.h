@@ -52,6 +52,12 @@
 
 namespace rp { namespace standalone{ namespace rplidar {
 
+class ScanFilter;
+struct RplidarDriverMetrics;
+class MotorSpeedController;
+class LidarCapabilityCache;
+class Scan;
+
 struct RplidarScanMode {
     _u16    id;
     float   us_per_sample;   // microseconds per sample
@@ -63,11 +69,15 @@ struct RplidarScanMode {
 enum {
     DRIVER_TYPE_SERIALPORT = 0x0,
     DRIVER_TYPE_TCP = 0x1,
+    // Linux only: receive path driven by io_uring, see arch/linux/net_uring.h
+    DRIVER_TYPE_SERIALPORT_URING = 0x2,
+    DRIVER_TYPE_TCP_URING = 0x3,
 };
 
 class ChannelDevice
 {
 public:
+    virtual ~ChannelDevice() {}
     virtual bool bind(const char*, uint32_t ) = 0;
     virtual bool open() {return true;}
     virtual void close() = 0;
@@ -78,12 +88,31 @@ public:
     virtual void setDTR() {return;}
     virtual void clearDTR() {return;}
     virtual void ReleaseRxTx() {return;}
+    // true once after the link was established again by the device itself:
+    // the lidar on the other end no longer knows the scan request
+    virtual bool takeReconnected() {return false;}
+    // descriptor for poll(), readable when data arrives; -1 if there is none
+    virtual int getNativeHandle() {return -1;}
+    // cut a waitfordata() in progress short, it then fails as a timeout; when no wait is in progress,
+    // the next one is cut short instead
+    virtual void cancelWait() {return;}
+    // true once after a waitfordata() was cut short by cancelWait(), its timeout is no stall
+    virtual bool takeWaitCancelled() {return false;}
+};
+
+/// Means tried in turn by RPlidarDriver::recoverScan()
+enum ScanRecoveryLevel {
+    SCAN_RECOVERY_RESYNC = 0,       // drop the bytes received and the revolution being assembled
+    SCAN_RECOVERY_RESTART = 1,      // send the scan command again, the motor keeps spinning
+    SCAN_RECOVERY_RESET = 2,        // reset the lidar, restore its motor PWM and send the scan command again
+    SCAN_RECOVERY_LEVELS = 3,
 };
 
 class RPlidarDriver {
 public:
     enum {
         DEFAULT_TIMEOUT = 2000, //2000 ms
+        DEFAULT_READY_TIMEOUT = 5000, //5000 ms, spin-up or reboot of the lidar
     };
 
     enum {
@@ -99,6 +128,9 @@ public:
     /// This interface should be invoked first before any other operations
     ///
     /// \param drivertype the connection type used by the driver. 
+    ///                   The *_URING types are only available on Linux builds with io_uring support,
+    ///                   NULL is returned otherwise. DRIVER_TYPE_TCP_URING is connected like a serial
+    ///                   port, with the ip address as path and the tcp port as baudrate.
     static RPlidarDriver * CreateDriver(_u32 drivertype = DRIVER_TYPE_SERIALPORT);
 
     /// Dispose the RPLIDAR Driver Instance specified by the drv parameter
@@ -156,6 +188,19 @@ public:
     /// \param outUsedScanMode  The scan mode selected by lidar
     virtual u_result startScanExpress(bool force, _u16 scanMode, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL, _u32 timeout = DEFAULT_TIMEOUT) = 0;
 
+    /// Switch the scan in progress to another scan mode, keeping the acquisition thread and its buffers
+    /// The motor keeps spinning: only the revolution in progress is lost, the next one is published in the new mode.
+    ///
+    /// \param scanMode         The scan mode id, which must be known by the capability cache (see setCapabilityCache)
+    /// \param options          Scan options (please use 0)
+    /// \param outUsedScanMode  The scan mode selected by lidar
+    /// \param timeout          The operation timeout value (in millisecond) for the serial port communication
+    ///
+    /// The interface will return RESULT_ALREADY_DONE when the scan is already in this mode, RESULT_OPERATION_FAIL when
+    /// no scan is in progress, and RESULT_OPERATION_NOT_SUPPORT when the mode is not cached: the lidar cannot be queried while it scans.
+    /// When the lidar does not answer, its scan is stopped and recoverScan() starts it again in the new mode.
+    virtual u_result switchScanMode(_u16 scanMode, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
     /// Retrieve the health status of the RPLIDAR
     /// The host system can use this operation to check whether RPLIDAR is in the self-protection mode.
     ///
@@ -182,12 +227,41 @@ public:
     /// \param pwm           The motor pwm value would like to set 
     virtual u_result setMotorPWM(_u16 pwm) = 0;
 
-    /// Start RPLIDAR's motor when using accessory board
+    /// Start RPLIDAR's motor when using accessory board.
+    /// Returns without waiting for the spin-up, see waitScanReady()
     virtual u_result startMotor() = 0;
 
     /// Stop RPLIDAR's motor when using accessory board
     virtual u_result stopMotor() = 0;
 
+    /// Wait until the lidar answers requests, e.g. after reset() or a power loss.
+    /// The device info is requested again every few hundred milliseconds until it is received.
+    ///
+    /// \param timeout        Max duration allowed to wait for the lidar
+    virtual u_result waitDeviceReady(_u32 timeout = DEFAULT_READY_TIMEOUT) = 0;
+
+    /// Wait until the scan in progress delivers revolutions of a stable period, i.e. the motor
+    /// finished its spin-up. The delay since the scan request is kept as the scan_ready_us metric.
+    /// Returns immediately when the scan is already stable.
+    ///
+    /// \param timeout        Max duration allowed to wait for a stable revolution
+    ///
+    /// The interface will return RESULT_OPERATION_FAIL when no scan is in progress.
+    virtual u_result waitScanReady(_u32 timeout = DEFAULT_READY_TIMEOUT) = 0;
+
+    /// Bring back a scan whose revolutions stopped coming (grabScanDataHq() failed), by the least
+    /// disruptive mean which works: resynchronizing the stream in place, then sending the last scan
+    /// command again, then resetting the lidar (see ScanRecoveryLevel). A recovery which did not
+    /// last a few seconds is not tried again, the next call starts from the following level.
+    /// The attempts, successes and durations of each level are counted in getMetrics().
+    ///
+    /// \param outLevel       The level which brought the scan back
+    /// \param timeout        Max duration allowed to the restart and to the reset to give a stable revolution
+    ///
+    /// The interface will return RESULT_OPERATION_FAIL when every level failed, the connection must then be
+    /// established again, and RESULT_OPERATION_NOT_SUPPORT with the external acquisition.
+    virtual u_result recoverScan(int & outLevel, _u32 timeout = DEFAULT_READY_TIMEOUT) = 0;
+
     /// Check whether the device support motor control.
     /// Note: this API will disable grab.
     /// 
@@ -271,6 +345,8 @@ public:
     /// \param timeout        Max duration allowed to wait for a complete scan data, nothing will be stored to the nodebuffer if a complete 360-degrees' scan data cannot to be ready timely.
     ///
     /// The interface will return RESULT_OPERATION_TIMEOUT to indicate that no complete 360-degrees' scan can be retrieved withing the given timeout duration. 
+    /// It also returns RESULT_OPERATION_TIMEOUT as soon as a stable scan missed a few capsules in a row (stalls metric),
+    /// once per stall, so that the caller may call recoverScan() within the revolution.
     ///
     /// \The caller application can set the timeout value to Zero(0) to make this interface always returns immediately to achieve non-block operation.
     virtual u_result grabScanDataHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u32 timeout = DEFAULT_TIMEOUT) = 0;
@@ -311,6 +387,62 @@ public:
     /// The interface will return RESULT_OPERATION_TIMEOUT to indicate that not even a single node can be retrieved since last call. 
     virtual u_result getScanDataWithIntervalHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count) = 0;
 
+    /// Same as grabScanDataHq, also returns when the grabbed revolution started
+    ///
+    /// \param timestamp_us   Arrival time of the first sample of the revolution, in microseconds (getus() clock)
+    virtual u_result grabScanDataHqWithTimeStamp(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 & timestamp_us, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    /// Same as grabScanDataHq, without converting the revolution to an array of nodes
+    ///
+    /// \param scan           Receives the revolution and its timestamp_us. Its buffers are exchanged with the ones of the driver,
+    ///                       reuse the same Scan for each call to avoid any allocation.
+    virtual u_result grabScan(Scan & scan, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    /// Do not create the background thread when a scan is started.
+    /// The scan data are then only decoded when the application invokes pumpScanData(),
+    /// which allows one thread to serve several lidars (see LidarManager).
+    /// The interface will return RESULT_OPERATION_FAIL when a scan is in progress.
+    virtual u_result setExternalAcquisition(bool enable) = 0;
+
+    /// Decode the scan data received so far, when the external acquisition is enabled.
+    /// Completed revolutions are retrieved with grabScanDataHq() as usual.
+    ///
+    /// \param timeout        Max duration allowed to wait for data when none is pending, 0 to return immediately
+    ///
+    /// The interface will return RESULT_OPERATION_TIMEOUT when no data arrived, and RESULT_OPERATION_FAIL
+    /// when no scan is in progress or the scan was aborted by a communication failure.
+    virtual u_result pumpScanData(_u32 timeout = 0) = 0;
+
+    /// Descriptor of the channel to the lidar, which becomes readable when data arrives,
+    /// so that one thread can poll() several lidars before calling pumpScanData().
+    /// It may change when the channel reconnects, query it again before each wait.
+    ///
+    /// \return -1 when the channel has none (Windows, io_uring channels)
+    virtual int getNativeHandle() = 0;
+
+    /// Filter every completed revolution before it is published to grabScanDataHq().
+    /// The nodes returned by getScanDataWithInterval() are not filtered.
+    ///
+    /// \param filter         The filter to apply, NULL to disable the filtering. It must outlive the scan.
+    virtual void setScanFilter(ScanFilter * filter) = 0;
+
+    /// Counters of the acquisition (bytes, decoded units, checksum errors, resynchronizations) and
+    /// of the assembled revolutions (period, jitter, node count), see rplidar_metrics.h.
+    /// They are updated with relaxed atomics and may be read from any thread while scanning.
+    virtual const RplidarDriverMetrics & getMetrics() = 0;
+
+    /// Feed the period of every completed revolution to a speed controller, from the acquisition thread.
+    ///
+    /// \param controller     The controller, NULL to detach it. It must outlive the scan.
+    virtual void setSpeedController(MotorSpeedController * controller) = 0;
+
+    /// Answer the scan mode queries from a cache of the lidars met so far, once getDeviceInfo()
+    /// identified the connected one (see rplidar_capabilities.h). A lidar missing from the cache
+    /// has all its scan modes queried by the first startScan(), and is then added to the cache.
+    ///
+    /// \param cache          The cache, NULL to always query the lidar. It must outlive the driver.
+    virtual void setCapabilityCache(LidarCapabilityCache * cache) = 0;
+
     virtual ~RPlidarDriver() {}
 protected:
     RPlidarDriver(){}
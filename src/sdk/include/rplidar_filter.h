@@ -0,0 +1,114 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+struct ScanFilterConfig {
+    size_t  bin_count;              // angular bins of the temporal median
+    size_t  median_depth;           // revolutions in the median window, current one included; < 2 disables the stage
+    _u32    isolation_mm;           // distance jump to both neighbours marking an isolated point; 0 disables the check
+    float   shadow_min_angle_deg;   // surfaces seen under a smaller incidence angle are edge shadows; 0 disables the check
+};
+
+/// Counters of a ScanFilter, accumulated since the last reset()
+struct ScanFilterStats {
+    _u32    revolutions;
+    _u32    last_median_us;         // time spent by each stage on the last revolution
+    _u32    last_outlier_us;
+    _u64    total_median_us;
+    _u64    total_outlier_us;
+    _u32    isolated_rejected;      // nodes cleared by each check
+    _u32    shadow_rejected;
+};
+
+/// Filters complete revolutions in place, before they are published.
+/// 1) Temporal median: each distance is replaced by the median of its angular bin over the last
+///    median_depth revolutions. The history of a bin takes one sample per revolution and is kept
+///    sorted incrementally, so the cost is O(median_depth) per node.
+/// 2) Outlier rejection, in angular order: isolated points (far from both neighbours) and edge
+///    shadows (mixed pixels between a foreground and a background surface) are cleared.
+/// Rejected nodes are reported as nodes without measurement (distance and quality 0).
+class ScanFilter {
+public:
+    enum {
+        MAX_MEDIAN_DEPTH = 15,
+    };
+
+    ScanFilter();
+
+    static ScanFilterConfig DefaultConfig();
+
+    /// Change the configuration, the history of the median is cleared
+    void setConfig(const ScanFilterConfig & config);
+    void getConfig(ScanFilterConfig & config);
+
+    /// Clear the history of the median and the counters
+    void reset();
+
+    /// Filter one complete revolution in place
+    void process(Scan & scan);
+
+    /// Same on legacy nodes
+    void process(rplidar_response_measurement_node_hq_t * nodes, size_t count);
+
+    void getStats(ScanFilterStats & stats);
+
+protected:
+    void _medianStage(Scan & scan);
+    void _outlierStage(Scan & scan);
+    void _pushHistory(size_t bin, _u32 dist);
+
+    ScanFilterConfig    _config;
+    ScanFilterStats     _stats;
+    size_t              _historyDepth;
+
+    // per bin, as dist_mm_q2: ring of the previous revolutions, the same values sorted, ring head and fill level
+    std::vector<_u32>   _history;
+    std::vector<_u32>   _sorted;
+    std::vector<_u8>    _head;
+    std::vector<_u8>    _filled;
+    // sample of the current revolution to push, per touched bin
+    std::vector<_u32>   _pending;
+    std::vector<_u32>   _touched;
+    // revolution given as legacy nodes
+    Scan                _nodesScan;
+};
+
+}}}
@@ -0,0 +1,113 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// Pose of a lidar in the robot frame (x forward, y to the left)
+struct LidarExtrinsics {
+    float   x_mm;
+    float   y_mm;
+    float   yaw_rad;    // counter-clockwise rotation of the lidar 0 degree direction from the robot x axis
+};
+
+/// One point of the fused scan, in the robot frame
+struct FusedPoint {
+    float   x_mm;
+    float   y_mm;
+    _u8     quality;
+    _u8     sensor_id;
+};
+
+/// Merges the latest revolutions of several lidars into one scan of the robot frame.
+/// Each scan handed to update() replaces the previous revolution of its sensor. The fused
+/// scan gathers the newest revolution and the revolutions of the other sensors that started
+/// at most maxSkew before or after it; older ones are left out rather than smeared in.
+/// Not thread safe, feed it from the thread calling LidarManager::waitScan().
+class ScanFusion {
+public:
+    enum {
+        MAX_SENSORS      = LidarManager::MAX_LIDARS,
+        DEFAULT_MAX_SKEW = 150000, // us, 1.5 revolution at 10Hz
+    };
+
+    ScanFusion();
+
+    /// Set the pose of a lidar, the identity is used until then
+    void setExtrinsics(int sensor_id, const LidarExtrinsics & extrinsics);
+
+    /// Set the largest start time difference allowed between fused revolutions
+    void setMaxSkew(_u32 skew_us);
+
+    /// Replace the revolution of scan.sensor_id, converted to the robot frame
+    u_result update(const LidarScan & scan);
+
+    /// Retrieve the fused point set.
+    ///
+    /// \param points         Buffer provided by the caller, of at least maxCount points
+    /// \param timestamp_us   Start time of the newest fused revolution
+    ///
+    /// \return the number of points stored
+    size_t getPoints(FusedPoint * points, size_t maxCount, _u64 & timestamp_us);
+
+    /// Retrieve the fused scan as a polar range array centered on the robot origin: bin i covers
+    /// [i, i+1) * 360 / binCount degrees, clockwise from the robot x axis like the lidar nodes,
+    /// and holds the nearest point falling in it, 0 when empty.
+    ///
+    /// \return the number of non empty bins
+    size_t getPolarRanges(float * ranges_mm, size_t binCount, _u64 & timestamp_us);
+
+protected:
+    struct SensorState {
+        LidarExtrinsics         extrinsics;
+        _u64                    timestamp_us;
+        bool                    isValid;
+        std::vector<FusedPoint> points;
+    };
+
+    // collect the sensors taking part in the next fused scan
+    size_t _selectSensors(int * sensors, _u64 & timestamp_us);
+
+    SensorState _sensors[MAX_SENSORS];
+    _u32        _maxSkew;
+
+    std::vector<CartesianPoint> _cartesian;
+};
+
+}}}
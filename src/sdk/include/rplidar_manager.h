@@ -0,0 +1,109 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// One complete 0-360 degree scan delivered by the LidarManager
+struct LidarScan {
+    int                                     sensor_id;    // value returned by LidarManager::addLidar
+    _u64                                    timestamp_us; // arrival time of the first sample, getus() clock
+    size_t                                  count;        // nodes of the scan, at the start of nodes
+    // exchanged with the buffers of the manager rather than copied: reuse the same LidarScan for each waitScan()
+    std::vector<rplidar_response_measurement_node_hq_t> nodes;
+
+    LidarScan() : sensor_id(-1), timestamp_us(0), count(0) {}
+};
+
+/// Acquisition of several lidars on a small pool of threads.
+/// The drivers are switched to the external acquisition (see RPlidarDriver::setExternalAcquisition):
+/// instead of one background thread per lidar, each thread of the pool decodes the data of
+/// its share of the lidars, and the completed scans of all of them are merged in one queue.
+/// A thread sleeps in poll() on the channels of its lidars (see RPlidarDriver::getNativeHandle),
+/// the lidars whose channel has no descriptor are checked every millisecond.
+class LidarManager {
+public:
+    enum {
+        MAX_LIDARS       = 8,
+        SCAN_QUEUE_DEPTH = 4,
+        DEFAULT_TIMEOUT  = 2000, //2000 ms
+    };
+
+public:
+    /// Create a LidarManager instance
+    static LidarManager * CreateManager();
+
+    /// Dispose the LidarManager instance, its threads are stopped and the lidars it owns are disposed
+    static void DisposeManager(LidarManager * manager);
+
+    /// Hand a driver over to the manager, before it starts scanning.
+    /// The driver keeps being used as usual for the control operations (connect, startScanExpress, stop...),
+    /// its scans are retrieved with waitScan() instead of grabScanDataHq().
+    ///
+    /// \return the sensor id tagging the scans of this lidar, or -1 when the manager is full or running
+    virtual int addLidar(RPlidarDriver * drv) = 0;
+
+    /// Return the driver registered with the given sensor id, NULL if none
+    virtual RPlidarDriver * getLidar(int sensor_id) = 0;
+
+    /// Start the acquisition threads
+    ///
+    /// \param threadCount  number of threads shared by the lidars, capped to the number of lidars
+    virtual u_result start(size_t threadCount = 1) = 0;
+
+    /// Stop the acquisition threads. The scans of the lidars are not stopped.
+    virtual void stop() = 0;
+
+    /// Wait and retrieve the oldest scan not yet retrieved, from any lidar.
+    /// When the application falls behind, the oldest queued scans are dropped.
+    ///
+    /// \param timeout      Max duration allowed to wait for a scan, 0 to return immediately
+    ///
+    /// The interface will return RESULT_OPERATION_TIMEOUT when no scan is ready within the given timeout duration.
+    virtual u_result waitScan(LidarScan & scan, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    /// Number of scans dropped because the queue was full
+    virtual _u32 getDroppedScanCount() = 0;
+
+    virtual ~LidarManager() {}
+protected:
+    LidarManager() {}
+};
+
+}}}
@@ -0,0 +1,132 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+#include <string>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// The metrics are updated in the hot paths with relaxed atomics: the writers never wait,
+/// and nothing is formatted until somebody asks for the Prometheus text.
+#if defined(__GNUC__) || defined(__clang__)
+static inline void metricAdd(_u64 & counter, _u64 value)
+{
+    __atomic_fetch_add(&counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void metricSet(_u64 & gauge, _u64 value)
+{
+    __atomic_store_n(&gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline _u64 metricLoad(const _u64 & value)
+{
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+#else
+// every metric has a single writer, a torn read only affects the value being scraped
+static inline void metricAdd(_u64 & counter, _u64 value) { counter += value; }
+static inline void metricSet(_u64 & gauge, _u64 value) { gauge = value; }
+static inline _u64 metricLoad(const _u64 & value) { return value; }
+#endif
+
+/// Append the "# HELP" and "# TYPE" lines of a metric
+void appendMetricHeader(std::string & out, const char * name, const char * type, const char * help);
+
+/// Append one sample, labels being e.g. "client=\"0\"" or NULL
+void appendMetricSample(std::string & out, const char * name, _u64 value, const char * labels = NULL);
+
+/// Append a metric made of a single sample
+void appendMetric(std::string & out, const char * name, const char * type, const char * help, _u64 value);
+
+/// Append a gauge with a fractional value
+void appendGauge(std::string & out, const char * name, const char * help, double value);
+
+/// Distribution of a value over fixed buckets, in the Prometheus histogram format
+class MetricHistogram {
+public:
+    enum {
+        MAX_BUCKETS = 16,
+    };
+
+    /// \param bounds         Upper bounds of the buckets, in increasing order, an implicit +Inf bucket follows
+    MetricHistogram(const _u64 * bounds, size_t count);
+
+    void observe(_u64 value);
+
+    void append(std::string & out, const char * name, const char * help) const;
+
+protected:
+    _u64    _bounds[MAX_BUCKETS];
+    size_t  _boundCount;
+    _u64    _buckets[MAX_BUCKETS + 1];  // not cumulative, the last one is +Inf
+    _u64    _sum;
+    _u64    _count;
+};
+
+/// Counters of the acquisition and assembly of the revolutions, see RPlidarDriver::getMetrics()
+struct RplidarDriverMetrics {
+    _u64    bytes_read;
+    _u64    units_decoded;      // nodes or capsules received complete, with a valid checksum
+    _u64    checksum_errors;    // checksum or CRC mismatches
+    _u64    resyncs;            // bytes skipped while looking for the start of a unit
+    _u64    timeouts;           // no complete unit received in time
+    _u64    decode_us;          // time spent decoding the units received complete
+    _u64    revolutions;        // revolutions published to grabScanData
+    _u64    rx_queue_bytes;     // bytes waiting in the channel, as last seen by the acquisition
+    _u64    scan_ready_us;      // from the last scan request to its first revolution of a stable period
+    _u64    stalls;             // stable scans which missed a few units in a row, see RPlidarDriver::grabScanDataHq
+    _u64    scan_mode_switches; // see RPlidarDriver::switchScanMode
+    _u64    scan_switch_blind_us;   // from the last scan mode switch to the first revolution in the new mode
+    _u64    link_reconnects;    // links re-established by the channel during a scan, the scan request is sent again
+    MetricHistogram revolution_period_us;
+    MetricHistogram revolution_jitter_us;   // difference between two consecutive periods
+    MetricHistogram nodes_per_revolution;
+    _u64    recovery_attempts[SCAN_RECOVERY_LEVELS];    // by ScanRecoveryLevel, see RPlidarDriver::recoverScan
+    _u64    recovery_successes[SCAN_RECOVERY_LEVELS];
+    _u64    recovery_duration_us[SCAN_RECOVERY_LEVELS]; // total time spent in each level
+    _u64    recovery_failures;  // recoveries where every level failed
+
+    RplidarDriverMetrics();
+
+    /// Append the metrics in the Prometheus text format, the names start with "rplidar_"
+    void append(std::string & out) const;
+};
+
+}}}
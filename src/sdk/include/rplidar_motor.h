@@ -0,0 +1,172 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+class RPlidarDriver;
+
+/// Output stage of the motor of the lidar
+class MotorDriver {
+public:
+    virtual ~MotorDriver() {}
+
+    /// \param duty           Percentage of the full speed, 0 stops the motor
+    virtual u_result setDuty(float duty) = 0;
+};
+
+/// Motor driven by the lidar itself with the MOTOR_PWM command (A2 and A3 with a motor controller)
+class LidarMotorDriver : public MotorDriver {
+public:
+    explicit LidarMotorDriver(RPlidarDriver * driver);
+
+    virtual u_result setDuty(float duty);
+
+protected:
+    RPlidarDriver * _driver;
+};
+
+/// Motor driven by a PWM channel of the kernel (/sys/class/pwm, Linux only): no peripheral to map
+/// and no root access once the channel files belong to the user (udev rule), unlike pigpio.
+/// On the Raspberry Pi, GPIO 12 is channel 0 of pwmchip0 with "dtoverlay=pwm,pin=12,func=4".
+/// Any directory laid out like a pwmchip (export, pwmN/period, pwmN/duty_cycle, pwmN/enable)
+/// can be used, e.g. a fake tree for the tests.
+class SysfsPwmMotorDriver : public MotorDriver {
+public:
+    SysfsPwmMotorDriver();
+    virtual ~SysfsPwmMotorDriver();
+
+    /// Export the channel if needed, set its period and enable it with a null duty
+    ///
+    /// \param chip           Directory of the PWM chip, e.g. "/sys/class/pwm/pwmchip0"
+    /// \param channel        Index of the PWM channel of the chip
+    /// \param frequency_hz   Frequency of the PWM
+    u_result open(const char * chip, int channel, _u32 frequency_hz = 25000);
+
+    /// Stop the motor and disable the channel, which stays exported
+    void close();
+
+    bool isOpened() const { return _opened; }
+
+    virtual u_result setDuty(float duty);
+
+protected:
+    u_result _write(const char * attribute, _u32 value);
+
+    bool    _opened;
+    _u32    _period_ns;
+    char    _channel_path[256];
+};
+
+/// Motor driver recording the duty it is given, for the tests of the speed control
+class MockMotorDriver : public MotorDriver {
+public:
+    MockMotorDriver();
+
+    virtual u_result setDuty(float duty);
+
+    /// Reject the next duty changes with RESULT_OPERATION_FAIL
+    void setFailing(bool failing) { _failing = failing; }
+
+    float getDuty() const { return _duty; }
+    _u32 getCommandCount() const { return _commands; }
+
+protected:
+    bool    _failing;
+    float   _duty;
+    _u32    _commands;
+};
+
+struct MotorSpeedConfig {
+    float   target_hz;      // revolutions per second to hold
+    float   kp;             // duty change (%) per Hz of error
+    float   ki;             // duty change (%) per Hz of error and per second
+    float   min_duty;       // range of the duty (%)
+    float   max_duty;
+    float   max_step;       // largest duty change (%) per revolution
+    float   tolerance_hz;   // error under which the speed is locked
+};
+
+enum MotorSpeedState {
+    MOTOR_SPEED_IDLE = 0,       // not started
+    MOTOR_SPEED_SPINUP = 1,     // first revolutions, not used for the control
+    MOTOR_SPEED_TRACKING = 2,   // converging to the target
+    MOTOR_SPEED_LOCKED = 3,     // within tolerance_hz of the target
+    MOTOR_SPEED_SATURATED = 4,  // the duty reached min_duty or max_duty
+};
+
+struct MotorSpeedStatus {
+    int     state;              // MotorSpeedState
+    float   target_hz;
+    float   measured_hz;        // smoothed over a few revolutions
+    float   duty;               // last duty sent to the motor driver (%)
+    _u32    revolutions;        // periods measured since start()
+    _u32    command_errors;     // duty changes rejected by the motor driver
+};
+
+/// Holds the rotation speed of the lidar by adjusting the duty of the motor, from the revolution
+/// periods measured at the sync bits by the acquisition thread of the driver (see
+/// RPlidarDriver::setSpeedController). A PI loop around the initial duty, used as feed-forward:
+/// the speed no longer drifts with the supply voltage, and with it the points per degree.
+class MotorSpeedController {
+public:
+    static MotorSpeedController * CreateController(MotorDriver * motor);
+    static void DisposeController(MotorSpeedController * controller);
+
+    static MotorSpeedConfig DefaultConfig(float target_hz);
+    static const char * StateName(int state);
+
+    /// Start the control from the given duty, e.g. the open loop duty giving about the target speed.
+    /// The duty is sent to the motor driver right away.
+    virtual u_result start(const MotorSpeedConfig & config, float initial_duty) = 0;
+
+    /// Stop the control, the motor keeps its last duty
+    virtual void stop() = 0;
+
+    /// Feed the period of the last revolution
+    virtual void update(_u64 period_us) = 0;
+
+    virtual void getStatus(MotorSpeedStatus & status) = 0;
+
+    virtual ~MotorSpeedController() {}
+protected:
+    MotorSpeedController() {}
+};
+
+}}}
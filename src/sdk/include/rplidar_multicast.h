@@ -0,0 +1,150 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// Scan frames (see rplidar_codec.h) published on an UDP multicast group.
+/// Each frame is split into datagrams starting with a fragment header, little endian:
+///   sync bytes (0xA5 0x4D), frame id (u32), fragment index (u16), fragment count (u16),
+///   frame size (u32), offset of the payload in the frame (u32)
+/// A frame missing a fragment is dropped as a whole. Receivers ask for a keyframe by sending
+/// SCAN_STREAM_KEYFRAME_REQUEST to the address the fragments come from.
+enum {
+    SCAN_FRAGMENT_SYNC_BYTE1 = 0xA5,
+    SCAN_FRAGMENT_SYNC_BYTE2 = 0x4D,
+    SCAN_FRAGMENT_HEADER_SIZE = 18,
+};
+
+struct ScanMulticastStats {
+    _u32    frames;             // frames completely received
+    _u32    lost_frames;        // frames skipped or missing a fragment
+    _u32    fragments;
+    _u32    invalid_datagrams;
+};
+
+/// Reassembly of the frames from the received datagrams, for the applications which manage their own socket
+class ScanReassembler {
+public:
+    ScanReassembler();
+
+    /// Feed one received datagram.
+    ///
+    /// The interface will return RESULT_OK when the datagram completed a frame (see getFrame),
+    /// RESULT_OPERATION_TIMEOUT when more fragments are needed, and RESULT_INVALID_DATA when
+    /// the datagram is not a fragment.
+    u_result push(const _u8 * datagram, size_t size);
+
+    /// The last completed frame, valid until the next call to push()
+    const _u8 * getFrame(size_t & size);
+
+    void getStats(ScanMulticastStats & stats);
+
+protected:
+    ScanMulticastStats  _stats;
+    bool                _hasFrame;
+    bool                _isComplete;
+    _u32                _frameId;
+    size_t              _missingFragments;
+    std::vector<_u8>    _frame;
+    std::vector<_u8>    _received;
+};
+
+class ScanMulticastPublisher {
+public:
+    enum {
+        DEFAULT_PORT = 17687,
+        DEFAULT_DATAGRAM_SIZE = 1472, // Ethernet MTU minus the IP and UDP headers
+        DEFAULT_TTL = 1,
+    };
+
+    static ScanMulticastPublisher * CreatePublisher();
+    static void DisposePublisher(ScanMulticastPublisher * publisher);
+
+    /// \param group          IPv4 multicast address, e.g. "239.255.76.68"
+    /// \param datagramSize   Size of the datagrams, fragment header included
+    /// \param ttl            Number of routers the datagrams may cross, 1 keeps them on the local network
+    virtual u_result open(const char * group, int port = DEFAULT_PORT, size_t datagramSize = DEFAULT_DATAGRAM_SIZE, int ttl = DEFAULT_TTL) = 0;
+    virtual void close() = 0;
+
+    /// The frames are self-contained unless the delta mode is enabled (see ScanEncoder)
+    virtual void setDeltaConfig(const ScanDeltaConfig & config) = 0;
+
+    /// Encode one revolution and send it to the group, whatever the number of receivers.
+    /// The pending keyframe requests of the receivers are handled first.
+    virtual u_result publishScan(const rplidar_response_measurement_node_hq_t * nodes, size_t count) = 0;
+
+    /// Send a frame already encoded
+    virtual u_result publishFrame(const _u8 * frame, size_t size) = 0;
+
+    virtual ~ScanMulticastPublisher() {}
+protected:
+    ScanMulticastPublisher() {}
+};
+
+class ScanMulticastReceiver {
+public:
+    enum {
+        DEFAULT_TIMEOUT = 2000, //2000 ms
+    };
+
+    static ScanMulticastReceiver * CreateReceiver();
+    static void DisposeReceiver(ScanMulticastReceiver * receiver);
+
+    /// Join the group, several receivers of the same host may listen to the same port
+    virtual u_result open(const char * group, int port = ScanMulticastPublisher::DEFAULT_PORT) = 0;
+    virtual void close() = 0;
+
+    /// Wait for the next complete revolution. A keyframe is requested when a delta was lost.
+    ///
+    /// \param nodes          Buffer provided by the caller to hold the nodes
+    /// \param count          The size of the node buffer. Once the interface returns, this parameter will store the actual node count.
+    /// \param timeout        Max duration allowed to wait for a revolution
+    ///
+    /// The interface will return RESULT_OPERATION_TIMEOUT when no revolution is completed within the given timeout duration.
+    virtual u_result waitScan(rplidar_response_measurement_node_hq_t * nodes, size_t & count, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    virtual void getStats(ScanMulticastStats & stats) = 0;
+
+    virtual ~ScanMulticastReceiver() {}
+protected:
+    ScanMulticastReceiver() {}
+};
+
+}}}
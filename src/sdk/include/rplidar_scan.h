@@ -0,0 +1,102 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// One revolution in structure-of-arrays layout: the angles, distances and qualities are each
+/// contiguous, which is what the filters and converters read, and a node takes 7 bytes instead of
+/// the 8 of rplidar_response_measurement_node_hq_t. The sync flag is implied: a revolution starts
+/// with its sync node.
+/// Distances are kept as dist_mm_q2, so that the nodes of grabScanDataHq go through a Scan unchanged.
+class Scan {
+public:
+    enum {
+        MAX_NODES = 8192,           // same bound as the node buffers of the driver
+        MIN_REVOLUTION_HZ = 5,      // slowest rotation expected by ExpectedSize()
+    };
+
+    Scan();
+
+    /// Nodes of a revolution at the slowest rotation speed for a scan mode, see RplidarScanMode::us_per_sample
+    static size_t ExpectedSize(float us_per_sample);
+
+    /// Allocate room for count nodes, a revolution which does not fit grows the scan up to MAX_NODES
+    void reserve(size_t count);
+    size_t capacity() const { return _capacity; }
+
+    size_t size() const { return _count; }
+    bool empty() const { return _count == 0; }
+    void clear() { _count = 0; }
+    void resize(size_t count);
+
+    /// Exchange the content and the arrays of two scans, without copying them
+    void swap(Scan & other);
+
+    /// Append a node, dropped once MAX_NODES are stored
+    void push_back(const rplidar_response_measurement_node_hq_t & node);
+
+    /// Replace the content with legacy nodes, e.g. retrieved with grabScanDataHq
+    void assign(const rplidar_response_measurement_node_hq_t * nodes, size_t count);
+
+    /// Convert to legacy nodes, the first one carrying the sync bit and the others the inverse sync bit
+    ///
+    /// \param nodes          Buffer provided by the caller
+    /// \param count          Size of the buffer, set to the number of nodes written
+    void copyTo(rplidar_response_measurement_node_hq_t * nodes, size_t & count) const;
+
+    _u16 * angles() { return &_angles[0]; }                 // angle_z_q14
+    const _u16 * angles() const { return &_angles[0]; }
+    _u32 * distances() { return &_distances[0]; }           // dist_mm_q2, 0 without measurement
+    const _u32 * distances() const { return &_distances[0]; }
+    _u8 * qualities() { return &_qualities[0]; }
+    const _u8 * qualities() const { return &_qualities[0]; }
+
+    _u64    timestamp_us;           // start of the revolution, see grabScanDataHqWithTimeStamp
+
+protected:
+    // sized to the capacity, so that the arrays stay allocated when the scan is cleared
+    std::vector<_u16>   _angles;
+    std::vector<_u32>   _distances;
+    std::vector<_u8>    _qualities;
+    size_t              _count;
+    size_t              _capacity;
+};
+
+}}}
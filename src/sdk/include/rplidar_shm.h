@@ -0,0 +1,124 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// A revolution read in place from the shared memory, see ScanShmReader::waitScan
+struct ScanShmView {
+    _u64    revolution;     // number of the revolution since the publisher started, from 1
+    _u64    timestamp_us;   // arrival time of the first sample, getus() clock
+    size_t  count;
+    const rplidar_response_measurement_node_hq_t * nodes;
+
+    _u32    slot;           // used by ScanShmReader::isValid
+    _u32    sequence;
+};
+
+/// Revolutions published to the processes of the same host through POSIX shared memory (Linux only).
+/// The memory holds a ring of slots, each one protected by a sequence lock: the publisher never
+/// waits for the readers, and a reader detects that the slot it reads was overwritten meanwhile.
+/// The readers map the memory read-only and sleep on a futex which the publisher signals after
+/// each revolution, so neither side makes a socket call or a copy.
+class ScanShmPublisher {
+public:
+    enum {
+        DEFAULT_SLOT_COUNT = 8,
+    };
+
+    static ScanShmPublisher * CreatePublisher();
+    static void DisposePublisher(ScanShmPublisher * publisher);
+
+    /// Create the shared memory, replacing the one a previous publisher left behind
+    ///
+    /// \param name           Name of the shared memory, e.g. "/rplidar_scan"
+    /// \param slotCount      Revolutions kept in the ring, a reader may be that many revolutions late
+    /// \param maxNodes       Capacity of a slot
+    virtual u_result open(const char * name, size_t slotCount = DEFAULT_SLOT_COUNT, size_t maxNodes = RPlidarDriver::MAX_SCAN_NODES) = 0;
+
+    /// Remove the shared memory, the readers are notified
+    virtual void close() = 0;
+
+    /// Copy one revolution to the next slot and wake the readers.
+    /// The interface will return RESULT_INSUFFICIENT_MEMORY when count exceeds the capacity of a slot.
+    virtual u_result publishScan(const rplidar_response_measurement_node_hq_t * nodes, size_t count, _u64 timestamp_us) = 0;
+
+    virtual ~ScanShmPublisher() {}
+protected:
+    ScanShmPublisher() {}
+};
+
+class ScanShmReader {
+public:
+    enum {
+        DEFAULT_TIMEOUT = 2000, //2000 ms
+    };
+
+    static ScanShmReader * CreateReader();
+    static void DisposeReader(ScanShmReader * reader);
+
+    /// Map the shared memory of a publisher.
+    /// The interface will return RESULT_OPERATION_FAIL when no publisher is running.
+    virtual u_result open(const char * name) = 0;
+    virtual void close() = 0;
+
+    /// Wait for the latest revolution, newer than the last one returned. The view points into the
+    /// shared memory: once the nodes are used, isValid() tells whether the publisher overwrote them.
+    ///
+    /// The interface will return RESULT_OPERATION_TIMEOUT when no revolution is published within the
+    /// given timeout duration, and RESULT_OPERATION_STOP when the publisher closed: the reader should be re-opened.
+    virtual u_result waitScan(ScanShmView & view, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    /// Whether the nodes of the view were left untouched since waitScan returned it
+    virtual bool isValid(const ScanShmView & view) = 0;
+
+    /// Same as waitScan, the nodes are copied to the buffer of the caller
+    ///
+    /// \param count          The size of the node buffer. Once the interface returns, this parameter will store the actual node count.
+    virtual u_result readScan(rplidar_response_measurement_node_hq_t * nodes, size_t & count, _u64 & timestamp_us, _u32 timeout = DEFAULT_TIMEOUT) = 0;
+
+    /// Revolutions published but never returned, because the reader was late
+    virtual _u64 getMissedScanCount() = 0;
+
+    virtual ~ScanShmReader() {}
+protected:
+    ScanShmReader() {}
+};
+
+}}}
@@ -0,0 +1,109 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "The RPlidar SDK requires a C++ compiler to be built"
+#endif
+
+#include <string>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+/// Timing of the stages of the hot paths, for the flame charts of chrome://tracing or Perfetto.
+///
+/// Each thread records its spans in its own ring of the last TRACE_RING_SIZE events, without
+/// any lock: a span costs two clock reads and a store while tracing, a relaxed load otherwise.
+/// The rings are dumped as Chrome trace-event JSON, while the threads keep recording.
+class Tracer {
+public:
+    enum {
+        TRACE_RING_SIZE = 4096,
+        MAX_TRACED_THREADS = 16,    // threads recording at the same time, the others are not traced
+    };
+
+    static void Enable(bool enable);
+
+    static inline bool IsEnabled()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_load_n(&_enabled, __ATOMIC_RELAXED);
+#else
+        return _enabled;
+#endif
+    }
+
+    /// Name of the calling thread in the dumps, name must stay valid (a string literal)
+    static void SetThreadName(const char * name);
+
+    static _u64 Now();
+
+    /// Record a span of the calling thread, name must stay valid (a string literal)
+    static void Record(const char * name, _u64 start_us, _u64 end_us);
+
+    /// Append the recorded spans of every thread as a Chrome trace-event JSON document
+    static void DumpChromeTrace(std::string & out);
+    static u_result DumpChromeTrace(const char * path);
+
+protected:
+    static bool _enabled;
+};
+
+/// Span from the construction to the destruction, or to end()
+class TraceScope {
+public:
+    explicit TraceScope(const char * name)
+        : _name(name)
+        , _start(Tracer::IsEnabled() ? Tracer::Now() : 0)
+    {}
+
+    ~TraceScope()
+    {
+        end();
+    }
+
+    void end()
+    {
+        if (!_start) return;
+        Tracer::Record(_name, _start, Tracer::Now());
+        _start = 0;
+    }
+
+protected:
+    const char *    _name;
+    _u64            _start;
+};
+
+}}}
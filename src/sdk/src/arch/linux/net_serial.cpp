@@ -197,6 +197,7 @@ bool raw_serial::open(const char * portname, uint32_t baudrate, uint32_t flags)
 
     _is_serial_opened = true;
     _operation_aborted = false;
+    _wait_cancelled = false;
 
     //Clear the DTR bit to let the motor spin
     clearDTR();
@@ -364,6 +365,7 @@ int raw_serial::waitfordata(size_t data_count, _u32 timeout, size_t * returned_s
                 }
 
                 // treat as  timeout
+                _wait_cancelled = true;
                 *returned_size = 0;
                 return ANS_TIMEOUT;
             }
@@ -422,6 +424,7 @@ void raw_serial::_init()
     _portName[0] = 0;
     required_tx_cnt = required_rx_cnt = 0;
     _operation_aborted = false;
+    _wait_cancelled = false;
     _selfpipe[0] = _selfpipe[1] = -1;
 }
 
@@ -433,6 +436,13 @@ void raw_serial::cancelOperation()
     ::write(_selfpipe[1], "x", 1);
 }
 
+bool raw_serial::takeCancelled()
+{
+    bool cancelled = _wait_cancelled;
+    _wait_cancelled = false;
+    return cancelled;
+}
+
 _u32 raw_serial::getTermBaudBitmap(_u32 baud)
 {
 #define BAUD_CONV( _baud_) case _baud_:  return B##_baud_ 
@@ -69,6 +69,8 @@ public:
     _u32 getTermBaudBitmap(_u32 baud);
 
     virtual void cancelOperation();
+    virtual bool takeCancelled();
+    virtual int getNativeHandle() { return isOpened() ? serial_fd : -1; }
 
 protected:
     bool open(const char * portname, uint32_t baudrate, uint32_t flags = 0);
@@ -85,6 +87,7 @@ protected:
 
     int    _selfpipe[2];
     bool   _operation_aborted;
+    bool   _wait_cancelled;
 };
 
 }}}
@@ -0,0 +1,656 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "arch/linux/arch_linux.h"
+#include "hal/types.h"
+#include "arch/linux/net_uring.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+#include <algorithm>
+
+// for Linux extension
+#include <asm/ioctls.h>
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+namespace rp{ namespace arch{ namespace net{
+
+enum {
+    URING_TAG_CANCEL = 0xFFFFFFFF,
+};
+
+static inline int _io_uring_setup(unsigned entries, io_uring_params * params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int _io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void * arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+uring_reader::uring_reader()
+    : _ring_fd(-1)
+    , _fd(-1)
+    , _event_fd(-1)
+    , _event_val(0)
+    , _sq_map(MAP_FAILED)
+    , _sq_map_len(0)
+    , _cq_map(MAP_FAILED)
+    , _cq_map_len(0)
+    , _sqes((io_uring_sqe *)MAP_FAILED)
+    , _sqes_len(0)
+    , _ready_head(0)
+    , _ready_count(0)
+    , _ready_pos(0)
+    , _buffered(0)
+    , _free_count(0)
+    , _reading(-1)
+    , _cancelled(false)
+    , _waitCancelled(false)
+    , _broken(false)
+{
+}
+
+uring_reader::~uring_reader()
+{
+    detach();
+}
+
+bool uring_reader::_setupRing(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    _ring_fd = _io_uring_setup(entries, &params);
+    if (_ring_fd < 0) {
+        _ring_fd = -1;
+        return false;
+    }
+
+    // the timed wait relies on io_uring_getevents_arg
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        _releaseRing();
+        return false;
+    }
+
+    _sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _sq_map_len = _cq_map_len = std::max(_sq_map_len, _cq_map_len);
+    }
+
+    _sq_map = mmap(NULL, _sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (_sq_map == MAP_FAILED) {
+        _releaseRing();
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _cq_map = _sq_map;
+    } else {
+        _cq_map = mmap(NULL, _cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (_cq_map == MAP_FAILED) {
+            _releaseRing();
+            return false;
+        }
+    }
+
+    _sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = (io_uring_sqe *)mmap(NULL, _sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        _releaseRing();
+        return false;
+    }
+
+    _u8 * sq = (_u8 *)_sq_map;
+    _u8 * cq = (_u8 *)_cq_map;
+    _sq_head  = (unsigned *)(sq + params.sq_off.head);
+    _sq_tail  = (unsigned *)(sq + params.sq_off.tail);
+    _sq_mask  = (unsigned *)(sq + params.sq_off.ring_mask);
+    _sq_array = (unsigned *)(sq + params.sq_off.array);
+    _cq_head  = (unsigned *)(cq + params.cq_off.head);
+    _cq_tail  = (unsigned *)(cq + params.cq_off.tail);
+    _cq_mask  = (unsigned *)(cq + params.cq_off.ring_mask);
+    _cqes     = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+void uring_reader::_releaseRing()
+{
+    if (_sqes != MAP_FAILED) munmap(_sqes, _sqes_len);
+    if (_cq_map != MAP_FAILED && _cq_map != _sq_map) munmap(_cq_map, _cq_map_len);
+    if (_sq_map != MAP_FAILED) munmap(_sq_map, _sq_map_len);
+    _sqes = (io_uring_sqe *)MAP_FAILED;
+    _cq_map = _sq_map = MAP_FAILED;
+
+    // closing the ring cancels the reads still posted on it
+    if (_ring_fd != -1) ::close(_ring_fd);
+    _ring_fd = -1;
+}
+
+bool uring_reader::attach(int fd)
+{
+    detach();
+
+    // the read and the cancellation watch may be in flight at once
+    if (!_setupRing(4)) return false;
+
+    _event_fd = eventfd(0, EFD_NONBLOCK);
+    if (_event_fd == -1) {
+        _releaseRing();
+        return false;
+    }
+
+    _fd = fd;
+    _ready_head = _ready_count = _ready_pos = _buffered = 0;
+    _cancelled = _waitCancelled = _broken = false;
+
+    for (int pos = 0; pos < READ_BUFFER_COUNT; ++pos) {
+        _free[pos] = pos;
+    }
+    _free_count = READ_BUFFER_COUNT;
+    _reading = -1;
+    _postNextRead();
+    _postCancelWatch();
+
+    if (_enter(0, 0) < 0) {
+        detach();
+        return false;
+    }
+    return true;
+}
+
+void uring_reader::detach()
+{
+    _releaseRing();
+    if (_event_fd != -1) ::close(_event_fd);
+    _event_fd = -1;
+    _fd = -1;
+    _ready_head = _ready_count = _ready_pos = _buffered = 0;
+    _free_count = 0;
+    _reading = -1;
+}
+
+void uring_reader::_postRead(int buffer_id)
+{
+    unsigned tail = *_sq_tail;
+    unsigned index = tail & *_sq_mask;
+    io_uring_sqe * sqe = &_sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = _fd;
+    sqe->addr = (unsigned long)_buffers[buffer_id];
+    sqe->len = READ_BUFFER_SIZE;
+    sqe->off = (__u64)-1; // current position, streams ignore it anyway
+    sqe->user_data = buffer_id;
+
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    _reading = buffer_id;
+}
+
+void uring_reader::_postNextRead()
+{
+    // stalls once every buffer is queued, until the caller consumes one
+    if (_reading != -1 || !_free_count) return;
+    _postRead(_free[--_free_count]);
+}
+
+void uring_reader::_postCancelWatch()
+{
+    unsigned tail = *_sq_tail;
+    unsigned index = tail & *_sq_mask;
+    io_uring_sqe * sqe = &_sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = _event_fd;
+    sqe->addr = (unsigned long)&_event_val;
+    sqe->len = sizeof(_event_val);
+    sqe->off = 0;
+    sqe->user_data = URING_TAG_CANCEL;
+
+    _sq_array[index] = index;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+unsigned uring_reader::_pendingSubmits() const
+{
+    return *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+}
+
+int uring_reader::_enter(unsigned min_complete, _u32 timeout)
+{
+    __kernel_timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000LL;
+
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (__u64)(unsigned long)&ts;
+
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (min_complete) flags |= IORING_ENTER_GETEVENTS;
+
+    int ans = _io_uring_enter(_ring_fd, _pendingSubmits(), min_complete, flags, &arg, sizeof(arg));
+    if (ans < 0 && (errno == ETIME || errno == EINTR || errno == EBUSY)) {
+        // time up or interrupted, the caller re-checks the completion queue
+        return 0;
+    }
+    return ans;
+}
+
+void uring_reader::_reap()
+{
+    unsigned head = *_cq_head;
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+    // a single read is in flight, the buffers are queued in byte order
+    while (head != tail) {
+        const io_uring_cqe & cqe = _cqes[head & *_cq_mask];
+
+        if (cqe.user_data == URING_TAG_CANCEL) {
+            _cancelled = true;
+            _postCancelWatch();
+        } else {
+            int buffer_id = (int)cqe.user_data;
+            _reading = -1;
+            if (cqe.res > 0) {
+                size_t slot = (_ready_head + _ready_count) % READ_BUFFER_COUNT;
+                _ready[slot] = buffer_id;
+                _ready_len[slot] = cqe.res;
+                ++_ready_count;
+                _buffered += cqe.res;
+                _postNextRead();
+            } else if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                _postRead(buffer_id);
+            } else if (cqe.res != -ECANCELED) {
+                // end of stream or device error, no read is posted again
+                _broken = true;
+            }
+        }
+        ++head;
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+int uring_reader::waitfordata(size_t data_count, _u32 timeout, size_t * returned_size)
+{
+    _u32 startTs = getms();
+    size_t length = 0;
+    if (returned_size == NULL) returned_size = &length;
+    *returned_size = 0;
+
+    if (!isAttached()) return rp::hal::serial_rxtx::ANS_DEV_ERR;
+
+    // the completions are collected at least once, also with a timeout of 0
+    bool entered = false;
+    for (;;) {
+        _reap();
+
+        if (_cancelled) {
+            // treat as timeout
+            _cancelled = false;
+            _waitCancelled = true;
+            return rp::hal::serial_rxtx::ANS_TIMEOUT;
+        }
+
+        if (_buffered >= data_count) {
+            *returned_size = _buffered;
+            // the next read is submitted with the next wait, not with a syscall of its own
+            return rp::hal::serial_rxtx::ANS_OK;
+        }
+
+        if (_broken) return rp::hal::serial_rxtx::ANS_DEV_ERR;
+
+        // getms() is coarse: a short wait must not spin on _enter() until the next tick
+        _u32 waitTime = getms() - startTs;
+        if (entered && waitTime >= timeout) {
+            return rp::hal::serial_rxtx::ANS_TIMEOUT;
+        }
+
+        if (_enter(1, waitTime < timeout ? timeout - waitTime : 0) < 0) {
+            return rp::hal::serial_rxtx::ANS_DEV_ERR;
+        }
+        entered = true;
+    }
+}
+
+int uring_reader::recvdata(unsigned char * data, size_t size)
+{
+    if (!isAttached()) return 0;
+
+    _reap();
+
+    size_t copied = 0;
+    while (copied < size && _ready_count) {
+        int buffer_id = _ready[_ready_head];
+        size_t chunk = std::min(_ready_len[_ready_head] - _ready_pos, size - copied);
+
+        memcpy(data + copied, _buffers[buffer_id] + _ready_pos, chunk);
+        copied += chunk;
+        _ready_pos += chunk;
+
+        if (_ready_pos == _ready_len[_ready_head]) {
+            _ready_pos = 0;
+            _ready_head = (_ready_head + 1) % READ_BUFFER_COUNT;
+            --_ready_count;
+            _free[_free_count++] = buffer_id;
+            if (!_broken) _postNextRead();
+        }
+    }
+    _buffered -= copied;
+    return (int)copied;
+}
+
+size_t uring_reader::available()
+{
+    if (!isAttached()) return 0;
+    _reap();
+    return _buffered;
+}
+
+void uring_reader::flush()
+{
+    if (!isAttached()) return;
+    _reap();
+    while (_ready_count) {
+        _free[_free_count++] = _ready[_ready_head];
+        _ready_head = (_ready_head + 1) % READ_BUFFER_COUNT;
+        --_ready_count;
+    }
+    if (!_broken) _postNextRead();
+    _ready_pos = 0;
+    _buffered = 0;
+    _enter(0, 0);
+}
+
+void uring_reader::cancel()
+{
+    if (_event_fd == -1) return;
+    _u64 val = 1;
+    ::write(_event_fd, &val, sizeof(val));
+}
+
+bool uring_reader::takeCancelled()
+{
+    bool cancelled = _waitCancelled;
+    _waitCancelled = false;
+    return cancelled;
+}
+
+
+uring_serial::uring_serial()
+    : raw_serial()
+{
+}
+
+uring_serial::~uring_serial()
+{
+    close();
+}
+
+bool uring_serial::open()
+{
+    if (!raw_serial::open()) return false;
+
+    // the reads now block inside the kernel: return as soon as one byte is there
+    struct termios2 tio;
+    if (ioctl(serial_fd, TCGETS2, &tio) != -1) {
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        ioctl(serial_fd, TCSETS2, &tio);
+    }
+    int flags = fcntl(serial_fd, F_GETFL);
+    fcntl(serial_fd, F_SETFL, flags & ~O_NONBLOCK);
+
+    if (!_reader.attach(serial_fd)) {
+        fprintf(stderr, "io_uring is not available, using select() on %s\n", _portName);
+        // restore the settings expected by raw_serial
+        if (ioctl(serial_fd, TCGETS2, &tio) != -1) {
+            tio.c_cc[VMIN] = 0;
+            ioctl(serial_fd, TCSETS2, &tio);
+        }
+        fcntl(serial_fd, F_SETFL, flags);
+    }
+    return true;
+}
+
+void uring_serial::close()
+{
+    _reader.detach();
+    raw_serial::close();
+}
+
+void uring_serial::flush( _u32 flags)
+{
+    raw_serial::flush(flags);
+    _reader.flush();
+}
+
+int uring_serial::waitfordata(size_t data_count, _u32 timeout, size_t * returned_size)
+{
+    if (!_reader.isAttached()) return raw_serial::waitfordata(data_count, timeout, returned_size);
+    return _reader.waitfordata(data_count, timeout, returned_size);
+}
+
+int uring_serial::recvdata(unsigned char * data, size_t size)
+{
+    if (!_reader.isAttached()) return raw_serial::recvdata(data, size);
+
+    int ans = _reader.recvdata(data, size);
+    required_rx_cnt = ans;
+    return ans;
+}
+
+size_t uring_serial::rxqueue_count()
+{
+    if (!_reader.isAttached()) return raw_serial::rxqueue_count();
+    return _reader.available();
+}
+
+void uring_serial::cancelOperation()
+{
+    raw_serial::cancelOperation();
+    _reader.cancel();
+}
+
+int uring_serial::getNativeHandle()
+{
+    return _reader.isAttached() ? _reader.getNativeHandle() : raw_serial::getNativeHandle();
+}
+
+bool uring_serial::takeCancelled()
+{
+    // the select() path is used when the ring could not be set up
+    bool cancelled = raw_serial::takeCancelled();
+    return _reader.takeCancelled() || cancelled;
+}
+
+
+uring_tcp::uring_tcp()
+    : rp::hal::serial_rxtx()
+    , _port(0)
+    , _socket_fd(-1)
+{
+    _address[0] = 0;
+}
+
+uring_tcp::~uring_tcp()
+{
+    close();
+}
+
+bool uring_tcp::bind(const char * address, _u32 port, _u32 flags)
+{
+    strncpy(_address, address, sizeof(_address) - 1);
+    _address[sizeof(_address) - 1] = 0;
+    _port = port;
+    return true;
+}
+
+bool uring_tcp::open()
+{
+    if (isOpened()) close();
+
+    char service[16];
+    snprintf(service, sizeof(service), "%u", _port);
+
+    struct addrinfo hints;
+    struct addrinfo * result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(_address, service, &hints, &result) != 0) return false;
+
+    for (struct addrinfo * cursor = result; cursor != NULL; cursor = cursor->ai_next) {
+        _socket_fd = ::socket(cursor->ai_family, cursor->ai_socktype, cursor->ai_protocol);
+        if (_socket_fd == -1) continue;
+
+        // bound the connection attempt, a blocking connect() honours SO_SNDTIMEO
+        timeval tv;
+        tv.tv_sec = CONNECT_TIMEOUT / 1000;
+        tv.tv_usec = (CONNECT_TIMEOUT % 1000) * 1000;
+        ::setsockopt(_socket_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        if (::connect(_socket_fd, cursor->ai_addr, cursor->ai_addrlen) == 0) break;
+
+        ::close(_socket_fd);
+        _socket_fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (_socket_fd == -1) return false;
+
+    int bool_true = 1;
+    ::setsockopt(_socket_fd, IPPROTO_TCP, TCP_NODELAY, &bool_true, sizeof(bool_true));
+
+    if (!_reader.attach(_socket_fd)) {
+        ::close(_socket_fd);
+        _socket_fd = -1;
+        return false;
+    }
+
+    _is_serial_opened = true;
+    return true;
+}
+
+void uring_tcp::close()
+{
+    _reader.detach();
+    if (_socket_fd != -1) ::close(_socket_fd);
+    _socket_fd = -1;
+    _is_serial_opened = false;
+}
+
+void uring_tcp::flush( _u32 flags)
+{
+    _reader.flush();
+}
+
+int uring_tcp::waitfordata(size_t data_count, _u32 timeout, size_t * returned_size)
+{
+    return _reader.waitfordata(data_count, timeout, returned_size);
+}
+
+int uring_tcp::senddata(const unsigned char * data, size_t size)
+{
+    if (!isOpened()) return 0;
+
+    if (data == NULL || size ==0) return 0;
+
+    size_t tx_len = 0;
+    do {
+        int ans = ::send(_socket_fd, data + tx_len, size - tx_len, MSG_NOSIGNAL);
+
+        if (ans == -1) return tx_len;
+
+        tx_len += ans;
+    } while (tx_len < size);
+
+    return tx_len;
+}
+
+int uring_tcp::recvdata(unsigned char * data, size_t size)
+{
+    return _reader.recvdata(data, size);
+}
+
+int uring_tcp::waitforsent(_u32 timeout, size_t * returned_size)
+{
+    if (returned_size) *returned_size = 0;
+    return 0;
+}
+
+int uring_tcp::waitforrecv(_u32 timeout, size_t * returned_size)
+{
+    if (!isOpened() ) return -1;
+
+    if (returned_size) *returned_size = _reader.available();
+    return 0;
+}
+
+size_t uring_tcp::rxqueue_count()
+{
+    return _reader.available();
+}
+
+void uring_tcp::cancelOperation()
+{
+    _reader.cancel();
+}
+
+bool uring_tcp::takeCancelled()
+{
+    return _reader.takeCancelled();
+}
+
+int uring_tcp::getNativeHandle()
+{
+    return isOpened() ? _reader.getNativeHandle() : -1;
+}
+
+}}} //end rp::arch::net
@@ -0,0 +1,190 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include "hal/abs_rxtx.h"
+#include "arch/linux/net_serial.h"
+
+#include <linux/io_uring.h>
+
+namespace rp{ namespace arch{ namespace net{
+
+// Keeps a read posted to the kernel through an io_uring instance.
+// Completed buffers are queued and served to the waitfordata/recvdata
+// callers straight from memory: draining bytes that have already arrived
+// costs no system call, and posting the next read is batched with the
+// next wait.
+// Only one read is in flight at a time: on a blocking fd the reads are
+// handed to io-wq workers and several of them may complete out of byte order.
+// Requires IORING_FEAT_EXT_ARG (Linux 5.11+), attach() fails otherwise.
+class uring_reader
+{
+public:
+    enum {
+        READ_BUFFER_COUNT = 8,
+        READ_BUFFER_SIZE  = 1024,
+    };
+
+    uring_reader();
+    ~uring_reader();
+
+    bool attach(int fd);
+    void detach();
+    bool isAttached() const { return _ring_fd != -1; }
+
+    int    waitfordata(size_t data_count, _u32 timeout, size_t * returned_size);
+    int    recvdata(unsigned char * data, size_t size);
+    size_t available();
+    void   flush();
+    void   cancel();
+    bool   takeCancelled();
+    // the ring, readable for poll() while a completion is pending; the next read is submitted
+    // by a wait which came short, as the drain of the driver ends with one
+    int    getNativeHandle() const { return _ring_fd; }
+
+protected:
+    bool     _setupRing(unsigned entries);
+    void     _releaseRing();
+    void     _postRead(int buffer_id);
+    void     _postNextRead();
+    void     _postCancelWatch();
+    void     _reap();
+    int      _enter(unsigned min_complete, _u32 timeout);
+    unsigned _pendingSubmits() const;
+
+    int     _ring_fd;
+    int     _fd;
+    int     _event_fd;
+    _u64    _event_val;
+
+    void *          _sq_map;
+    size_t          _sq_map_len;
+    void *          _cq_map;
+    size_t          _cq_map_len;
+    io_uring_sqe *  _sqes;
+    size_t          _sqes_len;
+
+    unsigned *      _sq_head;
+    unsigned *      _sq_tail;
+    unsigned *      _sq_mask;
+    unsigned *      _sq_array;
+    unsigned *      _cq_head;
+    unsigned *      _cq_tail;
+    unsigned *      _cq_mask;
+    io_uring_cqe *  _cqes;
+
+    _u8     _buffers[READ_BUFFER_COUNT][READ_BUFFER_SIZE];
+    int     _ready[READ_BUFFER_COUNT];
+    size_t  _ready_len[READ_BUFFER_COUNT];
+    size_t  _ready_head;
+    size_t  _ready_count;
+    size_t  _ready_pos;
+    size_t  _buffered;
+    int     _free[READ_BUFFER_COUNT];   // buffers neither read into nor queued
+    size_t  _free_count;
+    int     _reading;                   // buffer of the read in flight, -1 if none
+
+    bool    _cancelled;
+    bool    _waitCancelled;             // a wait returned on _cancelled
+    bool    _broken;
+};
+
+// raw_serial with its receive path moved onto an uring_reader.
+// Falls back to the select() based implementation if the ring cannot be set up.
+class uring_serial : public raw_serial
+{
+public:
+    uring_serial();
+    virtual ~uring_serial();
+
+    virtual bool open();
+    virtual void close();
+    virtual void flush( _u32 flags);
+
+    virtual int waitfordata(size_t data_count,_u32 timeout = -1, size_t * returned_size = NULL);
+    virtual int recvdata(unsigned char * data, size_t size);
+    virtual size_t rxqueue_count();
+
+    virtual void cancelOperation();
+    virtual bool takeCancelled();
+    // the bytes are read by the ring, the tty does not tell when they arrive
+    virtual int getNativeHandle();
+
+protected:
+    uring_reader _reader;
+};
+
+// TCP byte stream exposing the serial_rxtx interface, so that a networked
+// lidar can share the uring_reader receive path.
+// bind() takes the peer address and port instead of a port name and baudrate.
+class uring_tcp : public rp::hal::serial_rxtx
+{
+public:
+    enum {
+        CONNECT_TIMEOUT = 2000, //ms
+    };
+
+    uring_tcp();
+    virtual ~uring_tcp();
+
+    virtual bool bind(const char * address, _u32 port, _u32 flags = 0);
+    virtual bool open();
+    virtual void close();
+    virtual void flush( _u32 flags);
+
+    virtual int waitfordata(size_t data_count,_u32 timeout = -1, size_t * returned_size = NULL);
+
+    virtual int senddata(const unsigned char * data, size_t size);
+    virtual int recvdata(unsigned char * data, size_t size);
+
+    virtual int waitforsent(_u32 timeout = -1, size_t * returned_size = NULL);
+    virtual int waitforrecv(_u32 timeout = -1, size_t * returned_size = NULL);
+
+    virtual size_t rxqueue_count();
+
+    virtual void setDTR() {}
+    virtual void clearDTR() {}
+    virtual void cancelOperation();
+    virtual bool takeCancelled();
+    virtual int getNativeHandle();
+
+protected:
+    char    _address[200];
+    _u32    _port;
+    int     _socket_fd;
+    uring_reader _reader;
+};
+
+}}}
@@ -15,6 +15,7 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <fcntl.h>
 
 namespace rp{ namespace net {
 
@@ -396,16 +397,26 @@ public:
         switch (errno) {
             case EAFNOSUPPORT:
                 return RESULT_OPERATION_NOT_SUPPORT;
-#if 0
             case EINPROGRESS:
-                return RESULT_OK; //treat async connection as good status
-#endif
+                // non-blocking socket, see checkConnected()
             case ETIMEDOUT:
                 return RESULT_OPERATION_TIMEOUT;
             default:
                 return RESULT_OPERATION_FAIL;
         }
     }
+
+    virtual u_result checkConnected(_u32 timeout)
+    {
+        // writable once the connection is established or refused
+        u_result ans = waitforSent(timeout);
+        if (IS_FAIL(ans)) return ans;
+
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (::getsockopt(_socket_fd, SOL_SOCKET, SO_ERROR, &error, &len) || error) return RESULT_OPERATION_FAIL;
+        return RESULT_OK;
+    }
       
     virtual u_result listen(int backlog)
     {
@@ -544,6 +555,19 @@ public:
         return ::setsockopt( _socket_fd, IPPROTO_TCP, TCP_NODELAY,&bool_true, sizeof(bool_true) )?RESULT_OPERATION_FAIL:RESULT_OK;
     }
 
+    virtual u_result enableNonBlocking(bool enable )
+    {
+        int flags = ::fcntl(_socket_fd, F_GETFL, 0);
+        if (flags == -1) return RESULT_OPERATION_FAIL;
+        flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        return ::fcntl(_socket_fd, F_SETFL, flags)?RESULT_OPERATION_FAIL:RESULT_OK;
+    }
+
+    virtual int getNativeHandle()
+    {
+        return _socket_fd;
+    }
+
     virtual u_result waitforSent(_u32 timeout ) 
     {
         fd_set wrset;
@@ -608,7 +632,9 @@ public:
     {
         assert(fd>=0);
         int bool_true = 1;
-        ::setsockopt( _socket_fd, SOL_SOCKET, SO_REUSEADDR | SO_BROADCAST , (char *)&bool_true, sizeof(bool_true) );
+        // the options are not flags: each one needs its own call
+        ::setsockopt( _socket_fd, SOL_SOCKET, SO_REUSEADDR , (char *)&bool_true, sizeof(bool_true) );
+        ::setsockopt( _socket_fd, SOL_SOCKET, SO_BROADCAST , (char *)&bool_true, sizeof(bool_true) );
         setTimeout(DEFAULT_SOCKET_TIMEOUT, SOCKET_DIR_BOTH);
     }
 
@@ -745,6 +771,26 @@ public:
     }
 
 
+    virtual u_result joinMulticastGroup(const SocketAddress & group)
+    {
+        const struct sockaddr * addr = reinterpret_cast<const struct sockaddr *>(group.getPlatformData());
+        assert(addr);
+        if (addr->sa_family != AF_INET) return RESULT_OPERATION_NOT_SUPPORT;
+
+        ip_mreq mreq;
+        mreq.imr_multiaddr = reinterpret_cast<const struct sockaddr_in *>(addr)->sin_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        int ans = ::setsockopt(_socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        return ans ? RESULT_OPERATION_FAIL : RESULT_OK;
+    }
+
+    virtual u_result setMulticastTtl(int ttl)
+    {
+        unsigned char value = (unsigned char)ttl;
+        int ans = ::setsockopt(_socket_fd, IPPROTO_IP, IP_MULTICAST_TTL, &value, sizeof(value));
+        return ans ? RESULT_OPERATION_FAIL : RESULT_OK;
+    }
+
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
         struct sockaddr * addr = (sourceAddr?reinterpret_cast<struct sockaddr *>(const_cast<void *>(sourceAddr->getPlatformData())):NULL);
@@ -472,16 +472,26 @@ public:
         switch (WSAGetLastError()) {
             case WSAEAFNOSUPPORT:
                 return RESULT_OPERATION_NOT_SUPPORT;
-#if 0
-            case EINPROGRESS:
-                return RESULT_OK; //treat async connection as good status
-#endif
+            case WSAEWOULDBLOCK:
+                // non-blocking socket, see checkConnected()
             case WSAETIMEDOUT:
                 return RESULT_OPERATION_TIMEOUT;
             default:
                 return RESULT_OPERATION_FAIL;
         }
     }
+
+    virtual u_result checkConnected(_u32 timeout)
+    {
+        // writable once the connection is established, a refused one is left to the caller's timeout
+        u_result ans = waitforSent(timeout);
+        if (IS_FAIL(ans)) return ans;
+
+        int error = 0;
+        int len = (int)sizeof(error);
+        if (::getsockopt(_socket_fd, SOL_SOCKET, SO_ERROR, (char *)&error, &len) || error) return RESULT_OPERATION_FAIL;
+        return RESULT_OK;
+    }
       
     virtual u_result listen(int backlog)
     {
@@ -593,6 +603,17 @@ public:
         return ::setsockopt( _socket_fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&bool_true, (int)sizeof(bool_true) )?RESULT_OPERATION_FAIL:RESULT_OK;
     }
 
+    virtual u_result enableNonBlocking(bool enable )
+    {
+        u_long mode = enable?1:0;
+        return ::ioctlsocket( _socket_fd, FIONBIO, &mode )?RESULT_OPERATION_FAIL:RESULT_OK;
+    }
+
+    virtual int getNativeHandle()
+    {
+        return -1;
+    }
+
     virtual u_result waitforSent(_u32 timeout ) 
     {
         fd_set wrset;
@@ -658,7 +679,9 @@ public:
     {
         assert(fd>=0);
         int bool_true = 1;
-        ::setsockopt( _socket_fd, SOL_SOCKET, SO_REUSEADDR | SO_BROADCAST , (char *)&bool_true, (int)sizeof(bool_true) );
+        // the options are not flags: each one needs its own call
+        ::setsockopt( _socket_fd, SOL_SOCKET, SO_REUSEADDR , (char *)&bool_true, (int)sizeof(bool_true) );
+        ::setsockopt( _socket_fd, SOL_SOCKET, SO_BROADCAST , (char *)&bool_true, (int)sizeof(bool_true) );
         setTimeout(DEFAULT_SOCKET_TIMEOUT, SOCKET_DIR_BOTH);
     }
 
@@ -790,6 +813,26 @@ public:
     }
 
 
+    virtual u_result joinMulticastGroup(const SocketAddress & group)
+    {
+        const struct sockaddr * addr = reinterpret_cast<const struct sockaddr *>(group.getPlatformData());
+        assert(addr);
+        if (addr->sa_family != AF_INET) return RESULT_OPERATION_NOT_SUPPORT;
+
+        ip_mreq mreq;
+        mreq.imr_multiaddr = reinterpret_cast<const struct sockaddr_in *>(addr)->sin_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        int ans = ::setsockopt(_socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char *)&mreq, sizeof(mreq));
+        return ans ? RESULT_OPERATION_FAIL : RESULT_OK;
+    }
+
+    virtual u_result setMulticastTtl(int ttl)
+    {
+        DWORD value = (DWORD)ttl;
+        int ans = ::setsockopt(_socket_fd, IPPROTO_IP, IP_MULTICAST_TTL, (const char *)&value, sizeof(value));
+        return ans ? RESULT_OPERATION_FAIL : RESULT_OK;
+    }
+
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr)
     {
         struct sockaddr * addr = (sourceAddr?reinterpret_cast<struct sockaddr *>(const_cast<void *>(sourceAddr->getPlatformData())):NULL);
@@ -72,6 +72,10 @@ public:
     virtual void setDTR() = 0;
     virtual void clearDTR() = 0;
     virtual void cancelOperation() {}
+    // true once after a waitfordata() was cut short by cancelOperation()
+    virtual bool takeCancelled() { return false; }
+    // descriptor for poll(), readable when data arrives; -1 if there is none
+    virtual int getNativeHandle() { return -1; }
 
     virtual bool isOpened()
     {
@@ -105,7 +105,10 @@ public:
 
     static StreamSocket * CreateSocket(socket_family_t family = SOCKET_FAMILY_INET);
     
+    // on a non-blocking socket, RESULT_OPERATION_TIMEOUT while the connection is in progress
     virtual u_result connect(const SocketAddress & pairAddress) = 0;
+    // outcome of a connect() in progress: RESULT_OPERATION_TIMEOUT while it is still pending after timeout
+    virtual u_result checkConnected(_u32 timeout = 0) = 0;
     
     virtual u_result listen(int backlog = MAX_BACKLOG) = 0;
     virtual StreamSocket * accept(SocketAddress * pairAddress = NULL) = 0;
@@ -123,6 +126,12 @@ public:
     
     virtual u_result enableNoDelay(bool enable = true) = 0;
 
+    // send() and recv() return RESULT_OPERATION_TIMEOUT instead of waiting
+    virtual u_result enableNonBlocking(bool enable = true) = 0;
+
+    // descriptor for poll(), -1 where the platform has none
+    virtual int getNativeHandle() = 0;
+
 protected:
     virtual ~StreamSocket() {} // use dispose();
     StreamSocket() {}
@@ -141,6 +150,10 @@ public:
    
     virtual u_result recvFrom(void *buf, size_t len, size_t & recv_len, SocketAddress * sourceAddr = NULL) = 0;
 
+    virtual u_result joinMulticastGroup(const SocketAddress & group) = 0;
+
+    virtual u_result setMulticastTtl(int ttl) = 0;
+
     
 protected:
     virtual ~DGramSocket() {} // use dispose();
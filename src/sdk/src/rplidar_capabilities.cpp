@@ -0,0 +1,356 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+
+#include <stdio.h>
+#include <string>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// first line of the file, a different version is ignored
+static const char CACHE_FILE_HEADER[] = "rplidar-capabilities 1";
+
+// a mode is usable when the channel delivers this share of its samples...
+static const float MIN_DELIVERED_RATIO = 0.95f;
+// ...with fewer units dropped than this...
+static const float MAX_CHECKSUM_ERROR_RATIO = 0.01f;
+// ...and this share of the time left to the application
+static const float MAX_DECODE_LOAD = 0.5f;
+
+static bool sameLidar(const LidarCapabilities & capabilities, const _u8 * serialnum, _u16 firmware_version)
+{
+    return memcmp(capabilities.serialnum, serialnum, sizeof(capabilities.serialnum)) == 0
+        && capabilities.firmware_version == firmware_version;
+}
+
+class LidarCapabilityCacheImpl : public LidarCapabilityCache {
+public:
+    LidarCapabilityCacheImpl(const char * path);
+
+    virtual bool find(const rplidar_response_device_info_t & info, LidarCapabilities & capabilities);
+    virtual void store(const LidarCapabilities & capabilities);
+    virtual void clear();
+    virtual size_t size();
+
+protected:
+    void _load();
+    void _save();
+
+    rp::hal::Locker _lock;
+    std::string _path;
+    std::vector<LidarCapabilities> _lidars;
+};
+
+LidarCapabilityCache * LidarCapabilityCache::CreateCache(const char * path)
+{
+    return new LidarCapabilityCacheImpl(path);
+}
+
+void LidarCapabilityCache::DisposeCache(LidarCapabilityCache * cache)
+{
+    delete cache;
+}
+
+LidarCapabilityCacheImpl::LidarCapabilityCacheImpl(const char * path)
+{
+    if (path) {
+        _path = path;
+        _load();
+    }
+}
+
+bool LidarCapabilityCacheImpl::find(const rplidar_response_device_info_t & info, LidarCapabilities & capabilities)
+{
+    rp::hal::AutoLocker l(_lock);
+    for (size_t i = 0; i < _lidars.size(); i++) {
+        if (sameLidar(_lidars[i], info.serialnum, info.firmware_version)) {
+            capabilities = _lidars[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void LidarCapabilityCacheImpl::store(const LidarCapabilities & capabilities)
+{
+    rp::hal::AutoLocker l(_lock);
+    size_t i = 0;
+    while (i < _lidars.size() && !sameLidar(_lidars[i], capabilities.serialnum, capabilities.firmware_version)) i++;
+    if (i == _lidars.size()) {
+        _lidars.push_back(capabilities);
+    } else {
+        _lidars[i] = capabilities;
+    }
+    _save();
+}
+
+void LidarCapabilityCacheImpl::clear()
+{
+    rp::hal::AutoLocker l(_lock);
+    _lidars.clear();
+    _save();
+}
+
+size_t LidarCapabilityCacheImpl::size()
+{
+    rp::hal::AutoLocker l(_lock);
+    return _lidars.size();
+}
+
+void LidarCapabilityCacheImpl::_load()
+{
+    FILE * file = fopen(_path.c_str(), "r");
+    if (!file) return;
+
+    char line[256];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, CACHE_FILE_HEADER, sizeof(CACHE_FILE_HEADER) - 1) != 0) {
+        fclose(file);
+        return;
+    }
+
+    // one "lidar" line followed by its "mode" lines, a malformed entry is dropped;
+    // then optionally a "measured" line followed by its "measure" lines
+    LidarCapabilities lidar;
+    unsigned int expected = 0;
+    unsigned int expectedMeasures = 0;
+    bool accepted = false;      // the last "lidar" entry was complete, its measurements may follow
+    while (fgets(line, sizeof(line), file)) {
+        char serial[33];
+        unsigned int firmware, hardware, model, typical, count;
+        unsigned int id, ans_type, baudrate;
+        RplidarScanMode mode;
+        memset(&mode, 0, sizeof(mode));
+        ScanModeMeasurement measure;
+
+        if (sscanf(line, "lidar %32s %u %u %u %u %u", serial, &firmware, &hardware, &model, &typical, &count) == 6
+            && strlen(serial) == 32) {
+            for (int pos = 0; pos < 16; pos++) {
+                unsigned int byte;
+                sscanf(serial + pos * 2, "%2x", &byte);
+                lidar.serialnum[pos] = (_u8)byte;
+            }
+            lidar.firmware_version = (_u16)firmware;
+            lidar.hardware_version = (_u8)hardware;
+            lidar.model = (_u8)model;
+            lidar.typical_mode = (_u16)typical;
+            lidar.modes.clear();
+            lidar.measured_baudrate = 0;
+            lidar.measurements.clear();
+            expected = count;
+            expectedMeasures = 0;
+            accepted = false;
+        } else if (expected && sscanf(line, "mode %u %f %f %u %63[^\n]", &id, &mode.us_per_sample, &mode.max_distance, &ans_type, mode.scan_mode) == 5) {
+            mode.id = (_u16)id;
+            mode.ans_type = (_u8)ans_type;
+            lidar.modes.push_back(mode);
+            if (lidar.modes.size() == expected) {
+                _lidars.push_back(lidar);
+                expected = 0;
+                accepted = true;
+            }
+        } else if (accepted && !expectedMeasures && sscanf(line, "measured %u %u", &baudrate, &count) == 2) {
+            // completes the last lidar read
+            _lidars.back().measured_baudrate = baudrate;
+            _lidars.back().measurements.clear();
+            expectedMeasures = count;
+            accepted = false;
+        } else if (expectedMeasures && sscanf(line, "measure %u %f %f %f %f %f", &id, &measure.nominal_sps, &measure.measured_sps,
+            &measure.valid_ratio, &measure.checksum_error_ratio, &measure.decode_load) == 6) {
+            measure.id = (_u16)id;
+            _lidars.back().measurements.push_back(measure);
+            expectedMeasures--;
+        } else {
+            expected = 0;
+            expectedMeasures = 0;
+            accepted = false;
+        }
+    }
+    fclose(file);
+}
+
+void LidarCapabilityCacheImpl::_save()
+{
+    if (_path.empty()) return;
+
+    // written aside then renamed, a reader never sees a partial file
+    std::string temporary = _path + ".tmp";
+    FILE * file = fopen(temporary.c_str(), "w");
+    if (!file) return;
+
+    fprintf(file, "%s\n", CACHE_FILE_HEADER);
+    for (size_t i = 0; i < _lidars.size(); i++) {
+        const LidarCapabilities & lidar = _lidars[i];
+        fprintf(file, "lidar ");
+        for (int pos = 0; pos < 16; pos++) {
+            fprintf(file, "%02X", lidar.serialnum[pos]);
+        }
+        fprintf(file, " %u %u %u %u %u\n", lidar.firmware_version, lidar.hardware_version, lidar.model,
+            lidar.typical_mode, (unsigned int)lidar.modes.size());
+        for (size_t m = 0; m < lidar.modes.size(); m++) {
+            const RplidarScanMode & mode = lidar.modes[m];
+            fprintf(file, "mode %u %g %g %u %s\n", mode.id, mode.us_per_sample, mode.max_distance, mode.ans_type, mode.scan_mode);
+        }
+        if (lidar.measured_baudrate) {
+            fprintf(file, "measured %u %u\n", lidar.measured_baudrate, (unsigned int)lidar.measurements.size());
+            for (size_t m = 0; m < lidar.measurements.size(); m++) {
+                const ScanModeMeasurement & measure = lidar.measurements[m];
+                fprintf(file, "measure %u %g %g %g %g %g\n", measure.id, measure.nominal_sps, measure.measured_sps,
+                    measure.valid_ratio, measure.checksum_error_ratio, measure.decode_load);
+            }
+        }
+    }
+    if (fclose(file) != 0) {
+        remove(temporary.c_str());
+        return;
+    }
+#ifdef _WIN32
+    remove(_path.c_str());
+#endif
+    rename(temporary.c_str(), _path.c_str());
+}
+
+static u_result measureScanMode(RPlidarDriver * drv, const RplidarScanMode & mode, _u32 durationMs,
+    std::vector<rplidar_response_measurement_node_hq_t> & nodes, ScanModeMeasurement & measure)
+{
+    u_result ans;
+    if (IS_FAIL(ans = drv->startScanExpress(false, mode.id))) return ans;
+    if (IS_FAIL(ans = drv->waitScanReady())) return ans;
+
+    const RplidarDriverMetrics & metrics = drv->getMetrics();
+    _u64 unitsStart = metricLoad(metrics.units_decoded);
+    _u64 errorsStart = metricLoad(metrics.checksum_errors);
+    _u64 decodeStart = metricLoad(metrics.decode_us);
+    _u64 start = getus();
+
+    // the samples of a revolution are taken between its timestamp and the next one
+    _u64 samples = 0, valid = 0, firstTimestamp = 0, lastTimestamp = 0;
+    size_t lastCount = 0;
+    const _u64 duration = (_u64)durationMs * 1000;
+    for (;;) {
+        // a mode which delivers nothing must not overrun the window by the default timeout
+        _u64 spent = getus() - start;
+        if (spent >= duration) break;
+        _u32 remaining = (_u32)((duration - spent + 999) / 1000);
+
+        size_t count = nodes.size();
+        _u64 timestamp;
+        if (IS_FAIL(drv->grabScanDataHqWithTimeStamp(&nodes[0], count, timestamp, remaining))) continue;
+        if (!firstTimestamp) {
+            firstTimestamp = timestamp;
+        } else {
+            samples += lastCount;
+        }
+        lastTimestamp = timestamp;
+        lastCount = count;
+        for (size_t pos = 0; pos < count; pos++) {
+            if (nodes[pos].dist_mm_q2) valid++;
+        }
+    }
+    _u64 elapsed = getus() - start;
+    if (lastTimestamp == firstTimestamp || !elapsed) return RESULT_OPERATION_TIMEOUT;
+
+    _u64 units = metricLoad(metrics.units_decoded) - unitsStart;
+    _u64 errors = metricLoad(metrics.checksum_errors) - errorsStart;
+    measure.id = mode.id;
+    measure.nominal_sps = mode.us_per_sample > 0 ? 1000000.f / mode.us_per_sample : 0;
+    measure.measured_sps = samples * 1000000.f / (lastTimestamp - firstTimestamp);
+    measure.valid_ratio = (samples + lastCount) ? (float)valid / (samples + lastCount) : 0;
+    measure.checksum_error_ratio = (units + errors) ? (float)errors / (units + errors) : 0;
+    measure.decode_load = (float)(metricLoad(metrics.decode_us) - decodeStart) / elapsed;
+    return RESULT_OK;
+}
+
+u_result MeasureScanModes(RPlidarDriver * drv, std::vector<ScanModeMeasurement> & measurements, _u32 durationMs)
+{
+    u_result ans;
+    std::vector<RplidarScanMode> modes;
+    if (IS_FAIL(ans = drv->getAllSupportedScanModes(modes))) return ans;
+
+    std::vector<rplidar_response_measurement_node_hq_t> nodes(8192);
+    measurements.clear();
+    for (size_t i = 0; i < modes.size(); i++) {
+        ScanModeMeasurement measure;
+        // a mode which cannot be started is left out
+        if (IS_OK(measureScanMode(drv, modes[i], durationMs, nodes, measure))) {
+            measurements.push_back(measure);
+        }
+        drv->stop();
+    }
+    return measurements.empty() ? RESULT_OPERATION_FAIL : RESULT_OK;
+}
+
+static bool isUsable(const ScanModeMeasurement & measure)
+{
+    return measure.measured_sps >= measure.nominal_sps * MIN_DELIVERED_RATIO
+        && measure.checksum_error_ratio <= MAX_CHECKSUM_ERROR_RATIO
+        && measure.decode_load <= MAX_DECODE_LOAD;
+}
+
+u_result SelectScanMode(const LidarCapabilities & capabilities, int objective, _u16 & outMode)
+{
+    const ScanModeMeasurement * best = NULL;
+    float bestDistance = 0;
+    for (size_t i = 0; i < capabilities.measurements.size(); i++) {
+        const ScanModeMeasurement & measure = capabilities.measurements[i];
+        if (!isUsable(measure)) continue;
+
+        float distance = 0;
+        for (size_t m = 0; m < capabilities.modes.size(); m++) {
+            if (capabilities.modes[m].id == measure.id) distance = capabilities.modes[m].max_distance;
+        }
+        float density = measure.measured_sps * measure.valid_ratio;
+
+        bool better;
+        if (!best) {
+            better = true;
+        } else if (objective == SCAN_MODE_OBJECTIVE_RANGE && distance != bestDistance) {
+            better = distance > bestDistance;
+        } else if (objective == SCAN_MODE_OBJECTIVE_QUALITY && measure.valid_ratio != best->valid_ratio) {
+            better = measure.valid_ratio > best->valid_ratio;
+        } else {
+            better = density > best->measured_sps * best->valid_ratio;
+        }
+        if (better) {
+            best = &measure;
+            bestDistance = distance;
+        }
+    }
+    if (!best) return RESULT_OPERATION_FAIL;
+    outMode = best->id;
+    return RESULT_OK;
+}
+
+}}}
@@ -0,0 +1,163 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CARTESIAN_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CARTESIAN_USE_SSE2
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// sin() of every angle_z_q14 value, followed by a quarter turn so that
+// the cosine is the same table read 16384 entries further
+struct CartesianSinTable {
+    enum {
+        QUARTER_TURN = 16384,
+        SIZE         = 65536 + QUARTER_TURN,
+    };
+
+    float values[SIZE];
+
+    CartesianSinTable()
+    {
+        for (size_t pos = 0; pos < SIZE; ++pos) {
+            values[pos] = (float)sin(pos * 3.14159265358979 * 2 / 65536);
+        }
+    }
+};
+
+static const float * _getSinTable()
+{
+    static CartesianSinTable table;
+    return table.values;
+}
+
+void ConvertToCartesian(const rplidar_response_measurement_node_hq_t * nodes, size_t count, CartesianPoint * points)
+{
+    const float * sinTable = _getSinTable();
+    const float * cosTable = sinTable + CartesianSinTable::QUARTER_TURN;
+    size_t pos = 0;
+
+#if defined(CARTESIAN_USE_NEON)
+    for (; pos + 4 <= count; pos += 4) {
+        const rplidar_response_measurement_node_hq_t * node = nodes + pos;
+        float dist[4], cosv[4], sinv[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            dist[lane] = (float)node[lane].dist_mm_q2;
+            cosv[lane] = cosTable[node[lane].angle_z_q14];
+            sinv[lane] = sinTable[node[lane].angle_z_q14];
+        }
+        float32x4_t d = vmulq_n_f32(vld1q_f32(dist), 0.25f);
+        float32x4x2_t xy;
+        xy.val[0] = vmulq_f32(d, vld1q_f32(cosv));
+        xy.val[1] = vmulq_f32(vnegq_f32(d), vld1q_f32(sinv));
+        // interleaved store: x0 y0 x1 y1 ...
+        vst2q_f32(&points[pos].x_mm, xy);
+    }
+#elif defined(CARTESIAN_USE_SSE2)
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 negQuarter = _mm_set1_ps(-0.25f);
+    for (; pos + 4 <= count; pos += 4) {
+        const rplidar_response_measurement_node_hq_t * node = nodes + pos;
+        __m128 d = _mm_cvtepi32_ps(_mm_set_epi32(node[3].dist_mm_q2, node[2].dist_mm_q2, node[1].dist_mm_q2, node[0].dist_mm_q2));
+        __m128 c = _mm_set_ps(cosTable[node[3].angle_z_q14], cosTable[node[2].angle_z_q14], cosTable[node[1].angle_z_q14], cosTable[node[0].angle_z_q14]);
+        __m128 s = _mm_set_ps(sinTable[node[3].angle_z_q14], sinTable[node[2].angle_z_q14], sinTable[node[1].angle_z_q14], sinTable[node[0].angle_z_q14]);
+        __m128 x = _mm_mul_ps(_mm_mul_ps(d, quarter), c);
+        __m128 y = _mm_mul_ps(_mm_mul_ps(d, negQuarter), s);
+        // interleave: x0 y0 x1 y1 | x2 y2 x3 y3
+        _mm_storeu_ps(&points[pos].x_mm, _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(&points[pos + 2].x_mm, _mm_unpackhi_ps(x, y));
+    }
+#endif
+
+    for (; pos < count; ++pos) {
+        float dist = nodes[pos].dist_mm_q2 / 4.0f;
+        points[pos].x_mm = dist * cosTable[nodes[pos].angle_z_q14];
+        points[pos].y_mm = -dist * sinTable[nodes[pos].angle_z_q14];
+    }
+}
+
+void ConvertToCartesian(const Scan & scan, CartesianPoint * points)
+{
+    const float * sinTable = _getSinTable();
+    const float * cosTable = sinTable + CartesianSinTable::QUARTER_TURN;
+    const _u16 * angles = scan.angles();
+    const _u32 * distances = scan.distances();
+    size_t count = scan.size();
+    size_t pos = 0;
+
+#if defined(CARTESIAN_USE_NEON)
+    for (; pos + 4 <= count; pos += 4) {
+        float cosv[4], sinv[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            cosv[lane] = cosTable[angles[pos + lane]];
+            sinv[lane] = sinTable[angles[pos + lane]];
+        }
+        float32x4_t d = vmulq_n_f32(vcvtq_f32_u32(vld1q_u32(distances + pos)), 0.25f);
+        float32x4x2_t xy;
+        xy.val[0] = vmulq_f32(d, vld1q_f32(cosv));
+        xy.val[1] = vmulq_f32(vnegq_f32(d), vld1q_f32(sinv));
+        // interleaved store: x0 y0 x1 y1 ...
+        vst2q_f32(&points[pos].x_mm, xy);
+    }
+#elif defined(CARTESIAN_USE_SSE2)
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (; pos + 4 <= count; pos += 4) {
+        const _u16 * angle = angles + pos;
+        // dist_mm_q2 stays below 2^31, the signed conversion is exact
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(distances + pos))), quarter);
+        __m128 c = _mm_set_ps(cosTable[angle[3]], cosTable[angle[2]], cosTable[angle[1]], cosTable[angle[0]]);
+        __m128 s = _mm_set_ps(sinTable[angle[3]], sinTable[angle[2]], sinTable[angle[1]], sinTable[angle[0]]);
+        __m128 x = _mm_mul_ps(d, c);
+        __m128 y = _mm_xor_ps(_mm_mul_ps(d, s), sign);
+        // interleave: x0 y0 x1 y1 | x2 y2 x3 y3
+        _mm_storeu_ps(&points[pos].x_mm, _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(&points[pos + 2].x_mm, _mm_unpackhi_ps(x, y));
+    }
+#endif
+
+    for (; pos < count; ++pos) {
+        float dist = distances[pos] / 4.0f;
+        points[pos].x_mm = dist * cosTable[angles[pos]];
+        points[pos].y_mm = -dist * sinTable[angles[pos]];
+    }
+}
+
+}}}
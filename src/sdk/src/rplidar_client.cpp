@@ -0,0 +1,430 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/socket.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace rp::net;
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// largest frame accepted from the network, a stream without delimiter must not exhaust the memory
+static const size_t MAX_BUFFER_SIZE = 16 * 1024 * 1024;
+
+// unsigned decimal number with an optional sign and fraction, as printed by "%.4f"
+static bool parseNumber(const _u8 *& p, const _u8 * end, float & value)
+{
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        ++p;
+    }
+
+    const _u8 * start = p;
+    float result = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p++ - '0');
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        float scale = 0.1f;
+        while (p < end && *p >= '0' && *p <= '9') {
+            result += (*p++ - '0') * scale;
+            scale *= 0.1f;
+        }
+    }
+    if (p == start) return false;
+
+    value = negative ? -result : result;
+    return true;
+}
+
+class ScanClientImpl : public ScanClient {
+public:
+    ScanClientImpl();
+    virtual ~ScanClientImpl();
+
+    virtual u_result connect(const char * host, int port);
+    virtual void disconnect();
+    virtual bool isConnected();
+    virtual u_result subscribe(const char * request);
+    virtual u_result waitFrame(ScanFrameView & frame, _u32 timeout);
+    virtual void getStats(ScanClientStats & stats);
+
+protected:
+    u_result _open();
+    void _close();
+    u_result _receive(_u32 timeout);
+    u_result _parseFrame(ScanFrameView & frame);
+    bool _skipToHeader();
+    bool _parseText(const _u8 * data, size_t size);
+    void _completeFrame(ScanFrameView & frame);
+
+    StreamSocket *      _socket;
+    SocketAddress       _server;
+    bool                _hasServer;
+    bool                _wasConnected;
+    _u32                _lastAttemptTs;
+    std::string         _request;
+    bool                _isBinary;          // a binary frame was received on this connection
+
+    // received bytes not parsed yet are in [_begin, _end), the frame returned last stays in place
+    // until the next call to waitFrame()
+    std::vector<_u8>    _buffer;
+    size_t              _begin;
+    size_t              _end;
+    _u64                _frameStartUs;
+    _u64                _lastRecvUs;
+    _u64                _lastFrameUs;
+
+    ScanDecoder         _decoder;
+    std::vector<rplidar_response_measurement_node_hq_t> _nodes;
+    size_t              _nodeCount;
+    ScanClientStats     _stats;
+};
+
+ScanClient * ScanClient::CreateClient()
+{
+    return new ScanClientImpl();
+}
+
+void ScanClient::DisposeClient(ScanClient * client)
+{
+    delete client;
+}
+
+ScanClientImpl::ScanClientImpl()
+    : _socket(NULL)
+    , _hasServer(false)
+    , _wasConnected(false)
+    , _lastAttemptTs(0)
+    , _isBinary(false)
+    , _begin(0)
+    , _end(0)
+    , _frameStartUs(0)
+    , _lastRecvUs(0)
+    , _lastFrameUs(0)
+    , _nodeCount(0)
+{
+    _buffer.resize(DEFAULT_BUFFER_SIZE);
+    _nodes.resize(8192);
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+ScanClientImpl::~ScanClientImpl()
+{
+    disconnect();
+}
+
+u_result ScanClientImpl::connect(const char * host, int port)
+{
+    if (_socket) return RESULT_ALREADY_DONE;
+
+    if (IS_FAIL(_server.setAddressFromString(host))) return RESULT_INVALID_DATA;
+    _server.setPort(port);
+    _hasServer = true;
+    _wasConnected = false;
+    return _open();
+}
+
+void ScanClientImpl::disconnect()
+{
+    _close();
+    _hasServer = false;
+}
+
+bool ScanClientImpl::isConnected()
+{
+    return _socket != NULL;
+}
+
+u_result ScanClientImpl::subscribe(const char * request)
+{
+    _request = request;
+    _request += '\n';
+    if (!_socket) return RESULT_OK;
+
+    u_result ans = _socket->send(_request.data(), _request.size());
+    if (IS_FAIL(ans)) _close();
+    return ans;
+}
+
+u_result ScanClientImpl::_open()
+{
+    _lastAttemptTs = getms();
+    _socket = StreamSocket::CreateSocket();
+    if (!_socket) return RESULT_OPERATION_FAIL;
+
+    u_result ans = _socket->connect(_server);
+    if (IS_FAIL(ans)) {
+        _close();
+        return ans;
+    }
+    _socket->enableNoDelay(true);
+
+    // the server starts the stream over with a keyframe
+    _decoder = ScanDecoder();
+    _isBinary = false;
+    _begin = _end = 0;
+    if (_wasConnected) ++_stats.reconnections;
+    _wasConnected = true;
+
+    if (!_request.empty() && IS_FAIL(_socket->send(_request.data(), _request.size()))) {
+        _close();
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
+void ScanClientImpl::_close()
+{
+    if (!_socket) return;
+    _socket->dispose();
+    _socket = NULL;
+}
+
+u_result ScanClientImpl::_receive(_u32 timeout)
+{
+    if (_end == _buffer.size()) {
+        if (_begin) {
+            memmove(&_buffer[0], &_buffer[_begin], _end - _begin);
+            _end -= _begin;
+            _begin = 0;
+        } else if (_buffer.size() < MAX_BUFFER_SIZE) {
+            _buffer.resize(_buffer.size() * 2);
+        } else {
+            // no frame boundary in sight, start over
+            ++_stats.lost_frames;
+            _begin = _end = 0;
+        }
+    }
+
+    u_result ans = _socket->waitforData(timeout);
+    if (ans == RESULT_OPERATION_TIMEOUT) return ans;
+
+    size_t len = 0;
+    if (IS_OK(ans)) ans = _socket->recv(&_buffer[_end], _buffer.size() - _end, len);
+    if (IS_FAIL(ans) || len == 0) {
+        // broken or closed by the server, opened again by waitFrame()
+        _close();
+        return RESULT_OPERATION_FAIL;
+    }
+
+    _lastRecvUs = getus();
+    if (_begin == _end) _frameStartUs = _lastRecvUs;
+    _end += len;
+    return RESULT_OK;
+}
+
+bool ScanClientImpl::_parseText(const _u8 * data, size_t size)
+{
+    const _u8 * p = data;
+    const _u8 * end = data + size;
+    _nodeCount = 0;
+
+    while (p < end) {
+        float angle, distance, quality;
+        if (!parseNumber(p, end, angle) || p == end || *p++ != ':') return false;
+        if (!parseNumber(p, end, distance) || p == end || *p++ != ':') return false;
+        if (!parseNumber(p, end, quality)) return false;
+        // the cartesian output appends the coordinates, which are not needed here
+        while (p < end && *p != ';') ++p;
+        if (p == end) return false;
+        ++p;
+
+        if (_nodeCount == _nodes.size()) _nodes.resize(_nodes.size() * 2);
+        rplidar_response_measurement_node_hq_t & node = _nodes[_nodeCount++];
+        node.angle_z_q14 = (_u16)(angle * 16384.f / 90.f + 0.5f);
+        node.dist_mm_q2 = (_u32)(distance * 4.f + 0.5f);
+        node.quality = (_u8)quality;
+        node.flag = (_nodeCount == 1) ? RPLIDAR_RESP_MEASUREMENT_SYNCBIT : 0;
+    }
+    return true;
+}
+
+void ScanClientImpl::_completeFrame(ScanFrameView & frame)
+{
+    frame.nodes = &_nodes[0];
+    frame.count = _nodeCount;
+    frame.timestamp_us = _lastRecvUs;
+
+    ++_stats.frames;
+    _stats.last_transfer_us = (_u32)(_lastRecvUs - _frameStartUs);
+    if (_stats.last_transfer_us > _stats.max_transfer_us) _stats.max_transfer_us = _stats.last_transfer_us;
+    if (_lastFrameUs) {
+        _stats.last_period_us = (_u32)(_lastRecvUs - _lastFrameUs);
+        if (_stats.last_period_us > _stats.max_period_us) _stats.max_period_us = _stats.last_period_us;
+    }
+    _lastFrameUs = _lastRecvUs;
+
+    // the next frame started within the last chunk received
+    _frameStartUs = _lastRecvUs;
+}
+
+u_result ScanClientImpl::_parseFrame(ScanFrameView & frame)
+{
+    while (_begin < _end) {
+        const _u8 * data = &_buffer[_begin];
+        size_t size = _end - _begin;
+
+        if (data[0] == SCAN_FRAME_SYNC_BYTE1) {
+            size_t count = _nodes.size();
+            size_t consumed = 0;
+            u_result ans = _decoder.decode(data, size, &_nodes[0], count, consumed);
+            if (ans == RESULT_OPERATION_TIMEOUT) return ans;
+            if (ans == RESULT_INSUFFICIENT_MEMORY) {
+                _nodes.resize(_nodes.size() * 2);
+                continue;
+            }
+            if (ans == RESULT_INVALID_DATA) {
+                // no text holds this byte: the stream is binary, resynchronized on the next header
+                ++_stats.lost_frames;
+                _isBinary = true;
+                ++_begin;
+                if (!_skipToHeader()) return RESULT_OPERATION_TIMEOUT;
+                continue;
+            }
+
+            _isBinary = true;
+            _begin += consumed;
+            if (IS_FAIL(ans)) {
+                ++_stats.lost_frames;
+                if (_decoder.isKeyframeNeeded() && _socket) {
+                    _u8 request = SCAN_STREAM_KEYFRAME_REQUEST;
+                    _socket->send(&request, sizeof(request));
+                }
+                continue;
+            }
+
+            if (!count) continue;  // probe of the server
+
+            frame.data = data;
+            frame.size = consumed;
+            frame.is_text = false;
+            _nodeCount = count;
+            _completeFrame(frame);
+            return RESULT_OK;
+        }
+
+        if (_isBinary) {
+            // stray bytes in a binary stream
+            ++_stats.lost_frames;
+            if (!_skipToHeader()) return RESULT_OPERATION_TIMEOUT;
+            continue;
+        }
+
+        // text records, up to the "M" delimiter
+        const _u8 * delimiter = (const _u8 *)memchr(data, 'M', size);
+        if (!delimiter) return RESULT_OPERATION_TIMEOUT;
+
+        size_t length = delimiter - data;
+        _begin += length + 1;
+        if (!length) continue;  // probe of the server
+        if (!_parseText(data, length)) {
+            ++_stats.lost_frames;
+            continue;
+        }
+
+        frame.data = data;
+        frame.size = length;
+        frame.is_text = true;
+        _completeFrame(frame);
+        return RESULT_OK;
+    }
+    return RESULT_OPERATION_TIMEOUT;
+}
+
+bool ScanClientImpl::_skipToHeader()
+{
+    // drop the bytes up to the next SCAN_FRAME_SYNC_BYTE1 SCAN_FRAME_SYNC_BYTE2 pair,
+    // false when the buffer does not hold one yet
+    while (_begin < _end) {
+        const _u8 * data = &_buffer[_begin];
+        const _u8 * sync = (const _u8 *)memchr(data, SCAN_FRAME_SYNC_BYTE1, _end - _begin);
+        if (!sync) {
+            _begin = _end;
+            return false;
+        }
+        _begin += sync - data;
+        if (_begin + 1 == _end) return false;
+        if (_buffer[_begin + 1] == SCAN_FRAME_SYNC_BYTE2) return true;
+        ++_begin;
+    }
+    return false;
+}
+
+u_result ScanClientImpl::waitFrame(ScanFrameView & frame, _u32 timeout)
+{
+    if (!_hasServer) return RESULT_OPERATION_FAIL;
+
+    // the frame returned last is not referenced any more
+    if (_begin) {
+        memmove(&_buffer[0], &_buffer[_begin], _end - _begin);
+        _end -= _begin;
+        _begin = 0;
+    }
+
+    _u32 startTs = getms();
+    _u32 waitTime = 0;
+
+    while (true) {
+        if (_parseFrame(frame) == RESULT_OK) return RESULT_OK;
+
+        waitTime = getms() - startTs;
+        if (waitTime >= timeout) break;
+
+        if (!_socket) {
+            _u32 sinceAttempt = getms() - _lastAttemptTs;
+            if (sinceAttempt < RECONNECT_INTERVAL) {
+                delay(std::min<_u32>(RECONNECT_INTERVAL - sinceAttempt, timeout - waitTime));
+                continue;
+            }
+            _open();
+            continue;
+        }
+
+        _receive(timeout - waitTime);
+    }
+    return RESULT_OPERATION_TIMEOUT;
+}
+
+void ScanClientImpl::getStats(ScanClientStats & stats)
+{
+    stats = _stats;
+}
+
+}}}
@@ -0,0 +1,480 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+static inline _u8 * putVarint(_u8 * out, _u32 value)
+{
+    while (value >= 0x80) {
+        *out++ = (_u8)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (_u8)value;
+    return out;
+}
+
+static inline _u32 zigzag(_s32 value)
+{
+    return ((_u32)value << 1) ^ (_u32)(value >> 31);
+}
+
+static inline _s32 unzigzag(_u32 value)
+{
+    return (_s32)(value >> 1) ^ -(_s32)(value & 1);
+}
+
+// bounds checked reader of a received frame
+struct FrameReader {
+    const _u8 * pos;
+    const _u8 * end;
+
+    bool getVarint(_u32 & value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (pos == end) return false;
+            _u8 byte = *pos++;
+            value |= (_u32)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool getByte(_u8 & value)
+    {
+        if (pos == end) return false;
+        value = *pos++;
+        return true;
+    }
+};
+
+static inline size_t binOf(_u16 angle, size_t binCount)
+{
+    return ((size_t)angle * binCount) >> 16;
+}
+
+static inline _u16 binStart(size_t bin, size_t binCount)
+{
+    return (_u16)((bin << 16) / binCount);
+}
+
+static _u8 * encodeQualities(_u8 * out, const rplidar_response_measurement_node_hq_t * nodes, size_t count)
+{
+    size_t runStart = 0;
+    for (size_t pos = 1; pos <= count; ++pos) {
+        if (pos < count && nodes[pos].quality == nodes[runStart].quality) continue;
+        out = putVarint(out, (_u32)(pos - runStart));
+        *out++ = nodes[runStart].quality;
+        runStart = pos;
+    }
+    return out;
+}
+
+static bool decodeQualities(FrameReader & reader, rplidar_response_measurement_node_hq_t * nodes, size_t count)
+{
+    size_t pos = 0;
+    while (pos < count) {
+        _u32 run;
+        _u8 quality;
+        if (!reader.getVarint(run) || !reader.getByte(quality)) return false;
+        if (!run || run > count - pos) return false;
+        for (size_t end = pos + run; pos < end; ++pos) nodes[pos].quality = quality;
+    }
+    return true;
+}
+
+// sections shared by the full frames and the keyframes
+static _u8 * encodeNodes(_u8 * out, const rplidar_response_measurement_node_hq_t * nodes, size_t count)
+{
+    out = putVarint(out, (_u32)count);
+    if (!count) return out;
+
+    out = putVarint(out, nodes[0].angle_z_q14);
+
+    _u16 prevStep = 0;
+    for (size_t pos = 1; pos < count; ++pos) {
+        _u16 step = (_u16)(nodes[pos].angle_z_q14 - nodes[pos - 1].angle_z_q14);
+        out = putVarint(out, zigzag((_s16)(_u16)(step - prevStep)));
+        prevStep = step;
+    }
+
+    _u32 prevDist = 0;
+    for (size_t pos = 0; pos < count; ++pos) {
+        _u32 dist = nodes[pos].dist_mm_q2;
+        if (!dist) {
+            *out++ = 0;
+            continue;
+        }
+        out = putVarint(out, zigzag((_s32)(dist - prevDist)) + 1);
+        prevDist = dist;
+    }
+
+    return encodeQualities(out, nodes, count);
+}
+
+static u_result decodeNodes(FrameReader & reader, rplidar_response_measurement_node_hq_t * nodes, size_t maxCount, size_t & count)
+{
+    _u32 frameCount;
+    if (!reader.getVarint(frameCount)) return RESULT_INVALID_DATA;
+    if (frameCount > maxCount) return RESULT_INSUFFICIENT_MEMORY;
+    count = frameCount;
+    if (!frameCount) return RESULT_OK;
+
+    _u32 value;
+    if (!reader.getVarint(value) || value > 0xFFFF) return RESULT_INVALID_DATA;
+    nodes[0].angle_z_q14 = (_u16)value;
+
+    _u16 step = 0;
+    for (size_t pos = 1; pos < frameCount; ++pos) {
+        if (!reader.getVarint(value)) return RESULT_INVALID_DATA;
+        step = (_u16)(step + unzigzag(value));
+        nodes[pos].angle_z_q14 = (_u16)(nodes[pos - 1].angle_z_q14 + step);
+    }
+
+    _u32 prevDist = 0;
+    for (size_t pos = 0; pos < frameCount; ++pos) {
+        if (!reader.getVarint(value)) return RESULT_INVALID_DATA;
+        if (value) prevDist += unzigzag(value - 1);
+        nodes[pos].dist_mm_q2 = value ? prevDist : 0;
+        nodes[pos].flag = 0;
+    }
+    nodes[0].flag = RPLIDAR_RESP_MEASUREMENT_SYNCBIT;
+
+    return decodeQualities(reader, nodes, frameCount) ? RESULT_OK : RESULT_INVALID_DATA;
+}
+
+ScanEncoder::ScanEncoder()
+    : _sequence(0)
+    , _framesSinceKeyframe(0)
+    , _keyframeRequested(true)
+{
+    _config = DefaultDeltaConfig();
+    _config.bin_count = 0;
+}
+
+size_t ScanEncoder::MaxFrameSize(size_t count)
+{
+    // sequence, bins, cleared count, count, first angle, then per node at most: cleared bin gap (3),
+    // bin gap (3), angle (3), distance (5), quality run (1 + 1)
+    return SCAN_FRAME_HEADER_SIZE + 5 + 5 + 5 + 5 + 3 + count * 16;
+}
+
+ScanDeltaConfig ScanEncoder::DefaultDeltaConfig()
+{
+    ScanDeltaConfig config;
+    config.bin_count = 2048;
+    config.threshold_mm = 20;
+    config.keyframe_interval = 100;
+    return config;
+}
+
+void ScanEncoder::setDeltaConfig(const ScanDeltaConfig & config)
+{
+    _config = config;
+    if (_config.bin_count > 65536) _config.bin_count = 65536;
+
+    _bins.resize(_config.bin_count);
+    _binUsed.assign(_config.bin_count, 0);
+    _current.resize(_config.bin_count);
+    _currentUsed.assign(_config.bin_count, 0);
+    _cleared.clear();
+    _cleared.reserve(_config.bin_count);
+    _changed.clear();
+    _changed.reserve(_config.bin_count);
+    _frame.resize(_config.bin_count);
+    _keyframeRequested = true;
+}
+
+void ScanEncoder::requestKeyframe()
+{
+    _keyframeRequested = true;
+}
+
+size_t ScanEncoder::encode(const rplidar_response_measurement_node_hq_t * nodes, size_t count, _u8 * buffer)
+{
+    _u8 * out = buffer + SCAN_FRAME_HEADER_SIZE;
+    _u8 type = SCAN_FRAME_TYPE_FULL;
+
+    if (!_config.bin_count) {
+        out = encodeNodes(out, nodes, count);
+    } else {
+        // the last node falling in a bin represents it
+        for (size_t pos = 0; pos < count; ++pos) {
+            size_t bin = binOf(nodes[pos].angle_z_q14, _config.bin_count);
+            _current[bin] = nodes[pos];
+            _currentUsed[bin] = 1;
+        }
+
+        out = putVarint(out, ++_sequence);
+        out = putVarint(out, (_u32)_config.bin_count);
+
+        // past that many cleared bins, a keyframe is smaller than the delta
+        if (_keyframeRequested || ++_framesSinceKeyframe >= _config.keyframe_interval
+            || _collectCleared() > count) {
+            type = SCAN_FRAME_TYPE_KEY;
+            out = _encodeKeyframe(out);
+            _keyframeRequested = false;
+            _framesSinceKeyframe = 0;
+        } else {
+            type = SCAN_FRAME_TYPE_DELTA;
+            out = _encodeDelta(out);
+        }
+    }
+
+    _u32 bodySize = (_u32)(out - buffer - SCAN_FRAME_HEADER_SIZE);
+    buffer[0] = SCAN_FRAME_SYNC_BYTE1;
+    buffer[1] = SCAN_FRAME_SYNC_BYTE2;
+    buffer[2] = type;
+    buffer[3] = (_u8)bodySize;
+    buffer[4] = (_u8)(bodySize >> 8);
+    buffer[5] = (_u8)(bodySize >> 16);
+    buffer[6] = (_u8)(bodySize >> 24);
+    return out - buffer;
+}
+
+_u8 * ScanEncoder::_encodeKeyframe(_u8 * out)
+{
+    // the previous content of the bins is forgotten, the receivers start over from this frame
+    size_t count = 0;
+    for (size_t bin = 0; bin < _config.bin_count; ++bin) {
+        _binUsed[bin] = _currentUsed[bin];
+        _currentUsed[bin] = 0;
+        if (!_binUsed[bin]) continue;
+        _bins[bin] = _current[bin];
+        _frame[count++] = _current[bin];
+    }
+    return encodeNodes(out, &_frame[0], count);
+}
+
+size_t ScanEncoder::_collectCleared()
+{
+    _cleared.clear();
+    for (size_t bin = 0; bin < _config.bin_count; ++bin) {
+        if (_binUsed[bin] && !_currentUsed[bin]) _cleared.push_back((_u32)bin);
+    }
+    return _cleared.size();
+}
+
+_u8 * ScanEncoder::_encodeDelta(_u8 * out)
+{
+    const _u32 threshold_q2 = _config.threshold_mm << 2;
+
+    out = putVarint(out, (_u32)_cleared.size());
+
+    _u32 nextBin = 0;
+    for (size_t pos = 0; pos < _cleared.size(); ++pos) {
+        out = putVarint(out, _cleared[pos] - nextBin);
+        nextBin = _cleared[pos] + 1;
+        _binUsed[_cleared[pos]] = 0;
+    }
+
+    _changed.clear();
+    for (size_t bin = 0; bin < _config.bin_count; ++bin) {
+        if (!_currentUsed[bin]) continue;
+        _currentUsed[bin] = 0;
+
+        _u32 dist = _current[bin].dist_mm_q2;
+        _u32 prevDist = _binUsed[bin] ? _bins[bin].dist_mm_q2 : 0;
+        _u32 diff = (dist > prevDist) ? dist - prevDist : prevDist - dist;
+        if (_binUsed[bin] && (!dist == !prevDist) && diff <= threshold_q2) continue;
+
+        _frame[_changed.size()] = _current[bin];
+        _changed.push_back((_u32)bin);
+    }
+    size_t count = _changed.size();
+
+    out = putVarint(out, (_u32)count);
+
+    nextBin = 0;
+    for (size_t pos = 0; pos < count; ++pos) {
+        out = putVarint(out, _changed[pos] - nextBin);
+        nextBin = _changed[pos] + 1;
+    }
+    for (size_t pos = 0; pos < count; ++pos) {
+        out = putVarint(out, (_u16)(_frame[pos].angle_z_q14 - binStart(_changed[pos], _config.bin_count)));
+    }
+    for (size_t pos = 0; pos < count; ++pos) {
+        size_t bin = _changed[pos];
+        _u32 dist = _frame[pos].dist_mm_q2;
+        _u32 prevDist = _binUsed[bin] ? _bins[bin].dist_mm_q2 : 0;
+        if (dist) {
+            out = putVarint(out, zigzag((_s32)(dist - prevDist)) + 1);
+        } else {
+            *out++ = 0;
+        }
+        _bins[bin] = _frame[pos];
+        _binUsed[bin] = 1;
+    }
+    return encodeQualities(out, &_frame[0], count);
+}
+
+ScanDecoder::ScanDecoder()
+    : _hasReference(false)
+    , _keyframeNeeded(false)
+    , _sequence(0)
+{
+}
+
+bool ScanDecoder::isKeyframeNeeded()
+{
+    return _keyframeNeeded;
+}
+
+u_result ScanDecoder::decode(const _u8 * data, size_t size, rplidar_response_measurement_node_hq_t * nodes, size_t & count, size_t & consumed)
+{
+    size_t maxCount = count;
+    count = 0;
+    consumed = 0;
+
+    if (size >= 1 && data[0] != SCAN_FRAME_SYNC_BYTE1) return RESULT_INVALID_DATA;
+    if (size >= 2 && data[1] != SCAN_FRAME_SYNC_BYTE2) return RESULT_INVALID_DATA;
+    if (size < SCAN_FRAME_HEADER_SIZE) return RESULT_OPERATION_TIMEOUT;
+
+    _u8 type = data[2];
+    if (type > SCAN_FRAME_TYPE_DELTA) return RESULT_INVALID_DATA;
+
+    _u32 bodySize = data[3] | (data[4] << 8) | (data[5] << 16) | ((_u32)data[6] << 24);
+    // a corrupted size must not stall the stream: the frame could not fit the node buffer anyway
+    if (bodySize > ScanEncoder::MaxFrameSize(maxCount)) return RESULT_INVALID_DATA;
+    if (size - SCAN_FRAME_HEADER_SIZE < bodySize) return RESULT_OPERATION_TIMEOUT;
+
+    FrameReader reader;
+    reader.pos = data + SCAN_FRAME_HEADER_SIZE;
+    reader.end = reader.pos + bodySize;
+
+    size_t frameCount = 0;
+    u_result ans;
+
+    if (type == SCAN_FRAME_TYPE_FULL) {
+        ans = decodeNodes(reader, nodes, maxCount, frameCount);
+        if (IS_FAIL(ans)) return ans;
+        if (reader.pos != reader.end) return RESULT_INVALID_DATA;
+
+        count = frameCount;
+        consumed = SCAN_FRAME_HEADER_SIZE + bodySize;
+        return RESULT_OK;
+    }
+
+    _u32 sequence, binCount;
+    if (!reader.getVarint(sequence) || !reader.getVarint(binCount)) return RESULT_INVALID_DATA;
+    if (!binCount || binCount > 65536) return RESULT_INVALID_DATA;
+    if (binCount > maxCount) return RESULT_INSUFFICIENT_MEMORY;
+
+    if (type == SCAN_FRAME_TYPE_KEY) {
+        ans = decodeNodes(reader, nodes, maxCount, frameCount);
+        if (IS_FAIL(ans)) return ans;
+        if (reader.pos != reader.end) return RESULT_INVALID_DATA;
+
+        _bins.resize(binCount);
+        _binUsed.assign(binCount, 0);
+        for (size_t pos = 0; pos < frameCount; ++pos) {
+            size_t bin = binOf(nodes[pos].angle_z_q14, binCount);
+            _bins[bin] = nodes[pos];
+            _binUsed[bin] = 1;
+        }
+        _hasReference = true;
+        _keyframeNeeded = false;
+        _sequence = sequence;
+
+        count = frameCount;
+        consumed = SCAN_FRAME_HEADER_SIZE + bodySize;
+        return RESULT_OK;
+    }
+
+    if (!_hasReference || binCount != _bins.size() || sequence != _sequence + 1) {
+        // nothing to apply this delta to
+        _hasReference = false;
+        _keyframeNeeded = true;
+        consumed = SCAN_FRAME_HEADER_SIZE + bodySize;
+        return RESULT_OPERATION_FAIL;
+    }
+
+    // the changes are checked before being applied, a bad frame leaves the bins untouched
+    _u32 clearedCount, changedCount, value;
+    if (!reader.getVarint(clearedCount) || clearedCount > binCount) return RESULT_INVALID_DATA;
+    _cleared.resize(clearedCount);
+
+    _u32 nextBin = 0;
+    for (size_t pos = 0; pos < clearedCount; ++pos) {
+        if (!reader.getVarint(value) || value >= binCount - nextBin) return RESULT_INVALID_DATA;
+        _cleared[pos] = nextBin + value;
+        nextBin = _cleared[pos] + 1;
+    }
+
+    if (!reader.getVarint(changedCount) || changedCount > binCount) return RESULT_INVALID_DATA;
+    _changed.resize(changedCount);
+    _changes.resize(changedCount);
+
+    nextBin = 0;
+    for (size_t pos = 0; pos < changedCount; ++pos) {
+        if (!reader.getVarint(value) || value >= binCount - nextBin) return RESULT_INVALID_DATA;
+        _changed[pos] = nextBin + value;
+        nextBin = _changed[pos] + 1;
+    }
+    for (size_t pos = 0; pos < changedCount; ++pos) {
+        if (!reader.getVarint(value) || value > 0xFFFF) return RESULT_INVALID_DATA;
+        _changes[pos].angle_z_q14 = (_u16)(binStart(_changed[pos], binCount) + value);
+        _changes[pos].flag = 0;
+    }
+    for (size_t pos = 0; pos < changedCount; ++pos) {
+        if (!reader.getVarint(value)) return RESULT_INVALID_DATA;
+        size_t bin = _changed[pos];
+        _u32 prevDist = _binUsed[bin] ? _bins[bin].dist_mm_q2 : 0;
+        _changes[pos].dist_mm_q2 = value ? prevDist + unzigzag(value - 1) : 0;
+    }
+    if (changedCount && !decodeQualities(reader, &_changes[0], changedCount)) return RESULT_INVALID_DATA;
+    if (reader.pos != reader.end) return RESULT_INVALID_DATA;
+
+    for (size_t pos = 0; pos < clearedCount; ++pos) {
+        _binUsed[_cleared[pos]] = 0;
+    }
+    for (size_t pos = 0; pos < changedCount; ++pos) {
+        _bins[_changed[pos]] = _changes[pos];
+        _binUsed[_changed[pos]] = 1;
+    }
+    _sequence = sequence;
+
+    for (size_t bin = 0; bin < binCount; ++bin) {
+        if (_binUsed[bin]) nodes[frameCount++] = _bins[bin];
+    }
+    if (frameCount) nodes[0].flag = RPLIDAR_RESP_MEASUREMENT_SYNCBIT;
+
+    count = frameCount;
+    consumed = SCAN_FRAME_HEADER_SIZE + bodySize;
+    return RESULT_OK;
+}
+
+}}}
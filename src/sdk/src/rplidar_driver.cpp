@@ -44,6 +44,9 @@
 #include "rplidar_driver_impl.h"
 #include "rplidar_driver_serial.h"
 #include "rplidar_driver_TCP.h"
+#ifdef RPLIDAR_HAS_IO_URING
+#include "arch/linux/net_uring.h"
+#endif
 
 #include <algorithm>
 
@@ -66,17 +69,35 @@ namespace rp { namespace standalone{ namespace rplidar {
         fprintf(stderr, "*WARN* YOU ARE USING DEPRECATED API: %s, PLEASE MOVE TO %s\n", fn, replacement);
     }
 
+// answer delay of a lidar which is up, waitDeviceReady() asks again after it
+static const _u32 DEVICE_POLL_TIMEOUT_MS = 200;
+// consecutive revolutions whose node counts differ by less than 1/STABLE_COUNT_RATIO
+static const _u32 STABLE_REVOLUTIONS = 2;
+static const size_t STABLE_COUNT_RATIO = 50;
+// missing units after which a stable scan is considered stalled, and the least delay for it
+static const _u32 STALL_UNITS = 4;
+static const _u32 STALL_MIN_MS = 20;
+// time given to a resynchronized stream to deliver a revolution
+static const _u32 RESYNC_TIMEOUT_MS = 500;
+// a recovery failing again within this delay did not fix the cause
+static const _u32 RECOVERY_HOLDOFF_MS = 5000;
+// least delay between a STOP and the next request (protocol), then the input is drained until it is
+// silent for STOP_QUIET_MS: the units sent before the STOP are still arriving
+static const _u32 STOP_SETTLE_MS = 1;
+static const _u32 STOP_QUIET_MS = 2;
+static const _u32 STOP_DRAIN_MAX_MS = 50;
+
 static void convert(const rplidar_response_measurement_node_t& from, rplidar_response_measurement_node_hq_t& to)
 {
     to.angle_z_q14 = (((from.angle_q6_checkbit) >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) << 8) / 90;  //transfer to q14 Z-angle
     to.dist_mm_q2 = from.distance_q2;
-    to.flag = (from.sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT);  // trasfer syncbit to HQ flag field
+    to.flag = (from.sync_quality & (RPLIDAR_RESP_MEASUREMENT_SYNCBIT | RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT));  // trasfer sync bits to HQ flag field
     to.quality = (from.sync_quality >> RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT;  //remove the last two bits and then make quality from 0-63 to 0-255
 }
 
 static void convert(const rplidar_response_measurement_node_hq_t& from, rplidar_response_measurement_node_t& to)
 {
-    to.sync_quality = (from.flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT) | ((from.quality >> RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+    to.sync_quality = (from.flag & (RPLIDAR_RESP_MEASUREMENT_SYNCBIT | RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT)) | ((from.quality >> RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT) << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
     to.angle_q6_checkbit = 1 | (((from.angle_z_q14 * 90) >> 8) << RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT);
     to.distance_q2 = from.dist_mm_q2 > _u16(-1) ? _u16(0) : _u16(from.dist_mm_q2);
 }
@@ -89,6 +110,12 @@ RPlidarDriver * RPlidarDriver::CreateDriver(_u32 drivertype)
         return new RPlidarDriverSerial();
     case DRIVER_TYPE_TCP:
          return new RPlidarDriverTCP();
+#ifdef RPLIDAR_HAS_IO_URING
+    case DRIVER_TYPE_SERIALPORT_URING:
+        return new RPlidarDriverSerial(new rp::arch::net::uring_serial());
+    case DRIVER_TYPE_TCP_URING:
+        return new RPlidarDriverSerial(new rp::arch::net::uring_tcp());
+#endif
     default:
         return NULL;
     }
@@ -105,8 +132,36 @@ RPlidarDriverImplCommon::RPlidarDriverImplCommon()
     : _isConnected(false)
     , _isScanning(false)
     , _isSupportingMotorCtrl(false)
-{
-    _cached_scan_node_hq_count = 0;
+    , _isExternalAcquisition(false)
+    , _scanFilter(NULL)
+    , _speedController(NULL)
+    , _hasScanRequest(false)
+    , _lastScanForce(false)
+    , _lastScanMode(RPLIDAR_CONF_SCAN_COMMAND_STD)
+    , _lastScanOptions(0)
+    , _motorPWM(0)
+    , _isResyncing(false)
+    , _lastRecoveryLevel(-1)
+    , _lastRecoveryMs(0)
+    , _stallTimeoutMs(0)
+    , _isStalled(false)
+    , _stallPending(false)
+    , _isSwitching(false)
+    , _switch_request_us(0)
+    , _capabilityCache(NULL)
+    , _deviceInfoKnown(false)
+    , _capabilitiesKnown(false)
+    , _capabilitiesLoading(false)
+    , _readyEvt(false)
+{
+    _cached_scan_ans_type = RPLIDAR_ANS_TYPE_MEASUREMENT;
+    _is_first_unit_pending = true;
+    _last_revolution_period_us = 0;
+    _last_revolution_node_count = 0;
+    _scan_request_us = 0;
+    _stable_revolutions = 0;
+    _is_scan_ready = false;
+    _scan_sample_duration_us = 0;
     _cached_scan_node_hq_count_for_interval_retrieve = 0;
     _cached_sampleduration_std = LEGACY_SAMPLE_DURATION;
     _cached_sampleduration_express = LEGACY_SAMPLE_DURATION;
@@ -122,6 +177,7 @@ u_result RPlidarDriverImplCommon::reset(_u32 timeout)
 {
     u_result ans;
 
+    _forgetDevice();
     {
         rp::hal::AutoLocker l(_lock);
 
@@ -237,6 +293,7 @@ u_result RPlidarDriverImplCommon::getDeviceInfo(rplidar_response_device_info_t &
     if (!isConnected()) return RESULT_OPERATION_FAIL;
 
     _disableDataGrabbing();
+    _forgetDevice();
 
     {
         rp::hal::AutoLocker l(_lock);
@@ -264,6 +321,10 @@ u_result RPlidarDriverImplCommon::getDeviceInfo(rplidar_response_device_info_t &
             return RESULT_OPERATION_TIMEOUT;
         }
         _chanDev->recvdata(reinterpret_cast<_u8 *>(&info), sizeof(info));
+
+        _deviceInfo = info;
+        _deviceInfoKnown = true;
+        _capabilitiesKnown = _capabilityCache && _capabilityCache->find(info, _capabilities);
     }
     return RESULT_OK;
 }
@@ -309,6 +370,7 @@ u_result RPlidarDriverImplCommon::_waitNode(rplidar_response_measurement_node_t
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        metricAdd(_metrics.bytes_read, recvSize);
 
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -319,6 +381,7 @@ u_result RPlidarDriverImplCommon::_waitNode(rplidar_response_measurement_node_t
                     if ( (tmp ^ currentByte) & 0x1 ) {
                         // pass
                     } else {
+                        metricAdd(_metrics.resyncs, 1);
                         continue;
                     }
 
@@ -329,6 +392,7 @@ u_result RPlidarDriverImplCommon::_waitNode(rplidar_response_measurement_node_t
                     if (currentByte & RPLIDAR_RESP_MEASUREMENT_CHECKBIT) {
                         // pass
                     } else {
+                        metricAdd(_metrics.resyncs, 2);
                         recvPos = 0;
                         continue;
                     }
@@ -394,6 +458,7 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        metricAdd(_metrics.bytes_read, recvSize);
         
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -406,6 +471,7 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
                         // pass
                     } else {
                         _is_previous_capsuledataRdy = false;
+                        metricAdd(_metrics.resyncs, 1);
                         continue;
                     }
 
@@ -419,6 +485,7 @@ u_result RPlidarDriverImplCommon::_waitCapsuledNode(rplidar_response_capsule_mea
                     } else {
                         recvPos = 0;
                         _is_previous_capsuledataRdy = false;
+                        metricAdd(_metrics.resyncs, 2);
                         continue;
                     }
                 }
@@ -478,6 +545,7 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        metricAdd(_metrics.bytes_read, recvSize);
         
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -490,6 +558,7 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
                     }
                     else {
                         _is_previous_capsuledataRdy = false;
+                        metricAdd(_metrics.resyncs, 1);
                         continue;
                     }
                 }    
@@ -503,6 +572,7 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
                 else {
                     recvPos = 0;
                     _is_previous_capsuledataRdy = false;
+                    metricAdd(_metrics.resyncs, 2);
                     continue;
                 }
             }
@@ -542,241 +612,464 @@ u_result RPlidarDriverImplCommon::_waitUltraCapsuledNode(rplidar_response_ultra_
 
 u_result RPlidarDriverImplCommon::_cacheScanData()
 {
-    rplidar_response_measurement_node_t      local_buf[128];
-    size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
     u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
-
-    _waitScanData(local_buf, count); // // always discard the first data since it may be incomplete
 
+    Tracer::SetThreadName("rplidar acquisition");
     while(_isScanning)
     {
-        if (IS_FAIL(ans=_waitScanData(local_buf, count))) {
-            if (ans != RESULT_OPERATION_TIMEOUT) {
+        if (_isSwitching || _isResyncing) {
+            // switchScanMode() is reading the answer of the lidar, or recoverScan() resets the decoding
+            delay(1);
+            continue;
+        }
+        rp::hal::AutoLocker l(_acquisition_lock);
+
+        // the watchdog is armed once the spin-up, or the scan mode switch, is over
+        bool watched = _is_scan_ready && _stallTimeoutMs && !_switch_request_us;
+        ans = _acquireScanData(watched ? _stallTimeoutMs : DEFAULT_TIMEOUT);
+        // taken on every pass, so that a wait cut short elsewhere does not excuse a later stall
+        bool cancelled = _chanDev->takeWaitCancelled();
+        if (IS_FAIL(ans)) {
+            if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
                 _isScanning = false;
                 return RESULT_OPERATION_FAIL;
             }
-        }
-        
-        for (size_t pos = 0; pos < count; ++pos)
-        {
-            if (local_buf[pos].sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-                // only publish the data when it contains a full 360 degree scan 
-                
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
-            }
-
-            rplidar_response_measurement_node_hq_t nodeHq;
-            convert(local_buf[pos], nodeHq);
-            local_scan[scan_count++] = nodeHq;
-            if (scan_count == _countof(local_scan)) scan_count-=1; // prevent overflow
-
-            //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = nodeHq;
-                if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
+            if (ans == RESULT_OPERATION_TIMEOUT && cancelled) {
+                // cut short by recoverScan(), also when its cancellation arrived before this wait
+            } else if (ans == RESULT_OPERATION_TIMEOUT && watched && !_isStalled) {
+                // wake up grabScanDataHq() so that it reports the stall right away
+                _isStalled = true;
+                _stallPending = true;
+                metricAdd(_metrics.stalls, 1);
+                _dataEvt.set();
             }
+        } else {
+            _isStalled = false;
         }
+        _resumeAfterReconnect();
     }
     _isScanning = false;
     return RESULT_OK;
 }
 
-u_result RPlidarDriverImplCommon::startScanNormal(bool force,  _u32 timeout)
+void RPlidarDriverImplCommon::_resumeAfterReconnect()
 {
-    u_result ans;
-    if (!isConnected()) return RESULT_OPERATION_FAIL;
-    if (_isScanning) return RESULT_ALREADY_DONE;
+    if (!_chanDev->takeReconnected()) return;
 
-    stop(); //force the previous operation to stop
-
-    {
-        rp::hal::AutoLocker l(_lock);
-
-        if (IS_FAIL(ans = _sendCommand(force?RPLIDAR_CMD_FORCE_SCAN:RPLIDAR_CMD_SCAN))) {
-            return ans;
-        }
-
-        // waiting for confirmation
-        rplidar_ans_header_t response_header;
-        if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
-            return ans;
-        }
+    // the link came back without the scan request, send it again in the current mode;
+    // on failure the stall is left to the watchdog and recoverScan()
+    RplidarScanMode mode;
+    memset(&mode, 0, sizeof(mode));
+    mode.id = _lastScanMode;
+    mode.ans_type = _cached_scan_ans_type;
+    mode.us_per_sample = _scan_sample_duration_us;
+    metricAdd(_metrics.link_reconnects, 1);
+    _switchScan(mode, _lastScanOptions, DEFAULT_TIMEOUT);
+}
 
-        // verify whether we got a correct header
-        if (response_header.type != RPLIDAR_ANS_TYPE_MEASUREMENT) {
-            return RESULT_INVALID_DATA;
-        }
+u_result RPlidarDriverImplCommon::_startAcquisition(_u8 scanAnsType, float sampleDuration)
+{
+    _setScanAnsType(scanAnsType, sampleDuration);
+    _assembling_scan.clear();
+    _is_first_unit_pending = true;
+    _last_revolution_period_us = 0;
+    _last_revolution_node_count = 0;
+    _scan_request_us = getus();
+    _switch_request_us = 0;
+    _stable_revolutions = 0;
+    _is_scan_ready = false;
+    _readyEvt.set(false);
+    _isScanning = true;
 
-        _u32 header_size = (response_header.size_q30_subtype & RPLIDAR_ANS_HEADER_SIZE_MASK);
-        if (header_size < sizeof(rplidar_response_measurement_node_t)) {
-            return RESULT_INVALID_DATA;
-        }
+    if (_isExternalAcquisition) return RESULT_OK;
 
-        _isScanning = true;
-        _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheScanData);
-        if (_cachethread.getHandle() == 0) {
-            return RESULT_OPERATION_FAIL;
-        }
+    _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheScanData);
+    if (_cachethread.getHandle() == 0) {
+        _isScanning = false;
+        return RESULT_OPERATION_FAIL;
     }
     return RESULT_OK;
 }
 
-u_result RPlidarDriverImplCommon::checkExpressScanSupported(bool & support, _u32 timeout)
+void RPlidarDriverImplCommon::_setScanAnsType(_u8 scanAnsType, float sampleDuration)
 {
-    DEPRECATED_WARN("checkExpressScanSupported(bool&,_u32)", "getAllSupportedScanModes()");
-
-    rplidar_response_device_info_t devinfo;
-
-    support = false;
-    u_result ans = getDeviceInfo(devinfo, timeout);
-
-    if (IS_FAIL(ans)) return ans;
+    _cached_scan_ans_type = scanAnsType;
+    _scan_sample_duration_us = sampleDuration;
+    _assembling_scan.reserve(Scan::ExpectedSize(sampleDuration));
+    _cached_scan.reserve(Scan::ExpectedSize(sampleDuration));
 
-    if (devinfo.firmware_version >= ((0x1<<8) | 17)) {
-        support = true;
-        rplidar_response_sample_rate_t sample_rate;
-        getSampleDuration_uS(sample_rate);
-        _cached_sampleduration_express = sample_rate.express_sample_duration_us;
-        _cached_sampleduration_std = sample_rate.std_sample_duration_us;
+    size_t samplesPerUnit;
+    switch (scanAnsType)
+    {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        samplesPerUnit = 1;
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+        samplesPerUnit = _countof(((rplidar_response_capsule_measurement_nodes_t *)0)->cabins) * 2;
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        samplesPerUnit = _countof(((rplidar_response_dense_capsule_measurement_nodes_t *)0)->cabins);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        samplesPerUnit = _countof(((rplidar_response_hq_capsule_measurement_nodes_t *)0)->node_hq);
+        break;
+    default:
+        samplesPerUnit = _countof(((rplidar_response_ultra_capsule_measurement_nodes_t *)0)->ultra_cabins) * 3;
+        break;
     }
+    _stallTimeoutMs = (_u32)(STALL_UNITS * samplesPerUnit * sampleDuration / 1000);
+    if (sampleDuration > 0 && _stallTimeoutMs < STALL_MIN_MS) _stallTimeoutMs = STALL_MIN_MS;
+    _isStalled = false;
+    _stallPending = false;
+}
 
-    return RESULT_OK;
+u_result RPlidarDriverImplCommon::_countFailure(u_result ans)
+{
+    if (ans == RESULT_INVALID_DATA) {
+        metricAdd(_metrics.checksum_errors, 1);
+    } else if (ans == RESULT_OPERATION_TIMEOUT) {
+        metricAdd(_metrics.timeouts, 1);
+    }
+    return ans;
 }
 
-u_result RPlidarDriverImplCommon::_cacheCapsuledScanData()
+u_result RPlidarDriverImplCommon::_acquireScanData(_u32 timeout)
 {
-    rplidar_response_capsule_measurement_nodes_t    capsule_node;
     rplidar_response_measurement_node_hq_t   local_buf[128];
-    size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
+    size_t                                   count = 0;
+    size_t                                   unit_size;
+    size_t                                   buffered = 0;
     u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
 
-    _waitCapsuledNode(capsule_node); // // always discard the first data since it may be incomplete
+    switch (_cached_scan_ans_type)
+    {
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        unit_size = sizeof(rplidar_response_measurement_node_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
+        unit_size = sizeof(rplidar_response_capsule_measurement_nodes_t);
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
+        unit_size = sizeof(rplidar_response_hq_capsule_measurement_nodes_t);
+        break;
+    default:
+        unit_size = sizeof(rplidar_response_ultra_capsule_measurement_nodes_t);
+        break;
+    }
 
-    
-    
+    // the decoders lose a partially received unit when they time out:
+    // only enter them once a whole unit is buffered, leaving some room for a resync
+    TraceScope uartWait("uart_wait");
+    if (!_chanDev->waitfordata(unit_size, timeout, &buffered)) {
+        metricAdd(_metrics.timeouts, 1);
+        return RESULT_OPERATION_TIMEOUT;
+    }
+    uartWait.end();
+    metricSet(_metrics.rx_queue_bytes, buffered);
+    _u32 frameTimeout = (timeout < 100) ? 100 : timeout;
 
-    while(_isScanning)
+    TraceScope decode("decode");
+    _u64 decodeStart = getus();
+
+    switch (_cached_scan_ans_type)
     {
-        if (IS_FAIL(ans=_waitCapsuledNode(capsule_node))) {
-            if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
-                _isScanning = false;
-                return RESULT_OPERATION_FAIL;
-            } else {
-                // current data is invalid, do not use it.
-                continue;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT:
+        {
+            rplidar_response_measurement_node_t legacy_buf[_countof(local_buf)];
+            count = min(buffered / unit_size, _countof(legacy_buf));
+            if (count == 0) count = 1;
+            if (IS_FAIL(ans = _waitScanData(legacy_buf, count, frameTimeout))) {
+                return _countFailure(ans);
+            }
+            for (size_t pos = 0; pos < count; ++pos) {
+                convert(legacy_buf[pos], local_buf[pos]);
             }
         }
-        switch (_cached_express_flag) 
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED:
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED:
         {
-        case 0:
-            _capsuleToNormal(capsule_node, local_buf, count);
-            break;
-        case 1:
-            _dense_capsuleToNormal(capsule_node, local_buf, count);
-            break;
+            rplidar_response_capsule_measurement_nodes_t capsule_node;
+            if (IS_FAIL(ans = _waitCapsuledNode(capsule_node, frameTimeout))) {
+                return _countFailure(ans);
+            }
+            switch (_cached_express_flag)
+            {
+            case 0:
+                _capsuleToNormal(capsule_node, local_buf, count);
+                break;
+            case 1:
+                _dense_capsuleToNormal(capsule_node, local_buf, count);
+                break;
+            }
         }
-        //
-        
-        for (size_t pos = 0; pos < count; ++pos)
+        break;
+    case RPLIDAR_ANS_TYPE_MEASUREMENT_HQ:
         {
-            if (local_buf[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-                // only publish the data when it contains a full 360 degree scan 
-                
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
+            rplidar_response_hq_capsule_measurement_nodes_t hq_node;
+            if (IS_FAIL(ans = _waitHqNode(hq_node, frameTimeout))) {
+                return _countFailure(ans);
             }
-            local_scan[scan_count++] = local_buf[pos];
-            if (scan_count == _countof(local_scan)) scan_count-=1; // prevent overflow
-
-            //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
+            _HqToNormal(hq_node, local_buf, count);
+        }
+        break;
+    default:
+        {
+            rplidar_response_ultra_capsule_measurement_nodes_t ultra_capsule_node;
+            if (IS_FAIL(ans = _waitUltraCapsuledNode(ultra_capsule_node, frameTimeout))) {
+                return _countFailure(ans);
             }
+            _ultraCapsuleToNormal(ultra_capsule_node, local_buf, count);
         }
+        break;
     }
-    _isScanning = false;
 
+    metricAdd(_metrics.units_decoded, (_cached_scan_ans_type == RPLIDAR_ANS_TYPE_MEASUREMENT) ? count : 1);
+    metricAdd(_metrics.decode_us, getus() - decodeStart);
+    decode.end();
+
+    if (_is_first_unit_pending) {
+        // always discard the first data since it may be incomplete
+        _is_first_unit_pending = false;
+        return RESULT_OK;
+    }
+
+    _publishNodes(local_buf, count);
     return RESULT_OK;
 }
 
-u_result RPlidarDriverImplCommon::_cacheUltraCapsuledScanData()
+void RPlidarDriverImplCommon::_publishNodes(const rplidar_response_measurement_node_hq_t * nodes, size_t count)
 {
-    rplidar_response_ultra_capsule_measurement_nodes_t    ultra_capsule_node;
-    rplidar_response_measurement_node_hq_t   local_buf[128];
-    size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
-    u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
+    TraceScope assemble("assemble");
+    _u64 now = getus();
+    _u64 period_us = 0;
+    _u64 sample_clock_period_us = 0;
+    MotorSpeedController * speedController;
 
-    _waitUltraCapsuledNode(ultra_capsule_node);
-    
-    while(_isScanning)
+    // _assembling_scan belongs to the holder of _acquisition_lock, _lock only covers what the grab calls read
+    for (size_t pos = 0; pos < count; ++pos)
     {
-        if (IS_FAIL(ans=_waitUltraCapsuledNode(ultra_capsule_node))) {
-            if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
-                _isScanning = false;
-                return RESULT_OPERATION_FAIL;
-            } else {
-                // current data is invalid, do not use it.
-                continue;
-            }
-        }
-        
-        _ultraCapsuleToNormal(ultra_capsule_node, local_buf, count);
-        
-        for (size_t pos = 0; pos < count; ++pos)
+        if (nodes[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
         {
-            if (local_buf[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-                // only publish the data when it contains a full 360 degree scan 
-                
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count*sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
+            // only publish the data when it contains a full 360 degree scan 
+            if (!_assembling_scan.empty()) {
+                period_us = now - _assembling_scan.timestamp_us;
+                // unlike the arrival time, the sample clock of the lidar is not affected by the UART batching
+                sample_clock_period_us = (_u64)(_assembling_scan.size() * _scan_sample_duration_us);
+                {
+                    // the grab calls are not held by the filter pass
+                    rp::hal::AutoLocker filter(_filter_lock);
+                    if (_scanFilter) _scanFilter->process(_assembling_scan);
                 }
-                scan_count = 0;
-            }
-            local_scan[scan_count++] = local_buf[pos];
-            if (scan_count == _countof(local_scan)) scan_count-=1; // prevent overflow
 
-            //for interval retrieve
-            {
+                TraceScope lockWait("assemble_lock_wait");
                 rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
+                lockWait.end();
+                _countRevolution(period_us, _assembling_scan.size());
+                // the revolution not grabbed, if any, is the next one to assemble
+                _cached_scan.swap(_assembling_scan);
+                _dataEvt.set();
             }
+            _assembling_scan.clear();
+            _assembling_scan.timestamp_us = now;
+        }
+        // the nodes before the first sync node are not part of a full revolution
+        if (!_assembling_scan.empty() || (nodes[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
+            _assembling_scan.push_back(nodes[pos]);
         }
     }
-    
-    _isScanning = false;
+
+    {
+        TraceScope lockWait("assemble_lock_wait");
+        rp::hal::AutoLocker l(_lock);
+        lockWait.end();
+
+        for (size_t pos = 0; pos < count; ++pos)
+        {
+            //for interval retrieve
+            _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = nodes[pos];
+            if(_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve-=1; // prevent overflow
+        }
+        speedController = _speedController;
+    }
+
+    // the controller may send a command to the lidar, which takes the lock
+    if (period_us && speedController) speedController->update(sample_clock_period_us ? sample_clock_period_us : period_us);
+}
+
+void RPlidarDriverImplCommon::_countRevolution(_u64 period_us, size_t count)
+{
+    metricAdd(_metrics.revolutions, 1);
+    _metrics.nodes_per_revolution.observe(count);
+    _metrics.revolution_period_us.observe(period_us);
+    if (_last_revolution_period_us) {
+        _u64 jitter = (period_us > _last_revolution_period_us) ? period_us - _last_revolution_period_us : _last_revolution_period_us - period_us;
+        _metrics.revolution_jitter_us.observe(jitter);
+    }
+    _last_revolution_period_us = period_us;
+    if (_switch_request_us) {
+        metricSet(_metrics.scan_switch_blind_us, getus() - _switch_request_us);
+        _switch_request_us = 0;
+    }
+
+    // the node count settles with the rotation speed at the end of the spin-up
+    if (!_is_scan_ready) {
+        size_t delta = (count > _last_revolution_node_count) ? count - _last_revolution_node_count : _last_revolution_node_count - count;
+        if (_last_revolution_node_count && delta * STABLE_COUNT_RATIO <= _last_revolution_node_count) {
+            _stable_revolutions++;
+        } else {
+            _stable_revolutions = 0;
+        }
+        if (_stable_revolutions >= STABLE_REVOLUTIONS) {
+            _is_scan_ready = true;
+            metricSet(_metrics.scan_ready_us, getus() - _scan_request_us);
+            _readyEvt.set();
+        }
+    }
+    _last_revolution_node_count = count;
+}
+
+void RPlidarDriverImplCommon::setSpeedController(MotorSpeedController * controller)
+{
+    rp::hal::AutoLocker l(_lock);
+    _speedController = controller;
+}
+
+void RPlidarDriverImplCommon::setCapabilityCache(LidarCapabilityCache * cache)
+{
+    _capabilityCache = cache;
+    _capabilitiesKnown = cache && _deviceInfoKnown && cache->find(_deviceInfo, _capabilities);
+}
+
+void RPlidarDriverImplCommon::_forgetDevice()
+{
+    _deviceInfoKnown = false;
+    _capabilitiesKnown = false;
+}
+
+void RPlidarDriverImplCommon::_loadCapabilities()
+{
+    if (!_capabilityCache || _capabilitiesKnown || _capabilitiesLoading || !_deviceInfoKnown) return;
+
+    LidarCapabilities capabilities;
+    memcpy(capabilities.serialnum, _deviceInfo.serialnum, sizeof(capabilities.serialnum));
+    capabilities.firmware_version = _deviceInfo.firmware_version;
+    capabilities.hardware_version = _deviceInfo.hardware_version;
+    capabilities.model = _deviceInfo.model;
+
+    // the queries below reach the lidar since the capabilities are not known yet
+    _capabilitiesLoading = true;
+    u_result ans = getAllSupportedScanModes(capabilities.modes);
+    if (IS_OK(ans)) ans = getTypicalScanMode(capabilities.typical_mode);
+    _capabilitiesLoading = false;
+    if (IS_FAIL(ans) || !_deviceInfoKnown) return;
+
+    _capabilityCache->store(capabilities);
+    _capabilities = capabilities;
+    _capabilitiesKnown = true;
+}
+
+const RplidarScanMode * RPlidarDriverImplCommon::_cachedScanMode(_u16 scanModeID)
+{
+    if (!_capabilitiesKnown) return NULL;
+    for (size_t i = 0; i < _capabilities.modes.size(); i++) {
+        if (_capabilities.modes[i].id == scanModeID) return &_capabilities.modes[i];
+    }
+    return NULL;
+}
+
+const RplidarDriverMetrics & RPlidarDriverImplCommon::getMetrics()
+{
+    return _metrics;
+}
+
+void RPlidarDriverImplCommon::setScanFilter(ScanFilter * filter)
+{
+    rp::hal::AutoLocker l(_filter_lock);
+    _scanFilter = filter;
+}
+
+u_result RPlidarDriverImplCommon::setExternalAcquisition(bool enable)
+{
+    if (_isScanning) return RESULT_OPERATION_FAIL;
+    _isExternalAcquisition = enable;
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::pumpScanData(_u32 timeout)
+{
+    if (!_isExternalAcquisition) return RESULT_OPERATION_NOT_SUPPORT;
+
+    rp::hal::AutoLocker l(_acquisition_lock);
+    if (!_isScanning) return RESULT_OPERATION_FAIL;
+
+    u_result ans = _acquireScanData(timeout);
+    _resumeAfterReconnect();
+    while (ans == RESULT_OK || ans == RESULT_INVALID_DATA)
+    {
+        // drain what is already buffered without waiting
+        if ((ans = _acquireScanData(0)) == RESULT_OPERATION_TIMEOUT) return RESULT_OK;
+    }
+
+    if (ans != RESULT_OPERATION_TIMEOUT) {
+        _isScanning = false;
+        return RESULT_OPERATION_FAIL;
+    }
+    return ans;
+}
+
+int RPlidarDriverImplCommon::getNativeHandle()
+{
+    return _chanDev ? _chanDev->getNativeHandle() : -1;
+}
+
+u_result RPlidarDriverImplCommon::startScanNormal(bool force,  _u32 timeout)
+{
+    u_result ans;
+    if (!isConnected()) return RESULT_OPERATION_FAIL;
+    if (_isScanning) return RESULT_ALREADY_DONE;
+
+    _hasScanRequest = true;
+    _lastScanForce = force;
+    _lastScanMode = RPLIDAR_CONF_SCAN_COMMAND_STD;
+    _lastScanOptions = 0;
+
+    stop(); //force the previous operation to stop
+
+    {
+        rp::hal::AutoLocker l(_lock);
+
+        if (IS_FAIL(ans = _sendCommand(force?RPLIDAR_CMD_FORCE_SCAN:RPLIDAR_CMD_SCAN))) {
+            return ans;
+        }
+
+        if (IS_FAIL(ans = _waitScanHeader(RPLIDAR_ANS_TYPE_MEASUREMENT, timeout))) {
+            return ans;
+        }
+
+        return _startAcquisition(RPLIDAR_ANS_TYPE_MEASUREMENT, _cached_sampleduration_std);
+    }
+}
+
+u_result RPlidarDriverImplCommon::checkExpressScanSupported(bool & support, _u32 timeout)
+{
+    DEPRECATED_WARN("checkExpressScanSupported(bool&,_u32)", "getAllSupportedScanModes()");
+
+    rplidar_response_device_info_t devinfo;
+
+    support = false;
+    u_result ans = getDeviceInfo(devinfo, timeout);
+
+    if (IS_FAIL(ans)) return ans;
+
+    if (devinfo.firmware_version >= ((0x1<<8) | 17)) {
+        support = true;
+        rplidar_response_sample_rate_t sample_rate;
+        getSampleDuration_uS(sample_rate);
+        _cached_sampleduration_express = sample_rate.express_sample_duration_us;
+        _cached_sampleduration_std = sample_rate.std_sample_duration_us;
+    }
 
     return RESULT_OK;
 }
@@ -888,57 +1181,6 @@ void     RPlidarDriverImplCommon::_dense_capsuleToNormal(const rplidar_response_
     _is_previous_capsuledataRdy = true;
 }
 
-u_result RPlidarDriverImplCommon::_cacheHqScanData()
-{
-    rplidar_response_hq_capsule_measurement_nodes_t    hq_node;
-    rplidar_response_measurement_node_hq_t   local_buf[128];
-    size_t                                   count = 128;
-    rplidar_response_measurement_node_hq_t   local_scan[MAX_SCAN_NODES];
-    size_t                                   scan_count = 0;
-    u_result                                 ans;
-    memset(local_scan, 0, sizeof(local_scan));
-    _waitHqNode(hq_node);
-    while (_isScanning) {
-        if (IS_FAIL(ans = _waitHqNode(hq_node))) {
-            if (ans != RESULT_OPERATION_TIMEOUT && ans != RESULT_INVALID_DATA) {
-                _isScanning = false;
-                return RESULT_OPERATION_FAIL;
-            }
-            else {
-				// current data is invalid, do not use it.
-				continue;
-            }
-        }
-
-        _HqToNormal(hq_node, local_buf, count);
-        for (size_t pos = 0; pos < count; ++pos)
-        {
-            if (local_buf[pos].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)
-            {
-				// only publish the data when it contains a full 360 degree scan 
-                if ((local_scan[0].flag & RPLIDAR_RESP_MEASUREMENT_SYNCBIT)) {
-                    _lock.lock();
-                    memcpy(_cached_scan_node_hq_buf, local_scan, scan_count * sizeof(rplidar_response_measurement_node_hq_t));
-                    _cached_scan_node_hq_count = scan_count;
-                    _dataEvt.set();
-                    _lock.unlock();
-                }
-                scan_count = 0;
-            }
-            local_scan[scan_count++] = local_buf[pos];
-            if (scan_count == _countof(local_scan)) scan_count -= 1; // prevent overflow
-																	 //for interval retrieve
-            {
-                rp::hal::AutoLocker l(_lock);
-                _cached_scan_node_hq_buf_for_interval_retrieve[_cached_scan_node_hq_count_for_interval_retrieve++] = local_buf[pos];
-                if (_cached_scan_node_hq_count_for_interval_retrieve == _countof(_cached_scan_node_hq_buf_for_interval_retrieve)) _cached_scan_node_hq_count_for_interval_retrieve -= 1; // prevent overflow
-            }
-        }
-
-    }
-    return RESULT_OK;
-}
-
 //CRC calculate
 static _u32 table[256];//crc32_table
 
@@ -1034,6 +1276,7 @@ u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measur
         if (recvSize > remainSize) recvSize = remainSize;
         
         recvSize = _chanDev->recvdata(recvBuffer, recvSize);
+        metricAdd(_metrics.bytes_read, recvSize);
     
         for (size_t pos = 0; pos < recvSize; ++pos) {
             _u8 currentByte = recvBuffer[pos];
@@ -1047,6 +1290,7 @@ u_result RPlidarDriverImplCommon::_waitHqNode(rplidar_response_hq_capsule_measur
                     else {
                         recvPos = 0;
                         _is_previous_HqdataRdy = false;
+                        metricAdd(_metrics.resyncs, 1);
                         continue;
                     }
                 }
@@ -1251,11 +1495,16 @@ void RPlidarDriverImplCommon::_ultraCapsuleToNormal(const rplidar_response_ultra
 
 u_result RPlidarDriverImplCommon::checkSupportConfigCommands(bool& outSupport, _u32 timeoutInMs)
 {
-    u_result ans;
+    u_result ans = RESULT_OK;
 
     rplidar_response_device_info_t devinfo;
-    ans = getDeviceInfo(devinfo, timeoutInMs);
-    if (IS_FAIL(ans)) return ans;
+    if (_capabilityCache && _deviceInfoKnown) {
+        // the lidar cannot change without a new getDeviceInfo()
+        devinfo = _deviceInfo;
+    } else {
+        ans = getDeviceInfo(devinfo, timeoutInMs);
+        if (IS_FAIL(ans)) return ans;
+    }
 
     // if lidar firmware >= 1.24
     if (devinfo.firmware_version >= ((0x1 << 8) | 24)) {
@@ -1331,6 +1580,12 @@ u_result RPlidarDriverImplCommon::getLidarConf(_u32 type, std::vector<_u8> &outp
 
 u_result RPlidarDriverImplCommon::getTypicalScanMode(_u16& outMode, _u32 timeoutInMs)
 {
+    _loadCapabilities();
+    if (_capabilitiesKnown) {
+        outMode = _capabilities.typical_mode;
+        return RESULT_OK;
+    }
+
     u_result ans;
     std::vector<_u8> answer;
     bool lidarSupportConfigCmds = false;
@@ -1362,6 +1617,12 @@ u_result RPlidarDriverImplCommon::getTypicalScanMode(_u16& outMode, _u32 timeout
 
 u_result RPlidarDriverImplCommon::getLidarSampleDuration(float& sampleDurationRes, _u16 scanModeID, _u32 timeoutInMs)
 {
+    const RplidarScanMode * cached = _cachedScanMode(scanModeID);
+    if (cached) {
+        sampleDurationRes = cached->us_per_sample;
+        return RESULT_OK;
+    }
+
     u_result ans;
     std::vector<_u8> reserve(2);
     memcpy(&reserve[0], &scanModeID, sizeof(scanModeID));
@@ -1383,6 +1644,12 @@ u_result RPlidarDriverImplCommon::getLidarSampleDuration(float& sampleDurationRe
 
 u_result RPlidarDriverImplCommon::getMaxDistance(float &maxDistance, _u16 scanModeID, _u32 timeoutInMs)
 {
+    const RplidarScanMode * cached = _cachedScanMode(scanModeID);
+    if (cached) {
+        maxDistance = cached->max_distance;
+        return RESULT_OK;
+    }
+
     u_result ans;
     std::vector<_u8> reserve(2);
     memcpy(&reserve[0], &scanModeID, sizeof(scanModeID));
@@ -1404,6 +1671,12 @@ u_result RPlidarDriverImplCommon::getMaxDistance(float &maxDistance, _u16 scanMo
 
 u_result RPlidarDriverImplCommon::getScanModeAnsType(_u8 &ansType, _u16 scanModeID, _u32 timeoutInMs)
 {
+    const RplidarScanMode * cached = _cachedScanMode(scanModeID);
+    if (cached) {
+        ansType = cached->ans_type;
+        return RESULT_OK;
+    }
+
     u_result ans;
     std::vector<_u8> reserve(2);
     memcpy(&reserve[0], &scanModeID, sizeof(scanModeID));
@@ -1425,6 +1698,12 @@ u_result RPlidarDriverImplCommon::getScanModeAnsType(_u8 &ansType, _u16 scanMode
 
 u_result RPlidarDriverImplCommon::getScanModeName(char* modeName, _u16 scanModeID, _u32 timeoutInMs)
 {
+    const RplidarScanMode * cached = _cachedScanMode(scanModeID);
+    if (cached) {
+        strcpy(modeName, cached->scan_mode);
+        return RESULT_OK;
+    }
+
     u_result ans;
     std::vector<_u8> reserve(2);
     memcpy(&reserve[0], &scanModeID, sizeof(scanModeID));
@@ -1443,6 +1722,12 @@ u_result RPlidarDriverImplCommon::getScanModeName(char* modeName, _u16 scanModeI
 
 u_result RPlidarDriverImplCommon::getAllSupportedScanModes(std::vector<RplidarScanMode>& outModes, _u32 timeoutInMs)
 {
+    _loadCapabilities();
+    if (_capabilitiesKnown) {
+        outModes.insert(outModes.end(), _capabilities.modes.begin(), _capabilities.modes.end());
+        return RESULT_OK;
+    }
+
     u_result ans;
     bool confProtocolSupported = false;
     ans = checkSupportConfigCommands(confProtocolSupported);
@@ -1521,6 +1806,11 @@ u_result RPlidarDriverImplCommon::getAllSupportedScanModes(std::vector<RplidarSc
 
 u_result RPlidarDriverImplCommon::getScanModeCount(_u16& modeCount, _u32 timeoutInMs)
 {
+    if (_capabilitiesKnown) {
+        modeCount = (_u16)_capabilities.modes.size();
+        return RESULT_OK;
+    }
+
     u_result ans;
     std::vector<_u8> answer;
     ans = getLidarConf(RPLIDAR_CONF_SCAN_MODE_COUNT, answer, std::vector<_u8>(), timeoutInMs);
@@ -1542,6 +1832,8 @@ u_result RPlidarDriverImplCommon::startScan(bool force, bool useTypicalScan, _u3
 {
     u_result ans;
 
+    _loadCapabilities();
+
     bool ifSupportLidarConf = false;
     ans = checkSupportConfigCommands(ifSupportLidarConf);
     if (IS_FAIL(ans)) return RESULT_INVALID_DATA;
@@ -1627,7 +1919,13 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
     if (!isConnected()) return RESULT_OPERATION_FAIL;
     if (_isScanning) return RESULT_ALREADY_DONE;
 
+    _hasScanRequest = true;
+    _lastScanForce = force;
+    _lastScanMode = scanMode;
+    _lastScanOptions = options;
+
     stop(); //force the previous operation to stop
+    _loadCapabilities();
 
     if (scanMode == RPLIDAR_CONF_SCAN_COMMAND_STD)
     {
@@ -1683,6 +1981,13 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
         }
     }
 
+    float sampleDuration = _cached_sampleduration_express;
+    if (outUsedScanMode) {
+        sampleDuration = outUsedScanMode->us_per_sample;
+    } else if (ifSupportLidarConf) {
+        getLidarSampleDuration(sampleDuration, scanMode);
+    }
+
     //get scan answer type to specify how to wait data
     _u8 scanAnsType;
     if (ifSupportLidarConf)
@@ -1707,60 +2012,135 @@ u_result RPlidarDriverImplCommon::startScanExpress(bool force, _u16 scanMode, _u
             return ans;
         }
 
-        // waiting for confirmation
-        rplidar_ans_header_t response_header;
-        if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+        if (IS_FAIL(ans = _waitScanHeader(scanAnsType, timeout))) {
             return ans;
         }
 
-        // verify whether we got a correct header
-        if (response_header.type != scanAnsType) {
-            return RESULT_INVALID_DATA;
-        }
+        return _startAcquisition(scanAnsType, sampleDuration);
+    }
+}
 
-        _u32 header_size = (response_header.size_q30_subtype & RPLIDAR_ANS_HEADER_SIZE_MASK);
+u_result RPlidarDriverImplCommon::_waitScanHeader(_u8 scanAnsType, _u32 timeout)
+{
+    u_result ans;
 
-        if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED)
-        {
-            if (header_size < sizeof(rplidar_response_capsule_measurement_nodes_t)) {
-                return RESULT_INVALID_DATA;
-            }
-            _cached_express_flag = 0;
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheCapsuledScanData);
+    // waiting for confirmation
+    rplidar_ans_header_t response_header;
+    if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+        return ans;
+    }
+
+    // verify whether we got a correct header
+    if (response_header.type != scanAnsType) {
+        return RESULT_INVALID_DATA;
+    }
+
+    _u32 header_size = (response_header.size_q30_subtype & RPLIDAR_ANS_HEADER_SIZE_MASK);
+
+    if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT)
+    {
+        if (header_size < sizeof(rplidar_response_measurement_node_t)) {
+            return RESULT_INVALID_DATA;
         }
-        else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED)
-        {
-            if (header_size < sizeof(rplidar_response_capsule_measurement_nodes_t)) {
-                return RESULT_INVALID_DATA;
-            }
-            _cached_express_flag = 1;
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheCapsuledScanData);
+    }
+    else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED)
+    {
+        if (header_size < sizeof(rplidar_response_capsule_measurement_nodes_t)) {
+            return RESULT_INVALID_DATA;
         }
-        else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_HQ) {
-            if (header_size < sizeof(rplidar_response_hq_capsule_measurement_nodes_t)) {
-                return RESULT_INVALID_DATA;
-            }
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheHqScanData);
+        _cached_express_flag = 0;
+    }
+    else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_DENSE_CAPSULED)
+    {
+        if (header_size < sizeof(rplidar_response_capsule_measurement_nodes_t)) {
+            return RESULT_INVALID_DATA;
         }
-        else
-        {
-            if (header_size < sizeof(rplidar_response_ultra_capsule_measurement_nodes_t)) {
-                return RESULT_INVALID_DATA;
-            }
-            _isScanning = true;
-            _cachethread = CLASS_THREAD(RPlidarDriverImplCommon, _cacheUltraCapsuledScanData);
+        _cached_express_flag = 1;
+    }
+    else if (scanAnsType == RPLIDAR_ANS_TYPE_MEASUREMENT_HQ) {
+        if (header_size < sizeof(rplidar_response_hq_capsule_measurement_nodes_t)) {
+            return RESULT_INVALID_DATA;
         }
-
-        if (_cachethread.getHandle() == 0) {
-            return RESULT_OPERATION_FAIL;
+    }
+    else
+    {
+        if (header_size < sizeof(rplidar_response_ultra_capsule_measurement_nodes_t)) {
+            return RESULT_INVALID_DATA;
         }
     }
     return RESULT_OK;
 }
 
+u_result RPlidarDriverImplCommon::switchScanMode(_u16 scanMode, _u32 options, RplidarScanMode* outUsedScanMode, _u32 timeout)
+{
+    if (!isConnected() || !_isScanning || !_hasScanRequest) return RESULT_OPERATION_FAIL;
+
+    // the configuration queries would be answered in the middle of the scan data
+    const RplidarScanMode * cachedMode = _cachedScanMode(scanMode);
+    if (!cachedMode) return RESULT_OPERATION_NOT_SUPPORT;
+    RplidarScanMode mode = *cachedMode;
+    if (outUsedScanMode) *outUsedScanMode = mode;
+    if (scanMode == _lastScanMode && options == _lastScanOptions) return RESULT_ALREADY_DONE;
+
+    // a failed switch is completed by recoverScan()
+    _lastScanMode = scanMode;
+    _lastScanOptions = options;
+    metricAdd(_metrics.scan_mode_switches, 1);
+
+    // the acquisition thread, or pumpScanData(), leaves the channel at the end of its unit
+    _isSwitching = true;
+    u_result ans;
+    {
+        rp::hal::AutoLocker acquisition(_acquisition_lock);
+        ans = _switchScan(mode, options, timeout);
+    }
+    _isSwitching = false;
+    return ans;
+}
+
+u_result RPlidarDriverImplCommon::_switchScan(const RplidarScanMode & mode, _u32 options, _u32 timeout)
+{
+    u_result ans;
+    rp::hal::AutoLocker l(_lock);
+
+    if (IS_FAIL(ans = _sendCommand(RPLIDAR_CMD_STOP))) {
+        return ans;
+    }
+    _switch_request_us = getus();
+    // the units sent before the stop are of the previous mode, and the lidar ignores a request
+    // following the STOP too closely
+    delay(STOP_SETTLE_MS);
+    _u32 drainStart = getms();
+    while (getms() - drainStart < STOP_DRAIN_MAX_MS && _chanDev->waitfordata(1, STOP_QUIET_MS)) {
+        _chanDev->flush();
+    }
+    _chanDev->flush();
+
+    if (mode.ans_type == RPLIDAR_ANS_TYPE_MEASUREMENT) {
+        ans = _sendCommand(_lastScanForce ? RPLIDAR_CMD_FORCE_SCAN : RPLIDAR_CMD_SCAN);
+    } else {
+        rplidar_payload_express_scan_t scanReq;
+        memset(&scanReq, 0, sizeof(scanReq));
+        if (mode.id != RPLIDAR_CONF_SCAN_COMMAND_STD && mode.id != RPLIDAR_CONF_SCAN_COMMAND_EXPRESS)
+            scanReq.working_mode = _u8(mode.id);
+        scanReq.working_flags = options;
+        ans = _sendCommand(RPLIDAR_CMD_EXPRESS_SCAN, &scanReq, sizeof(scanReq));
+    }
+    if (IS_FAIL(ans) || IS_FAIL(ans = _waitScanHeader(mode.ans_type, timeout))) {
+        return ans;
+    }
+
+    // the rotation is unchanged: the scan stays ready, only the partial revolution is dropped
+    _setScanAnsType(mode.ans_type, mode.us_per_sample);
+    _is_previous_capsuledataRdy = false;
+    _is_previous_HqdataRdy = false;
+    _is_first_unit_pending = true;
+    _assembling_scan.clear();
+    _cached_scan.clear();
+    _last_revolution_period_us = 0;
+    return RESULT_OK;
+}
+
 u_result RPlidarDriverImplCommon::stop(_u32 timeout)
 {
     u_result ans;
@@ -1788,17 +2168,26 @@ u_result RPlidarDriverImplCommon::grabScanData(rplidar_response_measurement_node
         return RESULT_OPERATION_TIMEOUT;
     case rp::hal::Event::EVENT_OK:
         {
-            if(_cached_scan_node_hq_count == 0) return RESULT_OPERATION_TIMEOUT; //consider as timeout
+            if(_cached_scan.empty()) return RESULT_OPERATION_TIMEOUT; //consider as timeout
 
             rp::hal::AutoLocker l(_lock);
 
-            size_t size_to_copy = min(count, _cached_scan_node_hq_count);
+            size_t size_to_copy = min(count, _cached_scan.size());
+            const _u16 * angles = _cached_scan.angles();
+            const _u32 * distances = _cached_scan.distances();
+            const _u8 * qualities = _cached_scan.qualities();
 
-            for (size_t i = 0; i < size_to_copy; i++)
-                convert(_cached_scan_node_hq_buf[i], nodebuffer[i]);
+            for (size_t i = 0; i < size_to_copy; i++) {
+                rplidar_response_measurement_node_hq_t node;
+                node.angle_z_q14 = angles[i];
+                node.dist_mm_q2 = distances[i];
+                node.quality = qualities[i];
+                node.flag = (i == 0) ? RPLIDAR_RESP_MEASUREMENT_SYNCBIT : RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT;
+                convert(node, nodebuffer[i]);
+            }
 
             count = size_to_copy;
-            _cached_scan_node_hq_count = 0;
+            _cached_scan.clear();
         }
         return RESULT_OK;
 
@@ -1810,29 +2199,83 @@ u_result RPlidarDriverImplCommon::grabScanData(rplidar_response_measurement_node
 
 u_result RPlidarDriverImplCommon::grabScanDataHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u32 timeout)
 {
-    switch (_dataEvt.wait(timeout))
-    {
-    case rp::hal::Event::EVENT_TIMEOUT:
-        count = 0;
-        return RESULT_OPERATION_TIMEOUT;
-    case rp::hal::Event::EVENT_OK:
+    _u64 timestamp_us;
+    return grabScanDataHqWithTimeStamp(nodebuffer, count, timestamp_us, timeout);
+}
+
+u_result RPlidarDriverImplCommon::_waitCachedScan(_u32 timeout)
+{
+    // on success, returns with _lock held and a revolution in _cached_scan
+    _u32 start = getms();
+    for (;;)
     {
-        if (_cached_scan_node_hq_count == 0) return RESULT_OPERATION_TIMEOUT; //consider as timeout
+        if (_stallPending) {
+            // reported once, the next calls wait for the data as usual
+            _stallPending = false;
+            return RESULT_OPERATION_TIMEOUT;
+        }
 
-        rp::hal::AutoLocker l(_lock);
+        _u32 elapsed = getms() - start;
+        TraceScope waitRevolution("grab_wait_revolution");
+        unsigned long waitResult = _dataEvt.wait(elapsed < timeout ? timeout - elapsed : 0);
+        waitRevolution.end();
 
-        size_t size_to_copy = min(count, _cached_scan_node_hq_count);
-        memcpy(nodebuffer, _cached_scan_node_hq_buf, size_to_copy * sizeof(rplidar_response_measurement_node_hq_t));
+        switch (waitResult)
+        {
+        case rp::hal::Event::EVENT_TIMEOUT:
+            return RESULT_OPERATION_TIMEOUT;
+        case rp::hal::Event::EVENT_OK:
+        {
+            TraceScope lockWait("grab_lock_wait");
+            _lock.lock();
+            lockWait.end();
+
+            if (!_cached_scan.empty()) return RESULT_OK;
 
-        count = size_to_copy;
-        _cached_scan_node_hq_count = 0;
+            // the revolution signalled was already taken by the previous call, wait for the next one
+            _lock.unlock();
+            if (getms() - start >= timeout) return RESULT_OPERATION_TIMEOUT;
+            continue;
+        }
+
+        default:
+            return RESULT_OPERATION_FAIL;
+        }
     }
-    return RESULT_OK;
+}
 
-    default:
+u_result RPlidarDriverImplCommon::grabScanDataHqWithTimeStamp(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 & timestamp_us, _u32 timeout)
+{
+    TraceScope grab("grabScanDataHq");
+    u_result ans = _waitCachedScan(timeout);
+    if (IS_FAIL(ans)) {
         count = 0;
-        return RESULT_OPERATION_FAIL;
+        return ans;
     }
+
+    _cached_scan.copyTo(nodebuffer, count);
+    timestamp_us = _cached_scan.timestamp_us;
+    _cached_scan.clear();
+    _lock.unlock();
+    return RESULT_OK;
+}
+
+u_result RPlidarDriverImplCommon::grabScan(Scan & scan, _u32 timeout)
+{
+    TraceScope grab("grabScan");
+    // scan is handed to the acquisition thread below, it must not regrow it under _lock
+    scan.reserve(Scan::ExpectedSize(_scan_sample_duration_us));
+    u_result ans = _waitCachedScan(timeout);
+    if (IS_FAIL(ans)) {
+        scan.clear();
+        return ans;
+    }
+
+    // the buffers are exchanged, the previous content of scan is reused for a next revolution
+    scan.swap(_cached_scan);
+    _cached_scan.clear();
+    _lock.unlock();
+    return RESULT_OK;
 }
 
 u_result RPlidarDriverImplCommon::getScanDataWithInterval(rplidar_response_measurement_node_t * nodebuffer, size_t & count)
@@ -1979,6 +2422,7 @@ u_result RPlidarDriverImplCommon::ascendScanData(rplidar_response_measurement_no
 
 u_result RPlidarDriverImplCommon::ascendScanData(rplidar_response_measurement_node_hq_t * nodebuffer, size_t count)
 {
+    TraceScope ascend("ascendScanData");
     return ascendScanData_<rplidar_response_measurement_node_hq_t>(nodebuffer, count);
 }
 
@@ -2123,6 +2567,140 @@ u_result RPlidarDriverImplCommon::checkMotorCtrlSupport(bool & support, _u32 tim
     return RESULT_OK;
 }
 
+u_result RPlidarDriverImplCommon::waitDeviceReady(_u32 timeout)
+{
+    if (!isConnected()) return RESULT_OPERATION_FAIL;
+
+    // a rebooting lidar drops the requests, and may send its boot banner meanwhile
+    _u32 start = getms();
+    for (;;) {
+        _u32 elapsed = getms() - start;
+        if (elapsed >= timeout) return RESULT_OPERATION_TIMEOUT;
+
+        rplidar_response_device_info_t info;
+        u_result ans = getDeviceInfo(info, min(DEVICE_POLL_TIMEOUT_MS, timeout - elapsed));
+        if (IS_OK(ans)) return RESULT_OK;
+        if (ans != RESULT_OPERATION_TIMEOUT) {
+            clearNetSerialRxCache();
+            delay(10);
+        }
+    }
+}
+
+u_result RPlidarDriverImplCommon::waitScanReady(_u32 timeout)
+{
+    if (!_isScanning) return RESULT_OPERATION_FAIL;
+
+    switch (_readyEvt.wait(timeout))
+    {
+    case rp::hal::Event::EVENT_OK:
+        return RESULT_OK;
+    case rp::hal::Event::EVENT_TIMEOUT:
+        return RESULT_OPERATION_TIMEOUT;
+    default:
+        return RESULT_OPERATION_FAIL;
+    }
+}
+
+u_result RPlidarDriverImplCommon::recoverScan(int & outLevel, _u32 timeout)
+{
+    if (_isExternalAcquisition) return RESULT_OPERATION_NOT_SUPPORT;
+    if (!isConnected() || !_hasScanRequest) return RESULT_OPERATION_FAIL;
+
+    int level = SCAN_RECOVERY_RESYNC;
+    if (_lastRecoveryLevel >= 0 && getms() - _lastRecoveryMs < RECOVERY_HOLDOFF_MS) {
+        level = min(_lastRecoveryLevel + 1, (int)SCAN_RECOVERY_RESET);
+    }
+
+    for (; level < SCAN_RECOVERY_LEVELS; level++) {
+        metricAdd(_metrics.recovery_attempts[level], 1);
+        _u64 start = getus();
+        u_result ans = _recoverScanAt(level, timeout);
+        metricAdd(_metrics.recovery_duration_us[level], getus() - start);
+        if (IS_OK(ans)) {
+            metricAdd(_metrics.recovery_successes[level], 1);
+            _lastRecoveryLevel = level;
+            _lastRecoveryMs = getms();
+            outLevel = level;
+            return RESULT_OK;
+        }
+    }
+
+    metricAdd(_metrics.recovery_failures, 1);
+    _lastRecoveryLevel = -1;
+    return RESULT_OPERATION_FAIL;
+}
+
+u_result RPlidarDriverImplCommon::_recoverScanAt(int level, _u32 timeout)
+{
+    u_result ans;
+
+    switch (level)
+    {
+    case SCAN_RECOVERY_RESYNC:
+        {
+            // the acquisition ended on a channel error
+            if (!_isScanning) return RESULT_OPERATION_FAIL;
+
+            // the acquisition thread may be blocked in a wait longer than RESYNC_TIMEOUT_MS: the wait
+            // is cut short, and the decoding is reset here once the thread left the channel
+            _u32 start = getms();
+            _isResyncing = true;
+            _chanDev->cancelWait();
+            {
+                rp::hal::AutoLocker acquisition(_acquisition_lock);
+                _resetDecoding();
+                _isStalled = false;
+                _stallPending = false;
+                _dataEvt.set(false);
+            }
+            _isResyncing = false;
+
+            // resynchronized once a revolution is received again
+            _u32 elapsed;
+            while ((elapsed = getms() - start) < RESYNC_TIMEOUT_MS) {
+                if (_dataEvt.wait(RESYNC_TIMEOUT_MS - elapsed) != rp::hal::Event::EVENT_OK) break;
+                if (!_stallPending) {
+                    // left for grabScanDataHq()
+                    _dataEvt.set();
+                    return RESULT_OK;
+                }
+                // the watchdog fired while the data is still missing, reported by this call already
+                _stallPending = false;
+            }
+            return RESULT_OPERATION_TIMEOUT;
+        }
+
+    case SCAN_RECOVERY_RESET:
+        stop();
+        if (IS_FAIL(ans = reset())) return ans;
+        if (IS_FAIL(ans = waitDeviceReady(timeout))) return ans;
+        if (_isSupportingMotorCtrl && _motorPWM) {
+            if (IS_FAIL(ans = setMotorPWM(_motorPWM))) return ans;
+        }
+        // fall through, the scan command is sent again
+    case SCAN_RECOVERY_RESTART:
+        stop();
+        if (IS_FAIL(ans = startScanExpress(_lastScanForce, _lastScanMode, _lastScanOptions))) return ans;
+        return waitScanReady(timeout);
+
+    default:
+        return RESULT_INVALID_DATA;
+    }
+}
+
+void RPlidarDriverImplCommon::_resetDecoding()
+{
+    // the bytes buffered may predate the failure
+    _chanDev->flush();
+    _is_previous_capsuledataRdy = false;
+    _is_previous_HqdataRdy = false;
+    _is_first_unit_pending = true;
+
+    rp::hal::AutoLocker l(_lock);
+    _assembling_scan.clear();
+}
+
 u_result RPlidarDriverImplCommon::setMotorPWM(_u16 pwm)
 {
     u_result ans;
@@ -2135,6 +2713,7 @@ u_result RPlidarDriverImplCommon::setMotorPWM(_u16 pwm)
         if (IS_FAIL(ans = _sendCommand(RPLIDAR_CMD_SET_MOTOR_PWM,(const _u8 *)&motor_pwm, sizeof(motor_pwm)))) {
             return ans;
         }
+        _motorPWM = pwm;
     }
 
     return RESULT_OK;
@@ -2143,13 +2722,10 @@ u_result RPlidarDriverImplCommon::setMotorPWM(_u16 pwm)
 u_result RPlidarDriverImplCommon::startMotor()
 {
     if (_isSupportingMotorCtrl) { // RPLIDAR A2
-        setMotorPWM(DEFAULT_MOTOR_PWM);
-        delay(500);
-        return RESULT_OK;
+        return setMotorPWM(DEFAULT_MOTOR_PWM);
     } else { // RPLIDAR A1
         rp::hal::AutoLocker l(_lock);
         _chanDev->clearDTR();
-        delay(500);
         return RESULT_OK;
     }
 }
@@ -2157,13 +2733,10 @@ u_result RPlidarDriverImplCommon::startMotor()
 u_result RPlidarDriverImplCommon::stopMotor()
 {
     if (_isSupportingMotorCtrl) { // RPLIDAR A2
-        setMotorPWM(0);
-        delay(500);
-        return RESULT_OK;
+        return setMotorPWM(0);
     } else { // RPLIDAR A1
         rp::hal::AutoLocker l(_lock);
         _chanDev->setDTR();
-        delay(500);
         return RESULT_OK;
     }
 }
@@ -2172,6 +2745,10 @@ void RPlidarDriverImplCommon::_disableDataGrabbing()
 {
     _isScanning = false;
     _cachethread.join();
+    _cachethread = rp::hal::Thread();
+
+    // wait for a pending pumpScanData() to leave the channel
+    rp::hal::AutoLocker l(_acquisition_lock);
 }
 
 // Serial Driver Impl
@@ -2181,6 +2758,11 @@ RPlidarDriverSerial::RPlidarDriverSerial()
     _chanDev = new SerialChannelDevice();
 }
 
+RPlidarDriverSerial::RPlidarDriverSerial(rp::hal::serial_rxtx * rxtx)
+{
+    _chanDev = new SerialChannelDevice(rxtx);
+}
+
 RPlidarDriverSerial::~RPlidarDriverSerial()
 {
     // force disconnection
@@ -2213,6 +2795,7 @@ u_result RPlidarDriverSerial::connect(const char * port_path, _u32 baudrate, _u3
     }
 
     _isConnected = true;
+    _forgetDevice();
 
     checkMotorCtrlSupport(_isSupportingMotorCtrl);
     stopMotor();
@@ -2229,6 +2812,9 @@ RPlidarDriverTCP::~RPlidarDriverTCP()
 {
     // force disconnection
     disconnect();
+
+    delete _chanDev;
+    _chanDev = NULL;
 }
 
 void RPlidarDriverTCP::disconnect()
@@ -2253,6 +2839,7 @@ u_result RPlidarDriverTCP::connect(const char * ipStr, _u32 port, _u32 flag)
     }
 
     _isConnected = true;
+    _forgetDevice();
 
     checkMotorCtrlSupport(_isSupportingMotorCtrl);
     stopMotor();
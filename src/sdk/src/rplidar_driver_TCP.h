@@ -39,37 +39,213 @@ namespace rp { namespace standalone{ namespace rplidar {
 class TCPChannelDevice :public ChannelDevice
 {
 public:
+    enum {
+        RX_BUFFER_SIZE     = 8192,
+        CONNECT_TIMEOUT    = 2000, //ms
+        RECONNECT_INTERVAL = 1000, //ms
+    };
+
     rp::net::StreamSocket * _binded_socket;
-    TCPChannelDevice():_binded_socket(rp::net::StreamSocket::CreateSocket()){}
+
+    TCPChannelDevice()
+        : _binded_socket(NULL)
+        , _port(0)
+        , _rxPos(0)
+        , _rxLen(0)
+        , _lastConnectTs(0)
+        , _connecting(false)
+        , _closePending(false)
+        , _reconnected(false)
+    {
+        _address[0] = 0;
+    }
+
+    ~TCPChannelDevice()
+    {
+        _dropSocket();
+    }
 
     bool bind(const char * ipStr, uint32_t port)
     {
-        rp::net::SocketAddress socket(ipStr, port);
-        return IS_OK(_binded_socket->connect(socket));
+        strncpy(_address, ipStr, sizeof(_address) - 1);
+        _address[sizeof(_address) - 1] = 0;
+        _port = port;
+        _closePending = false;
+        _reconnected = false;
+        return _connect(CONNECT_TIMEOUT);
     }
     void close()
     {
-        _binded_socket->dispose();
-        _binded_socket = NULL;
+        _closePending = true;
+        _dropSocket();
+    }
+    void flush()
+    {
+        _rxPos = _rxLen = 0;
     }
     bool waitfordata(size_t data_count,_u32 timeout = -1, size_t * returned_size = NULL)
     {
-        if(returned_size)
-            *returned_size = data_count;
-        return (_binded_socket->waitforData(timeout) == RESULT_OK);
+        _u32 startTs = getms();
+        if (data_count > RX_BUFFER_SIZE) data_count = RX_BUFFER_SIZE;
+
+        while (_rxLen < data_count) {
+            _u32 waitTime = getms() - startTs;
+            if (waitTime > timeout) break;
+
+            if (!_binded_socket) {
+                // the link went down, retry at most once per RECONNECT_INTERVAL
+                if (_closePending || !_reconnect()) break;
+                if (!_connecting) break;
+            }
+            if (_connecting) {
+                // the connection is started once and completed by the next calls, the caller
+                // never waits longer than its own timeout for the peer
+                if (IS_FAIL(_finishConnect(timeout - waitTime))) break;
+                // nothing arrives before the scan request is sent again, see takeReconnected()
+                _reconnected = true;
+                break;
+            }
+
+            if (_binded_socket->waitforData(timeout - waitTime) != RESULT_OK) break;
+            if (!_readahead()) break;
+        }
+
+        if (returned_size) *returned_size = _rxLen;
+        return _rxLen >= data_count;
     }
     int senddata(const _u8 * data, size_t size)
     {
-        return _binded_socket->send(data, size) ;
+        if (!_binded_socket || _connecting) return 0;
+        if (IS_FAIL(_binded_socket->send(data, size))) {
+            _dropSocket();
+            return 0;
+        }
+        return (int)size;
     }
     int recvdata(unsigned char * data, size_t size)
     {
-        size_t lenRec = 0;
-        _binded_socket->recv(data, size, lenRec);
-        return lenRec;
+        size_t lenRec = (size < _rxLen) ? size : _rxLen;
+        memcpy(data, _rxBuffer + _rxPos, lenRec);
+        _rxPos += lenRec;
+        _rxLen -= lenRec;
+        if (!_rxLen) _rxPos = 0;
+        return (int)lenRec;
+    }
+    int getNativeHandle()
+    {
+        // bytes already buffered are served by waitfordata() without waiting; a connection in
+        // progress is completed by waitfordata() as well, the socket is not readable meanwhile
+        return (_binded_socket && !_connecting) ? _binded_socket->getNativeHandle() : -1;
+    }
+    bool takeReconnected()
+    {
+        bool reconnected = _reconnected;
+        _reconnected = false;
+        return reconnected;
+    }
+
+protected:
+    bool _connect(_u32 timeout)
+    {
+        if (!_startConnect()) return false;
+        if (!_connecting) return true;
+        if (IS_OK(_finishConnect(timeout))) return true;
+        _dropSocket();
+        return false;
     }
-};
 
+    // a non-blocking connect(), _connecting until _finishConnect() sees it established
+    bool _startConnect()
+    {
+        _dropSocket();
+        _lastConnectTs = getms();
+
+        rp::net::SocketAddress socket(_address, _port);
+        _binded_socket = rp::net::StreamSocket::CreateSocket();
+        if (!_binded_socket) return false;
+
+        if (IS_FAIL(_binded_socket->enableNonBlocking(true))) {
+            _dropSocket();
+            return false;
+        }
+        u_result ans = _binded_socket->connect(socket);
+        if (ans == RESULT_OPERATION_TIMEOUT) {
+            _connecting = true;
+            return true;
+        }
+        if (IS_FAIL(ans)) {
+            _dropSocket();
+            return false;
+        }
+        return IS_OK(_finishConnect(0));
+    }
+
+    u_result _finishConnect(_u32 timeout)
+    {
+        u_result ans = _binded_socket->checkConnected(timeout);
+        if (ans == RESULT_OPERATION_TIMEOUT && getms() - _lastConnectTs < CONNECT_TIMEOUT) return ans;
+        if (IS_FAIL(ans)) {
+            // refused, or no answer within CONNECT_TIMEOUT
+            _dropSocket();
+            return RESULT_OPERATION_FAIL;
+        }
+        _connecting = false;
+        _binded_socket->enableNonBlocking(false);
+        _binded_socket->enableNoDelay(true);
+        _binded_socket->enableKeepAlive(true);
+        return RESULT_OK;
+    }
+
+    bool _reconnect()
+    {
+        // do not hammer an unreachable peer from the acquisition loop
+        if (getms() - _lastConnectTs < RECONNECT_INTERVAL) return false;
+        if (!_startConnect()) return false;
+        if (!_connecting) _reconnected = true;
+        return true;
+    }
+
+    void _dropSocket()
+    {
+        if (_binded_socket) _binded_socket->dispose();
+        _binded_socket = NULL;
+        _connecting = false;
+        _rxPos = _rxLen = 0;
+    }
+
+    // pull everything the socket holds in one recv, the parsers are served from memory
+    bool _readahead()
+    {
+        if (!_binded_socket) return false;
+
+        if (_rxPos && _rxPos + _rxLen == RX_BUFFER_SIZE) {
+            memmove(_rxBuffer, _rxBuffer + _rxPos, _rxLen);
+            _rxPos = 0;
+        }
+        size_t freeSize = RX_BUFFER_SIZE - _rxPos - _rxLen;
+        if (!freeSize) return true;
+
+        size_t recvSize = 0;
+        u_result ans = _binded_socket->recv(_rxBuffer + _rxPos + _rxLen, freeSize, recvSize);
+        if (IS_FAIL(ans) || !recvSize) {
+            // timeout is not expected after waitforData, treat it as a broken link as well
+            _dropSocket();
+            return false;
+        }
+        _rxLen += recvSize;
+        return true;
+    }
+
+    char    _address[200];
+    _u32    _port;
+    _u8     _rxBuffer[RX_BUFFER_SIZE];
+    size_t  _rxPos;
+    size_t  _rxLen;
+    _u32    _lastConnectTs;
+    bool    _connecting;
+    bool    _closePending;
+    bool    _reconnected;
+};
 
 class RPlidarDriverTCP : public RPlidarDriverImplCommon
 {
@@ -55,6 +55,7 @@ public:
 
     virtual u_result startScan(bool force, bool useTypicalScan, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL);
     virtual u_result startScanExpress(bool force, _u16 scanMode, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result switchScanMode(_u16 scanMode, _u32 options = 0, RplidarScanMode* outUsedScanMode = NULL, _u32 timeout = DEFAULT_TIMEOUT);
 
 
     virtual u_result getHealth(rplidar_response_device_health_t & health, _u32 timeout = DEFAULT_TIMEOUT);
@@ -64,6 +65,9 @@ public:
     virtual u_result startMotor();
     virtual u_result stopMotor();
     virtual u_result checkMotorCtrlSupport(bool & support, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result waitDeviceReady(_u32 timeout = DEFAULT_READY_TIMEOUT);
+    virtual u_result waitScanReady(_u32 timeout = DEFAULT_READY_TIMEOUT);
+    virtual u_result recoverScan(int & outLevel, _u32 timeout = DEFAULT_READY_TIMEOUT);
     virtual u_result getFrequency(bool inExpressMode, size_t count, float & frequency, bool & is4kmode);
     virtual u_result getFrequency(const RplidarScanMode& scanMode, size_t count, float & frequency);
     virtual u_result startScanNormal(bool force, _u32 timeout = DEFAULT_TIMEOUT);
@@ -75,6 +79,16 @@ public:
     virtual u_result ascendScanData(rplidar_response_measurement_node_hq_t * nodebuffer, size_t count);
     virtual u_result getScanDataWithInterval(rplidar_response_measurement_node_t * nodebuffer, size_t & count);
     virtual u_result getScanDataWithIntervalHq(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count);
+    virtual u_result grabScanDataHqWithTimeStamp(rplidar_response_measurement_node_hq_t * nodebuffer, size_t & count, _u64 & timestamp_us, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual u_result grabScan(Scan & scan, _u32 timeout = DEFAULT_TIMEOUT);
+
+    virtual u_result setExternalAcquisition(bool enable);
+    virtual u_result pumpScanData(_u32 timeout = 0);
+    virtual int getNativeHandle();
+    virtual void setScanFilter(ScanFilter * filter);
+    virtual const RplidarDriverMetrics & getMetrics();
+    virtual void setSpeedController(MotorSpeedController * controller);
+    virtual void setCapabilityCache(LidarCapabilityCache * cache);
 
 protected:
 
@@ -83,28 +97,81 @@ protected:
 
     virtual u_result _waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result _cacheScanData();
+    u_result         _startAcquisition(_u8 scanAnsType, float sampleDuration);
+    void             _setScanAnsType(_u8 scanAnsType, float sampleDuration);
+    u_result         _waitScanHeader(_u8 scanAnsType, _u32 timeout);
+    u_result         _switchScan(const RplidarScanMode & mode, _u32 options, _u32 timeout);
+    u_result         _acquireScanData(_u32 timeout);
+    void             _publishNodes(const rplidar_response_measurement_node_hq_t * nodes, size_t count);
+    u_result         _waitCachedScan(_u32 timeout);
+    void             _resumeAfterReconnect();
+    u_result         _countFailure(u_result ans);
+    void             _countRevolution(_u64 period_us, size_t count);
+    void             _forgetDevice();
+    void             _resetDecoding();
+    u_result         _recoverScanAt(int level, _u32 timeout);
+    void             _loadCapabilities();
+    const RplidarScanMode * _cachedScanMode(_u16 scanModeID);
     virtual u_result _waitScanData(rplidar_response_measurement_node_t * nodebuffer, size_t & count, _u32 timeout = DEFAULT_TIMEOUT);
     virtual u_result _waitNode(rplidar_response_measurement_node_t * node, _u32 timeout = DEFAULT_TIMEOUT);
-    virtual u_result  _cacheCapsuledScanData();
     virtual u_result _waitCapsuledNode(rplidar_response_capsule_measurement_nodes_t & node, _u32 timeout = DEFAULT_TIMEOUT);
     virtual void     _capsuleToNormal(const rplidar_response_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
     virtual void     _dense_capsuleToNormal(const rplidar_response_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
     
     //FW1.23
-    virtual u_result  _cacheUltraCapsuledScanData();
     virtual u_result _waitUltraCapsuledNode(rplidar_response_ultra_capsule_measurement_nodes_t & node, _u32 timeout = DEFAULT_TIMEOUT);
     virtual void     _ultraCapsuleToNormal(const rplidar_response_ultra_capsule_measurement_nodes_t & capsule, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
 
-    virtual u_result  _cacheHqScanData();
     virtual u_result _waitHqNode(rplidar_response_hq_capsule_measurement_nodes_t & node, _u32 timeout = DEFAULT_TIMEOUT);
     virtual void     _HqToNormal(const rplidar_response_hq_capsule_measurement_nodes_t & node_hq, rplidar_response_measurement_node_hq_t *nodebuffer, size_t &nodeCount);
 
     bool     _isConnected; 
     bool     _isScanning;
     bool     _isSupportingMotorCtrl;
-
-    rplidar_response_measurement_node_hq_t   _cached_scan_node_hq_buf[8192];
-    size_t                                   _cached_scan_node_hq_count;
+    bool     _isExternalAcquisition;
+    ScanFilter * _scanFilter;
+    MotorSpeedController * _speedController;
+    RplidarDriverMetrics _metrics;
+    _u64     _last_revolution_period_us;
+    size_t   _last_revolution_node_count;
+    _u64     _scan_request_us;
+    _u32     _stable_revolutions;
+    bool     _is_scan_ready;
+
+    // last scan requested and motor PWM, restored by recoverScan()
+    bool     _hasScanRequest;
+    bool     _lastScanForce;
+    _u16     _lastScanMode;
+    _u32     _lastScanOptions;
+    _u16     _motorPWM;
+    volatile bool _isResyncing;      // recoverScan() resets the decoding, the acquisition thread waits meanwhile
+    int      _lastRecoveryLevel;     // -1 when none
+    _u32     _lastRecoveryMs;
+
+    // watchdog of the acquisition thread, 0 when the sample duration is unknown
+    _u32     _stallTimeoutMs;
+    volatile bool _isStalled;
+    volatile bool _stallPending;
+    float    _scan_sample_duration_us;
+
+    // set by switchScanMode() while it talks to the lidar, the acquisition thread waits meanwhile
+    volatile bool _isSwitching;
+    _u64     _switch_request_us;     // 0 once the first revolution in the new mode is published
+
+    // identity and capabilities of the connected lidar, see setCapabilityCache()
+    LidarCapabilityCache * _capabilityCache;
+    rplidar_response_device_info_t _deviceInfo;
+    bool     _deviceInfoKnown;
+    LidarCapabilities _capabilities;
+    bool     _capabilitiesKnown;
+    bool     _capabilitiesLoading;
+
+    // last complete revolution, empty once grabbed, and the one being assembled by the acquisition loop,
+    // which starts at a sync node; both are sized from the scan mode and exchanged at each revolution
+    Scan                                     _cached_scan;
+    Scan                                     _assembling_scan;
+    _u8                                      _cached_scan_ans_type;
+    bool                                     _is_first_unit_pending;
 
     rplidar_response_measurement_node_hq_t   _cached_scan_node_hq_buf_for_interval_retrieve[8192];
     size_t                                   _cached_scan_node_hq_count_for_interval_retrieve;
@@ -123,7 +190,10 @@ protected:
 	
 
     rp::hal::Locker         _lock;
+    rp::hal::Locker         _acquisition_lock;
+    rp::hal::Locker         _filter_lock;           // _scanFilter, held for a whole filter pass
     rp::hal::Event          _dataEvt;
+    rp::hal::Event          _readyEvt;
     rp::hal::Thread _cachethread;
 
 protected:
@@ -43,6 +43,7 @@ public:
     bool _closePending;
 
     SerialChannelDevice():_rxtxSerial(rp::hal::serial_rxtx::CreateRxTx()){}
+    SerialChannelDevice(rp::hal::serial_rxtx * rxtx):_rxtxSerial(rxtx){}
 
     bool bind(const char * portname, uint32_t baudrate)
     {
@@ -63,6 +64,14 @@ public:
     {
         _rxtxSerial->flush(0);
     }
+    void cancelWait()
+    {
+        _rxtxSerial->cancelOperation();
+    }
+    bool takeWaitCancelled()
+    {
+        return _rxtxSerial->takeCancelled();
+    }
     bool waitfordata(size_t data_count,_u32 timeout = -1, size_t * returned_size = NULL)
     {
         if (_closePending) return false;
@@ -90,6 +99,10 @@ public:
     {
         rp::hal::serial_rxtx::ReleaseRxTx(_rxtxSerial);
     }
+    int getNativeHandle()
+    {
+        return _rxtxSerial->getNativeHandle();
+    }
 };
 
 class RPlidarDriverSerial : public RPlidarDriverImplCommon
@@ -97,6 +110,7 @@ class RPlidarDriverSerial : public RPlidarDriverImplCommon
 public:
 
     RPlidarDriverSerial();
+    RPlidarDriverSerial(rp::hal::serial_rxtx * rxtx);
     virtual ~RPlidarDriverSerial();
     virtual u_result connect(const char * port_path,  _u32 baudrate, _u32 flag = 0);
     virtual void disconnect();
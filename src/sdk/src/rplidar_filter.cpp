@@ -0,0 +1,250 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include <math.h>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// consecutive nodes further apart than this are not neighbours, e.g. around a gap of invalid nodes
+static const float SHADOW_MAX_NEIGHBOUR_ANGLE = 2.0f * 3.14159265f / 180;
+
+ScanFilter::ScanFilter()
+    : _historyDepth(0)
+{
+    setConfig(DefaultConfig());
+}
+
+ScanFilterConfig ScanFilter::DefaultConfig()
+{
+    ScanFilterConfig config;
+    config.bin_count = 1440;
+    config.median_depth = 5;
+    config.isolation_mm = 150;
+    config.shadow_min_angle_deg = 8.0f;
+    return config;
+}
+
+void ScanFilter::setConfig(const ScanFilterConfig & config)
+{
+    _config = config;
+    if (_config.bin_count < 1) _config.bin_count = 1;
+    if (_config.bin_count > 65536) _config.bin_count = 65536;
+    if (_config.median_depth > MAX_MEDIAN_DEPTH) _config.median_depth = MAX_MEDIAN_DEPTH;
+
+    // the current revolution completes the window
+    _historyDepth = (_config.median_depth < 2) ? 0 : _config.median_depth - 1;
+
+    _history.assign(_config.bin_count * _historyDepth, 0);
+    _sorted.assign(_config.bin_count * _historyDepth, 0);
+    _head.assign(_config.bin_count, 0);
+    _filled.assign(_config.bin_count, 0);
+    _pending.assign(_config.bin_count, 0);
+    _touched.clear();
+    _touched.reserve(_config.bin_count);
+
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void ScanFilter::getConfig(ScanFilterConfig & config)
+{
+    config = _config;
+}
+
+void ScanFilter::reset()
+{
+    setConfig(_config);
+}
+
+void ScanFilter::getStats(ScanFilterStats & stats)
+{
+    stats = _stats;
+}
+
+void ScanFilter::process(Scan & scan)
+{
+    _u64 startTs = getus();
+    if (_historyDepth) _medianStage(scan);
+    _u64 medianTs = getus();
+    if (_config.isolation_mm || _config.shadow_min_angle_deg > 0) _outlierStage(scan);
+    _u64 endTs = getus();
+
+    ++_stats.revolutions;
+    _stats.last_median_us = (_u32)(medianTs - startTs);
+    _stats.last_outlier_us = (_u32)(endTs - medianTs);
+    _stats.total_median_us += _stats.last_median_us;
+    _stats.total_outlier_us += _stats.last_outlier_us;
+}
+
+void ScanFilter::process(rplidar_response_measurement_node_hq_t * nodes, size_t count)
+{
+    _nodesScan.assign(nodes, count);
+    process(_nodesScan);
+
+    const _u32 * dist = _nodesScan.distances();
+    for (size_t pos = 0; pos < _nodesScan.size(); ++pos) {
+        if (dist[pos] == nodes[pos].dist_mm_q2) continue;
+        nodes[pos].dist_mm_q2 = dist[pos];
+        if (!dist[pos]) nodes[pos].quality = 0;
+    }
+}
+
+void ScanFilter::_medianStage(Scan & scan)
+{
+    const _u16 * angles = scan.angles();
+    _u32 * distances = scan.distances();
+    size_t count = scan.size();
+
+    for (size_t pos = 0; pos < count; ++pos) {
+        _u32 dist = distances[pos];
+        if (!dist) continue;
+
+        size_t bin = ((size_t)angles[pos] * _config.bin_count) >> 16;
+        const _u32 * sorted = &_sorted[bin * _historyDepth];
+        size_t filled = _filled[bin];
+
+        if (filled) {
+            // median of the history plus the current sample, read without merging them
+            size_t rank = 0;
+            while (rank < filled && sorted[rank] < dist) ++rank;
+
+            size_t mid = (filled + 1) / 2;
+            if (mid < rank) {
+                distances[pos] = sorted[mid];
+            } else if (mid > rank) {
+                distances[pos] = sorted[mid - 1];
+            }
+        }
+
+        // the raw sample enters the history, once per bin and revolution
+        if (!_pending[bin]) _touched.push_back((_u32)bin);
+        _pending[bin] = dist;
+    }
+
+    for (size_t pos = 0; pos < _touched.size(); ++pos) {
+        size_t bin = _touched[pos];
+        _pushHistory(bin, _pending[bin]);
+        _pending[bin] = 0;
+    }
+    _touched.clear();
+}
+
+void ScanFilter::_pushHistory(size_t bin, _u32 dist)
+{
+    _u32 * ring = &_history[bin * _historyDepth];
+    _u32 * sorted = &_sorted[bin * _historyDepth];
+    size_t filled = _filled[bin];
+
+    if (filled == _historyDepth) {
+        // the oldest sample leaves the sorted window
+        _u32 oldest = ring[_head[bin]];
+        size_t pos = 0;
+        while (sorted[pos] != oldest) ++pos;
+        memmove(sorted + pos, sorted + pos + 1, (filled - pos - 1) * sizeof(_u32));
+        --filled;
+    }
+
+    ring[_head[bin]] = dist;
+    _head[bin] = (_u8)((_head[bin] + 1) % _historyDepth);
+
+    size_t pos = filled;
+    while (pos > 0 && sorted[pos - 1] > dist) {
+        sorted[pos] = sorted[pos - 1];
+        --pos;
+    }
+    sorted[pos] = dist;
+    _filled[bin] = (_u8)(filled + 1);
+}
+
+void ScanFilter::_outlierStage(Scan & scan)
+{
+    const size_t none = (size_t)-1;
+    const _u32 isolation = _config.isolation_mm << 2;   // compared with dist_mm_q2
+    const float tanMinAngle = (_config.shadow_min_angle_deg > 0) ? tanf(_config.shadow_min_angle_deg * 3.14159265f / 180) : 0;
+    const _u16 * angles = scan.angles();
+    _u32 * distances = scan.distances();
+    _u8 * qualities = scan.qualities();
+    size_t count = scan.size();
+
+    // decisions are taken on the unfiltered neighbours, the nodes are cleared afterwards
+    _touched.clear();
+
+    size_t prev = none;
+    size_t cur = none;
+    for (size_t pos = 0; pos <= count; ++pos) {
+        if (pos < count && !distances[pos]) continue;
+        size_t next = (pos < count) ? pos : none;
+
+        if (cur != none) {
+            _u32 dist = distances[cur];
+
+            if (isolation && prev != none && next != none) {
+                _u32 prevDist = distances[prev];
+                _u32 nextDist = distances[next];
+                _u32 prevJump = (dist > prevDist) ? dist - prevDist : prevDist - dist;
+                _u32 nextJump = (dist > nextDist) ? dist - nextDist : nextDist - dist;
+                if (prevJump > isolation && nextJump > isolation) {
+                    _touched.push_back((_u32)cur);
+                    ++_stats.isolated_rejected;
+                }
+            }
+
+            if (tanMinAngle > 0 && next != none) {
+                _u32 nextDist = distances[next];
+                float gap = (_u16)(angles[next] - angles[cur]) * (3.14159265f / 2) / 16384;
+
+                if (gap <= SHADOW_MAX_NEIGHBOUR_ANGLE) {
+                    // incidence angle at the near point: tan(a) ~= near * gap / (far - near)
+                    float nearDist = (float)((dist < nextDist) ? dist : nextDist);
+                    float farDist = (float)((dist < nextDist) ? nextDist : dist);
+                    if ((farDist - nearDist) * tanMinAngle > nearDist * gap) {
+                        _touched.push_back((_u32)((dist < nextDist) ? next : cur));
+                        ++_stats.shadow_rejected;
+                    }
+                }
+            }
+        }
+        prev = cur;
+        cur = next;
+    }
+
+    for (size_t pos = 0; pos < _touched.size(); ++pos) {
+        distances[_touched[pos]] = 0;
+        qualities[_touched[pos]] = 0;
+    }
+    _touched.clear();
+}
+
+}}}
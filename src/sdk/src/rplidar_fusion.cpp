@@ -0,0 +1,161 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include <algorithm>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+static const float PI_F = 3.14159265358979f;
+
+ScanFusion::ScanFusion()
+    : _maxSkew(DEFAULT_MAX_SKEW)
+{
+    for (size_t pos = 0; pos < _countof(_sensors); ++pos) {
+        _sensors[pos].extrinsics.x_mm = 0;
+        _sensors[pos].extrinsics.y_mm = 0;
+        _sensors[pos].extrinsics.yaw_rad = 0;
+        _sensors[pos].timestamp_us = 0;
+        _sensors[pos].isValid = false;
+    }
+}
+
+void ScanFusion::setExtrinsics(int sensor_id, const LidarExtrinsics & extrinsics)
+{
+    if (sensor_id < 0 || sensor_id >= MAX_SENSORS) return;
+    _sensors[sensor_id].extrinsics = extrinsics;
+}
+
+void ScanFusion::setMaxSkew(_u32 skew_us)
+{
+    _maxSkew = skew_us;
+}
+
+u_result ScanFusion::update(const LidarScan & scan)
+{
+    if (scan.sensor_id < 0 || scan.sensor_id >= MAX_SENSORS) return RESULT_INVALID_DATA;
+
+    SensorState & sensor = _sensors[scan.sensor_id];
+    const float cosYaw = cosf(sensor.extrinsics.yaw_rad);
+    const float sinYaw = sinf(sensor.extrinsics.yaw_rad);
+
+    _cartesian.resize(scan.count);
+    if (scan.count) ConvertToCartesian(&scan.nodes[0], scan.count, &_cartesian[0]);
+
+    sensor.points.clear();
+    sensor.points.reserve(scan.count);
+    for (size_t pos = 0; pos < scan.count; ++pos) {
+        const rplidar_response_measurement_node_hq_t & node = scan.nodes[pos];
+        if (!node.dist_mm_q2) continue;
+
+        float xs = _cartesian[pos].x_mm;
+        float ys = _cartesian[pos].y_mm;
+
+        FusedPoint point;
+        point.x_mm = sensor.extrinsics.x_mm + cosYaw * xs - sinYaw * ys;
+        point.y_mm = sensor.extrinsics.y_mm + sinYaw * xs + cosYaw * ys;
+        point.quality = node.quality;
+        point.sensor_id = (_u8)scan.sensor_id;
+        sensor.points.push_back(point);
+    }
+    sensor.timestamp_us = scan.timestamp_us;
+    sensor.isValid = true;
+    return RESULT_OK;
+}
+
+size_t ScanFusion::_selectSensors(int * sensors, _u64 & timestamp_us)
+{
+    timestamp_us = 0;
+    for (int id = 0; id < MAX_SENSORS; ++id) {
+        if (_sensors[id].isValid && _sensors[id].timestamp_us > timestamp_us) {
+            timestamp_us = _sensors[id].timestamp_us;
+        }
+    }
+
+    size_t count = 0;
+    for (int id = 0; id < MAX_SENSORS; ++id) {
+        if (_sensors[id].isValid && timestamp_us - _sensors[id].timestamp_us <= _maxSkew) {
+            sensors[count++] = id;
+        }
+    }
+    return count;
+}
+
+size_t ScanFusion::getPoints(FusedPoint * points, size_t maxCount, _u64 & timestamp_us)
+{
+    int sensors[MAX_SENSORS];
+    size_t sensorCount = _selectSensors(sensors, timestamp_us);
+
+    size_t count = 0;
+    for (size_t pos = 0; pos < sensorCount; ++pos) {
+        const std::vector<FusedPoint> & sensorPoints = _sensors[sensors[pos]].points;
+        size_t size_to_copy = std::min(sensorPoints.size(), maxCount - count);
+        if (size_to_copy) memcpy(points + count, &sensorPoints[0], size_to_copy * sizeof(FusedPoint));
+        count += size_to_copy;
+    }
+    return count;
+}
+
+size_t ScanFusion::getPolarRanges(float * ranges_mm, size_t binCount, _u64 & timestamp_us)
+{
+    int sensors[MAX_SENSORS];
+    size_t sensorCount = _selectSensors(sensors, timestamp_us);
+    size_t filled = 0;
+
+    memset(ranges_mm, 0, binCount * sizeof(float));
+    for (size_t pos = 0; pos < sensorCount; ++pos) {
+        const std::vector<FusedPoint> & sensorPoints = _sensors[sensors[pos]].points;
+        for (size_t pt = 0; pt < sensorPoints.size(); ++pt) {
+            const FusedPoint & point = sensorPoints[pt];
+
+            // clockwise, like the lidar nodes
+            float angle = -atan2f(point.y_mm, point.x_mm);
+            if (angle < 0) angle += 2 * PI_F;
+            size_t bin = (size_t)(angle * binCount / (2 * PI_F));
+            if (bin >= binCount) bin = 0;
+
+            float range = sqrtf(point.x_mm * point.x_mm + point.y_mm * point.y_mm);
+            if (ranges_mm[bin] == 0) {
+                ++filled;
+                ranges_mm[bin] = range;
+            } else if (range < ranges_mm[bin]) {
+                ranges_mm[bin] = range;
+            }
+        }
+    }
+    return filled;
+}
+
+}}}
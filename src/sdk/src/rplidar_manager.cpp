@@ -0,0 +1,285 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/thread.h"
+#include "hal/locker.h"
+#include "hal/event.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+class LidarManagerImpl : public LidarManager
+{
+public:
+    enum {
+        POLL_TIMEOUT = 100, // ms, wait of a thread whose lidars send nothing, or are not scanning
+        RETRY_DELAY  = 1,   // ms, wait for the rest of a unit, or for a lidar without descriptor
+    };
+
+    typedef std::vector<rplidar_response_measurement_node_hq_t> NodeBuffer;
+
+    LidarManagerImpl();
+    virtual ~LidarManagerImpl();
+
+    virtual int addLidar(RPlidarDriver * drv);
+    virtual RPlidarDriver * getLidar(int sensor_id);
+    virtual u_result start(size_t threadCount = 1);
+    virtual void stop();
+    virtual u_result waitScan(LidarScan & scan, _u32 timeout = DEFAULT_TIMEOUT);
+    virtual _u32 getDroppedScanCount();
+
+    u_result _acquisitionLoop(size_t worker);
+
+protected:
+    class AcquisitionWorker
+    {
+    public:
+        LidarManagerImpl *  owner;
+        size_t              index;
+        rp::hal::Thread     thread;
+
+        void start() { thread = CLASS_THREAD(AcquisitionWorker, run); }
+        u_result run() { return owner->_acquisitionLoop(index); }
+    };
+
+    void _collectScan(int sensor_id, NodeBuffer & spare);
+
+    RPlidarDriver *         _lidars[MAX_LIDARS];
+    size_t                  _lidarCount;
+    AcquisitionWorker       _workers[MAX_LIDARS];
+    size_t                  _workerCount;
+    volatile bool           _isRunning;
+
+    // scans of all the lidars, oldest first; their node buffers circulate between
+    // the queue, the threads of the pool and the callers of waitScan()
+    LidarScan               _queue[SCAN_QUEUE_DEPTH];
+    size_t                  _queueHead;
+    size_t                  _queueCount;
+    _u32                    _droppedCount;
+
+    rp::hal::Locker         _lock;
+    rp::hal::Event          _scanEvt;
+};
+
+LidarManager * LidarManager::CreateManager()
+{
+    return new LidarManagerImpl();
+}
+
+void LidarManager::DisposeManager(LidarManager * manager)
+{
+    delete manager;
+}
+
+LidarManagerImpl::LidarManagerImpl()
+    : _lidarCount(0)
+    , _workerCount(0)
+    , _isRunning(false)
+    , _queueHead(0)
+    , _queueCount(0)
+    , _droppedCount(0)
+{
+}
+
+LidarManagerImpl::~LidarManagerImpl()
+{
+    stop();
+    for (size_t pos = 0; pos < _lidarCount; ++pos) {
+        RPlidarDriver::DisposeDriver(_lidars[pos]);
+    }
+}
+
+int LidarManagerImpl::addLidar(RPlidarDriver * drv)
+{
+    if (!drv || _isRunning || _lidarCount == MAX_LIDARS) return -1;
+
+    // the scan must not be running yet, its cache thread would compete for the data
+    if (IS_FAIL(drv->setExternalAcquisition(true))) return -1;
+
+    _lidars[_lidarCount] = drv;
+    return (int)_lidarCount++;
+}
+
+RPlidarDriver * LidarManagerImpl::getLidar(int sensor_id)
+{
+    if (sensor_id < 0 || (size_t)sensor_id >= _lidarCount) return NULL;
+    return _lidars[sensor_id];
+}
+
+u_result LidarManagerImpl::start(size_t threadCount)
+{
+    if (_isRunning) return RESULT_ALREADY_DONE;
+    if (!_lidarCount) return RESULT_OPERATION_FAIL;
+
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount > _lidarCount) threadCount = _lidarCount;
+
+    _isRunning = true;
+    for (_workerCount = 0; _workerCount < threadCount; ++_workerCount) {
+        AcquisitionWorker & worker = _workers[_workerCount];
+        worker.owner = this;
+        worker.index = _workerCount;
+        worker.start();
+        if (worker.thread.getHandle() == 0) {
+            stop();
+            return RESULT_OPERATION_FAIL;
+        }
+    }
+    return RESULT_OK;
+}
+
+void LidarManagerImpl::stop()
+{
+    _isRunning = false;
+    for (size_t pos = 0; pos < _workerCount; ++pos) {
+        _workers[pos].thread.join();
+        _workers[pos].thread = rp::hal::Thread();
+    }
+    _workerCount = 0;
+}
+
+u_result LidarManagerImpl::_acquisitionLoop(size_t worker)
+{
+    NodeBuffer spare;
+    bool readable[MAX_LIDARS] = { false, };
+#ifndef _WIN32
+    pollfd fds[MAX_LIDARS];
+    size_t polledIds[MAX_LIDARS];
+#endif
+
+    while (_isRunning) {
+        size_t polled = 0;
+        int timeout = POLL_TIMEOUT;
+
+        for (size_t id = worker; id < _lidarCount; id += _workerCount) {
+            // decode what the lidar already sent
+            u_result ans = _lidars[id]->pumpScanData(0);
+            if (IS_OK(ans)) _collectScan((int)id, spare);
+
+            // a lidar which is not scanning is checked again after POLL_TIMEOUT
+            if (IS_OK(ans) || ans == RESULT_OPERATION_TIMEOUT) {
+                // still readable but nothing decoded: the rest of a unit is on its way
+                bool partialUnit = readable[id] && ans == RESULT_OPERATION_TIMEOUT;
+                int fd = _lidars[id]->getNativeHandle();
+                if (fd == -1 || partialUnit) {
+                    timeout = RETRY_DELAY;
+                } else {
+#ifndef _WIN32
+                    fds[polled].fd = fd;
+                    fds[polled].events = POLLIN;
+                    fds[polled].revents = 0;
+                    polledIds[polled++] = id;
+#endif
+                }
+            }
+            readable[id] = false;
+        }
+
+#ifndef _WIN32
+        if (polled) {
+            if (::poll(fds, polled, timeout) > 0) {
+                for (size_t pos = 0; pos < polled; ++pos) {
+                    if (fds[pos].revents) readable[polledIds[pos]] = true;
+                }
+            }
+            continue;
+        }
+#endif
+        delay(timeout);
+    }
+    return RESULT_OK;
+}
+
+void LidarManagerImpl::_collectScan(int sensor_id, NodeBuffer & spare)
+{
+    // grabbed out of the lock, only the buffers are exchanged under it
+    if (spare.size() < RPlidarDriver::MAX_SCAN_NODES) spare.resize(RPlidarDriver::MAX_SCAN_NODES);
+    size_t count = spare.size();
+    _u64 timestamp_us;
+    if (IS_FAIL(_lidars[sensor_id]->grabScanDataHqWithTimeStamp(&spare[0], count, timestamp_us, 0))) return;
+
+    rp::hal::AutoLocker l(_lock);
+
+    // when the queue is full the oldest scan is overwritten
+    LidarScan & scan = _queue[(_queueHead + _queueCount) % SCAN_QUEUE_DEPTH];
+    scan.nodes.swap(spare);
+    scan.sensor_id = sensor_id;
+    scan.timestamp_us = timestamp_us;
+    scan.count = count;
+
+    if (_queueCount == SCAN_QUEUE_DEPTH) {
+        _queueHead = (_queueHead + 1) % SCAN_QUEUE_DEPTH;
+        ++_droppedCount;
+    } else {
+        ++_queueCount;
+    }
+    _scanEvt.set();
+}
+
+u_result LidarManagerImpl::waitScan(LidarScan & scan, _u32 timeout)
+{
+    _u32 startTs = getms();
+
+    for (;;) {
+        {
+            rp::hal::AutoLocker l(_lock);
+            if (_queueCount) {
+                LidarScan & queued = _queue[_queueHead];
+                scan.sensor_id = queued.sensor_id;
+                scan.timestamp_us = queued.timestamp_us;
+                scan.count = queued.count;
+                scan.nodes.swap(queued.nodes);
+
+                _queueHead = (_queueHead + 1) % SCAN_QUEUE_DEPTH;
+                --_queueCount;
+                return RESULT_OK;
+            }
+        }
+
+        _u32 waitTime = getms() - startTs;
+        if (waitTime >= timeout) return RESULT_OPERATION_TIMEOUT;
+        _scanEvt.wait(timeout - waitTime);
+    }
+}
+
+_u32 LidarManagerImpl::getDroppedScanCount()
+{
+    return _droppedCount;
+}
+
+}}}
@@ -0,0 +1,204 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include <algorithm>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+static const _u64 PERIOD_BOUNDS_US[] = { 50000, 60000, 70000, 80000, 90000, 100000, 110000, 125000, 150000, 200000, 500000 };
+static const _u64 JITTER_BOUNDS_US[] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000 };
+static const _u64 NODE_COUNT_BOUNDS[] = { 100, 250, 500, 750, 1000, 1250, 1500, 2000, 3000, 4000, 8192 };
+
+void appendMetricHeader(std::string & out, const char * name, const char * type, const char * help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendMetricSample(std::string & out, const char * name, _u64 value, const char * labels)
+{
+    char buffer[32];
+    out += name;
+    if (labels) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    snprintf(buffer, sizeof(buffer), " %llu\n", (unsigned long long)value);
+    out += buffer;
+}
+
+void appendMetric(std::string & out, const char * name, const char * type, const char * help, _u64 value)
+{
+    appendMetricHeader(out, name, type, help);
+    appendMetricSample(out, name, value);
+}
+
+void appendGauge(std::string & out, const char * name, const char * help, double value)
+{
+    char buffer[32];
+    appendMetricHeader(out, name, "gauge", help);
+    out += name;
+    snprintf(buffer, sizeof(buffer), " %g\n", value);
+    out += buffer;
+}
+
+MetricHistogram::MetricHistogram(const _u64 * bounds, size_t count)
+    : _boundCount(std::min(count, (size_t)MAX_BUCKETS))
+    , _sum(0)
+    , _count(0)
+{
+    memcpy(_bounds, bounds, _boundCount * sizeof(_u64));
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+void MetricHistogram::observe(_u64 value)
+{
+    size_t bucket = 0;
+    while (bucket < _boundCount && value > _bounds[bucket]) ++bucket;
+    metricAdd(_buckets[bucket], 1);
+    metricAdd(_sum, value);
+    metricAdd(_count, 1);
+}
+
+void MetricHistogram::append(std::string & out, const char * name, const char * help) const
+{
+    std::string series = name;
+    char labels[32];
+    _u64 cumulated = 0;
+
+    appendMetricHeader(out, name, "histogram", help);
+    series += "_bucket";
+    for (size_t bucket = 0; bucket <= _boundCount; ++bucket) {
+        cumulated += metricLoad(_buckets[bucket]);
+        if (bucket < _boundCount) {
+            snprintf(labels, sizeof(labels), "le=\"%llu\"", (unsigned long long)_bounds[bucket]);
+        } else {
+            strcpy(labels, "le=\"+Inf\"");
+        }
+        appendMetricSample(out, series.c_str(), cumulated, labels);
+    }
+    series = name;
+    appendMetricSample(out, (series + "_sum").c_str(), metricLoad(_sum));
+    // the buckets and the count are read at different times, keep them consistent for the scraper
+    appendMetricSample(out, (series + "_count").c_str(), cumulated);
+}
+
+RplidarDriverMetrics::RplidarDriverMetrics()
+    : bytes_read(0)
+    , units_decoded(0)
+    , checksum_errors(0)
+    , resyncs(0)
+    , timeouts(0)
+    , decode_us(0)
+    , revolutions(0)
+    , rx_queue_bytes(0)
+    , scan_ready_us(0)
+    , stalls(0)
+    , scan_mode_switches(0)
+    , scan_switch_blind_us(0)
+    , link_reconnects(0)
+    , revolution_period_us(PERIOD_BOUNDS_US, _countof(PERIOD_BOUNDS_US))
+    , revolution_jitter_us(JITTER_BOUNDS_US, _countof(JITTER_BOUNDS_US))
+    , nodes_per_revolution(NODE_COUNT_BOUNDS, _countof(NODE_COUNT_BOUNDS))
+    , recovery_failures(0)
+{
+    for (int level = 0; level < SCAN_RECOVERY_LEVELS; level++) {
+        recovery_attempts[level] = 0;
+        recovery_successes[level] = 0;
+        recovery_duration_us[level] = 0;
+    }
+}
+
+void RplidarDriverMetrics::append(std::string & out) const
+{
+    appendMetric(out, "rplidar_bytes_read_total", "counter",
+        "Bytes read from the lidar while scanning", metricLoad(bytes_read));
+    appendMetric(out, "rplidar_units_decoded_total", "counter",
+        "Measurement nodes or capsules decoded", metricLoad(units_decoded));
+    appendMetric(out, "rplidar_checksum_errors_total", "counter",
+        "Measurement units dropped on a checksum or CRC mismatch", metricLoad(checksum_errors));
+    appendMetric(out, "rplidar_resync_bytes_total", "counter",
+        "Bytes skipped while looking for the start of a measurement unit", metricLoad(resyncs));
+    appendMetric(out, "rplidar_timeouts_total", "counter",
+        "Measurement units not received in time", metricLoad(timeouts));
+    appendMetric(out, "rplidar_decode_us_total", "counter",
+        "Time spent decoding the measurement units received complete, in microseconds", metricLoad(decode_us));
+    appendMetric(out, "rplidar_revolutions_total", "counter",
+        "Complete revolutions assembled", metricLoad(revolutions));
+    appendMetric(out, "rplidar_rx_queue_bytes", "gauge",
+        "Bytes waiting in the receive buffer of the lidar channel", metricLoad(rx_queue_bytes));
+    appendMetric(out, "rplidar_scan_ready_us", "gauge",
+        "Time from the last scan request to its first revolution of a stable period, in microseconds", metricLoad(scan_ready_us));
+    appendMetric(out, "rplidar_stalls_total", "counter",
+        "Stable scans which stopped delivering data for a few capsule intervals", metricLoad(stalls));
+    appendMetric(out, "rplidar_scan_mode_switches_total", "counter",
+        "Scan mode changes made without stopping the acquisition", metricLoad(scan_mode_switches));
+    appendMetric(out, "rplidar_scan_switch_blind_us", "gauge",
+        "Time from the last scan mode switch to the first revolution in the new mode, in microseconds", metricLoad(scan_switch_blind_us));
+    appendMetric(out, "rplidar_link_reconnects_total", "counter",
+        "Links to the lidar re-established during a scan", metricLoad(link_reconnects));
+    revolution_period_us.append(out, "rplidar_revolution_period_us", "Duration of the revolutions, in microseconds");
+    revolution_jitter_us.append(out, "rplidar_revolution_jitter_us", "Difference between two consecutive revolution periods, in microseconds");
+    nodes_per_revolution.append(out, "rplidar_nodes_per_revolution", "Measurement nodes per revolution");
+
+    static const char * const RECOVERY_LABELS[SCAN_RECOVERY_LEVELS] = {
+        "level=\"resync\"", "level=\"restart\"", "level=\"reset\"",
+    };
+    appendMetricHeader(out, "rplidar_recovery_attempts_total", "counter", "Recoveries of a stalled scan tried, by level");
+    for (int level = 0; level < SCAN_RECOVERY_LEVELS; level++) {
+        appendMetricSample(out, "rplidar_recovery_attempts_total", metricLoad(recovery_attempts[level]), RECOVERY_LABELS[level]);
+    }
+    appendMetricHeader(out, "rplidar_recovery_successes_total", "counter", "Recoveries of a stalled scan which brought it back, by level");
+    for (int level = 0; level < SCAN_RECOVERY_LEVELS; level++) {
+        appendMetricSample(out, "rplidar_recovery_successes_total", metricLoad(recovery_successes[level]), RECOVERY_LABELS[level]);
+    }
+    appendMetricHeader(out, "rplidar_recovery_duration_us_total", "counter", "Time spent recovering a stalled scan, by level, in microseconds");
+    for (int level = 0; level < SCAN_RECOVERY_LEVELS; level++) {
+        appendMetricSample(out, "rplidar_recovery_duration_us_total", metricLoad(recovery_duration_us[level]), RECOVERY_LABELS[level]);
+    }
+    appendMetric(out, "rplidar_recovery_failures_total", "counter",
+        "Recoveries where every level failed", metricLoad(recovery_failures));
+}
+
+}}}
@@ -0,0 +1,247 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// the spin-up revolutions only initialize the measure
+static const _u32 SPINUP_REVOLUTIONS = 2;
+// consecutive revolutions within the tolerance before the speed is locked
+static const _u32 LOCK_REVOLUTIONS = 3;
+// weight of the last revolution in the measured speed
+static const float MEASURE_SMOOTHING = 0.5f;
+// duty changes too small to be worth a command
+static const float MIN_DUTY_CHANGE = 0.05f;
+// a period this much longer than the measured one spans a lost sync bit
+static const float MISSED_SYNC_RATIO = 0.6f;
+
+LidarMotorDriver::LidarMotorDriver(RPlidarDriver * driver)
+    : _driver(driver)
+{
+}
+
+u_result LidarMotorDriver::setDuty(float duty)
+{
+    if (duty < 0) duty = 0;
+    if (duty > 100) duty = 100;
+    return _driver->setMotorPWM((_u16)(duty * MAX_MOTOR_PWM / 100.f + 0.5f));
+}
+
+MockMotorDriver::MockMotorDriver()
+    : _failing(false)
+    , _duty(0)
+    , _commands(0)
+{
+}
+
+u_result MockMotorDriver::setDuty(float duty)
+{
+    if (_failing) return RESULT_OPERATION_FAIL;
+    _duty = duty;
+    _commands++;
+    return RESULT_OK;
+}
+
+class MotorSpeedControllerImpl : public MotorSpeedController {
+public:
+    MotorSpeedControllerImpl(MotorDriver * motor);
+
+    virtual u_result start(const MotorSpeedConfig & config, float initial_duty);
+    virtual void stop();
+    virtual void update(_u64 period_us);
+    virtual void getStatus(MotorSpeedStatus & status);
+
+protected:
+    void _setDuty(float duty);
+
+    rp::hal::Locker     _lock;
+    MotorDriver *       _motor;
+    MotorSpeedConfig    _config;
+    MotorSpeedStatus    _status;
+    float               _feedForward;
+    float               _integral;
+    _u32                _inTolerance;
+    bool                _skipped;
+};
+
+MotorSpeedController * MotorSpeedController::CreateController(MotorDriver * motor)
+{
+    return new MotorSpeedControllerImpl(motor);
+}
+
+void MotorSpeedController::DisposeController(MotorSpeedController * controller)
+{
+    delete controller;
+}
+
+MotorSpeedConfig MotorSpeedController::DefaultConfig(float target_hz)
+{
+    MotorSpeedConfig config;
+    config.target_hz = target_hz;
+    config.kp = 3.0f;
+    config.ki = 6.0f;
+    config.min_duty = 20.0f;
+    config.max_duty = 100.0f;
+    config.max_step = 5.0f;
+    config.tolerance_hz = 0.1f;
+    return config;
+}
+
+const char * MotorSpeedController::StateName(int state)
+{
+    switch (state) {
+    case MOTOR_SPEED_IDLE:
+        return "idle";
+    case MOTOR_SPEED_SPINUP:
+        return "spinup";
+    case MOTOR_SPEED_TRACKING:
+        return "tracking";
+    case MOTOR_SPEED_LOCKED:
+        return "locked";
+    case MOTOR_SPEED_SATURATED:
+        return "saturated";
+    default:
+        return "unknown";
+    }
+}
+
+MotorSpeedControllerImpl::MotorSpeedControllerImpl(MotorDriver * motor)
+    : _motor(motor)
+    , _feedForward(0)
+    , _integral(0)
+    , _inTolerance(0)
+    , _skipped(false)
+{
+    _config = DefaultConfig(0);
+    memset(&_status, 0, sizeof(_status));
+}
+
+u_result MotorSpeedControllerImpl::start(const MotorSpeedConfig & config, float initial_duty)
+{
+    if (config.target_hz <= 0 || config.min_duty > config.max_duty) return RESULT_INVALID_DATA;
+
+    rp::hal::AutoLocker l(_lock);
+    _config = config;
+    _feedForward = initial_duty;
+    _integral = 0;
+    _inTolerance = 0;
+    _skipped = false;
+    memset(&_status, 0, sizeof(_status));
+    _status.state = MOTOR_SPEED_SPINUP;
+    _status.target_hz = config.target_hz;
+    _status.duty = initial_duty;
+    return _motor->setDuty(initial_duty);
+}
+
+void MotorSpeedControllerImpl::stop()
+{
+    rp::hal::AutoLocker l(_lock);
+    _status.state = MOTOR_SPEED_IDLE;
+}
+
+void MotorSpeedControllerImpl::update(_u64 period_us)
+{
+    rp::hal::AutoLocker l(_lock);
+    if (_status.state == MOTOR_SPEED_IDLE) return;
+    if (period_us < 1000 || period_us > 2000000) return;
+
+    float hz = 1000000.f / period_us;
+    if (_status.revolutions++ < SPINUP_REVOLUTIONS) {
+        _status.measured_hz = hz;
+        return;
+    }
+    // a lost sync bit gives a double period, which is not the speed of the motor;
+    // a second one in a row is a real slowdown
+    bool outlier = hz < _status.measured_hz * MISSED_SYNC_RATIO;
+    if (outlier && !_skipped) {
+        _skipped = true;
+        return;
+    }
+    _skipped = false;
+    _status.measured_hz += (hz - _status.measured_hz) * MEASURE_SMOOTHING;
+
+    float error = _config.target_hz - _status.measured_hz;
+    float dt = period_us / 1000000.f;
+    float integral = _integral + error * dt;
+    float duty = _feedForward + _config.kp * error + _config.ki * integral;
+
+    if (duty > _status.duty + _config.max_step) duty = _status.duty + _config.max_step;
+    if (duty < _status.duty - _config.max_step) duty = _status.duty - _config.max_step;
+
+    bool saturated = false;
+    if (duty >= _config.max_duty) {
+        duty = _config.max_duty;
+        saturated = error > 0;
+    } else if (duty <= _config.min_duty) {
+        duty = _config.min_duty;
+        saturated = error < 0;
+    }
+    // no integration while the output cannot follow
+    if (!saturated) _integral = integral;
+
+    if (saturated) {
+        _inTolerance = 0;
+        _status.state = MOTOR_SPEED_SATURATED;
+    } else if (error <= _config.tolerance_hz && error >= -_config.tolerance_hz) {
+        if (++_inTolerance >= LOCK_REVOLUTIONS) _status.state = MOTOR_SPEED_LOCKED;
+        else if (_status.state != MOTOR_SPEED_LOCKED) _status.state = MOTOR_SPEED_TRACKING;
+    } else {
+        _inTolerance = 0;
+        _status.state = MOTOR_SPEED_TRACKING;
+    }
+
+    _setDuty(duty);
+}
+
+void MotorSpeedControllerImpl::_setDuty(float duty)
+{
+    float change = duty - _status.duty;
+    if (change < MIN_DUTY_CHANGE && change > -MIN_DUTY_CHANGE) return;
+
+    if (IS_FAIL(_motor->setDuty(duty))) {
+        ++_status.command_errors;
+        return;
+    }
+    _status.duty = duty;
+}
+
+void MotorSpeedControllerImpl::getStatus(MotorSpeedStatus & status)
+{
+    rp::hal::AutoLocker l(_lock);
+    status = _status;
+}
+
+}}}
@@ -0,0 +1,127 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// udev gives the files of a newly exported channel to their group a little later
+static const _u32 EXPORT_TIMEOUT_MS = 1000;
+
+static bool writeFile(const char * path, const char * value)
+{
+    // O_TRUNC for the regular files of a fake tree, ignored by sysfs
+    int fd = ::open(path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (fd < 0) return false;
+    size_t len = strlen(value);
+    bool written = ::write(fd, value, len) == (ssize_t)len;
+    ::close(fd);
+    return written;
+}
+
+SysfsPwmMotorDriver::SysfsPwmMotorDriver()
+    : _opened(false)
+    , _period_ns(0)
+{
+    _channel_path[0] = 0;
+}
+
+SysfsPwmMotorDriver::~SysfsPwmMotorDriver()
+{
+    close();
+}
+
+u_result SysfsPwmMotorDriver::open(const char * chip, int channel, _u32 frequency_hz)
+{
+    if (_opened) return RESULT_ALREADY_DONE;
+    if (!frequency_hz || channel < 0) return RESULT_INVALID_DATA;
+
+    char path[sizeof(_channel_path) + 16];
+    int len = snprintf(_channel_path, sizeof(_channel_path), "%s/pwm%d", chip, channel);
+    if (len < 0 || len >= (int)sizeof(_channel_path)) return RESULT_INVALID_DATA;
+
+    snprintf(path, sizeof(path), "%s/duty_cycle", _channel_path);
+    if (access(_channel_path, F_OK) != 0) {
+        char export_path[sizeof(_channel_path)];
+        char value[16];
+        snprintf(export_path, sizeof(export_path), "%s/export", chip);
+        snprintf(value, sizeof(value), "%d", channel);
+        if (!writeFile(export_path, value)) return RESULT_OPERATION_FAIL;
+    }
+    _u32 start = getms();
+    while (access(path, W_OK) != 0) {
+        if (getms() - start > EXPORT_TIMEOUT_MS) return RESULT_OPERATION_TIMEOUT;
+        delay(10);
+    }
+
+    // the period cannot be set below the current duty
+    _period_ns = 1000000000 / frequency_hz;
+    if (IS_FAIL(_write("duty_cycle", 0)) || IS_FAIL(_write("period", _period_ns)) || IS_FAIL(_write("enable", 1))) {
+        return RESULT_OPERATION_FAIL;
+    }
+    _opened = true;
+    return RESULT_OK;
+}
+
+void SysfsPwmMotorDriver::close()
+{
+    if (!_opened) return;
+    _write("duty_cycle", 0);
+    _write("enable", 0);
+    _opened = false;
+}
+
+u_result SysfsPwmMotorDriver::setDuty(float duty)
+{
+    if (!_opened) return RESULT_OPERATION_FAIL;
+    if (duty < 0) duty = 0;
+    if (duty > 100) duty = 100;
+    return _write("duty_cycle", (_u32)(_period_ns * (duty / 100.f) + 0.5f));
+}
+
+u_result SysfsPwmMotorDriver::_write(const char * attribute, _u32 value)
+{
+    char path[sizeof(_channel_path) + 16];
+    char text[16];
+    snprintf(path, sizeof(path), "%s/%s", _channel_path, attribute);
+    snprintf(text, sizeof(text), "%u", value);
+    return writeFile(path, text) ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+}}}
@@ -0,0 +1,383 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/socket.h"
+
+#include <algorithm>
+
+using namespace rp::net;
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// largest frame accepted from the network, a corrupted header must not exhaust the memory
+static const size_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+static inline void putU16(_u8 * out, _u16 value)
+{
+    out[0] = (_u8)value;
+    out[1] = (_u8)(value >> 8);
+}
+
+static inline void putU32(_u8 * out, _u32 value)
+{
+    out[0] = (_u8)value;
+    out[1] = (_u8)(value >> 8);
+    out[2] = (_u8)(value >> 16);
+    out[3] = (_u8)(value >> 24);
+}
+
+static inline _u16 getU16(const _u8 * in)
+{
+    return (_u16)(in[0] | (in[1] << 8));
+}
+
+static inline _u32 getU32(const _u8 * in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((_u32)in[3] << 24);
+}
+
+ScanReassembler::ScanReassembler()
+    : _hasFrame(false)
+    , _isComplete(false)
+    , _frameId(0)
+    , _missingFragments(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+u_result ScanReassembler::push(const _u8 * datagram, size_t size)
+{
+    if (size < SCAN_FRAGMENT_HEADER_SIZE
+        || datagram[0] != SCAN_FRAGMENT_SYNC_BYTE1 || datagram[1] != SCAN_FRAGMENT_SYNC_BYTE2) {
+        ++_stats.invalid_datagrams;
+        return RESULT_INVALID_DATA;
+    }
+
+    _u32 frameId = getU32(datagram + 2);
+    _u16 index = getU16(datagram + 6);
+    _u16 fragmentCount = getU16(datagram + 8);
+    _u32 frameSize = getU32(datagram + 10);
+    _u32 offset = getU32(datagram + 14);
+    size_t payloadSize = size - SCAN_FRAGMENT_HEADER_SIZE;
+
+    if (index >= fragmentCount || frameSize > MAX_FRAME_SIZE
+        || offset > frameSize || payloadSize > frameSize - offset) {
+        ++_stats.invalid_datagrams;
+        return RESULT_INVALID_DATA;
+    }
+    ++_stats.fragments;
+
+    if (!_hasFrame || (_s32)(frameId - _frameId) > 0) {
+        if (_hasFrame) {
+            // the frames in between never showed up, the current one is given up if incomplete
+            _stats.lost_frames += frameId - _frameId - 1;
+            if (!_isComplete) ++_stats.lost_frames;
+        }
+        _hasFrame = true;
+        _isComplete = false;
+        _frameId = frameId;
+        _missingFragments = fragmentCount;
+        _frame.resize(frameSize);
+        _received.assign(fragmentCount, 0);
+    } else if (frameId != _frameId || _isComplete) {
+        // late or duplicated
+        return RESULT_OPERATION_TIMEOUT;
+    }
+
+    if (fragmentCount != _received.size() || frameSize != _frame.size()) {
+        ++_stats.invalid_datagrams;
+        return RESULT_INVALID_DATA;
+    }
+    if (_received[index]) return RESULT_OPERATION_TIMEOUT;
+
+    if (payloadSize) memcpy(&_frame[offset], datagram + SCAN_FRAGMENT_HEADER_SIZE, payloadSize);
+    _received[index] = 1;
+    if (--_missingFragments) return RESULT_OPERATION_TIMEOUT;
+
+    _isComplete = true;
+    ++_stats.frames;
+    return RESULT_OK;
+}
+
+const _u8 * ScanReassembler::getFrame(size_t & size)
+{
+    if (!_isComplete) {
+        size = 0;
+        return NULL;
+    }
+    size = _frame.size();
+    return size ? &_frame[0] : NULL;
+}
+
+void ScanReassembler::getStats(ScanMulticastStats & stats)
+{
+    stats = _stats;
+}
+
+class ScanMulticastPublisherImpl : public ScanMulticastPublisher {
+public:
+    ScanMulticastPublisherImpl();
+    virtual ~ScanMulticastPublisherImpl();
+
+    virtual u_result open(const char * group, int port, size_t datagramSize, int ttl);
+    virtual void close();
+    virtual void setDeltaConfig(const ScanDeltaConfig & config);
+    virtual u_result publishScan(const rplidar_response_measurement_node_hq_t * nodes, size_t count);
+    virtual u_result publishFrame(const _u8 * frame, size_t size);
+
+protected:
+    void _pollKeyframeRequests();
+
+    DGramSocket *       _socket;
+    SocketAddress       _group;
+    _u32                _frameId;
+    std::vector<_u8>    _datagram;
+    std::vector<_u8>    _frame;
+    ScanEncoder         _encoder;
+};
+
+ScanMulticastPublisher * ScanMulticastPublisher::CreatePublisher()
+{
+    return new ScanMulticastPublisherImpl();
+}
+
+void ScanMulticastPublisher::DisposePublisher(ScanMulticastPublisher * publisher)
+{
+    delete publisher;
+}
+
+ScanMulticastPublisherImpl::ScanMulticastPublisherImpl()
+    : _socket(NULL)
+    , _frameId(0)
+{
+}
+
+ScanMulticastPublisherImpl::~ScanMulticastPublisherImpl()
+{
+    close();
+}
+
+u_result ScanMulticastPublisherImpl::open(const char * group, int port, size_t datagramSize, int ttl)
+{
+    if (_socket) return RESULT_ALREADY_DONE;
+    if (datagramSize <= SCAN_FRAGMENT_HEADER_SIZE || datagramSize > 65507) return RESULT_INVALID_DATA;
+
+    if (IS_FAIL(_group.setAddressFromString(group))) return RESULT_INVALID_DATA;
+    _group.setPort(port);
+
+    _socket = DGramSocket::CreateSocket();
+    if (!_socket) return RESULT_OPERATION_FAIL;
+    if (IS_FAIL(_socket->setMulticastTtl(ttl))) {
+        close();
+        return RESULT_OPERATION_FAIL;
+    }
+
+    _datagram.resize(datagramSize);
+    return RESULT_OK;
+}
+
+void ScanMulticastPublisherImpl::close()
+{
+    if (!_socket) return;
+    _socket->dispose();
+    _socket = NULL;
+}
+
+void ScanMulticastPublisherImpl::setDeltaConfig(const ScanDeltaConfig & config)
+{
+    _encoder.setDeltaConfig(config);
+}
+
+void ScanMulticastPublisherImpl::_pollKeyframeRequests()
+{
+    _u8 request[16];
+    size_t len;
+    while (_socket->waitforData(0) == RESULT_OK) {
+        if (IS_FAIL(_socket->recvFrom(request, sizeof(request), len))) break;
+        if (len && memchr(request, SCAN_STREAM_KEYFRAME_REQUEST, len)) _encoder.requestKeyframe();
+    }
+}
+
+u_result ScanMulticastPublisherImpl::publishScan(const rplidar_response_measurement_node_hq_t * nodes, size_t count)
+{
+    if (!_socket) return RESULT_OPERATION_FAIL;
+    _pollKeyframeRequests();
+
+    _frame.resize(ScanEncoder::MaxFrameSize(count));
+    size_t size = _encoder.encode(nodes, count, &_frame[0]);
+    return publishFrame(&_frame[0], size);
+}
+
+u_result ScanMulticastPublisherImpl::publishFrame(const _u8 * frame, size_t size)
+{
+    if (!_socket) return RESULT_OPERATION_FAIL;
+
+    size_t payloadSize = _datagram.size() - SCAN_FRAGMENT_HEADER_SIZE;
+    size_t fragmentCount = (size + payloadSize - 1) / payloadSize;
+    if (!fragmentCount) fragmentCount = 1;
+    if (fragmentCount > 0xFFFF || size > MAX_FRAME_SIZE) return RESULT_INVALID_DATA;
+
+    _u8 * datagram = &_datagram[0];
+    datagram[0] = SCAN_FRAGMENT_SYNC_BYTE1;
+    datagram[1] = SCAN_FRAGMENT_SYNC_BYTE2;
+    putU32(datagram + 2, ++_frameId);
+    putU16(datagram + 8, (_u16)fragmentCount);
+    putU32(datagram + 10, (_u32)size);
+
+    u_result ans = RESULT_OK;
+    for (size_t index = 0; index < fragmentCount; ++index) {
+        size_t offset = index * payloadSize;
+        size_t len = std::min(payloadSize, size - offset);
+        putU16(datagram + 6, (_u16)index);
+        putU32(datagram + 14, (_u32)offset);
+        memcpy(datagram + SCAN_FRAGMENT_HEADER_SIZE, frame + offset, len);
+
+        // a fragment refused by the network only costs this frame, the next ones are still sent
+        u_result sent = _socket->sendTo(_group, datagram, SCAN_FRAGMENT_HEADER_SIZE + len);
+        if (IS_FAIL(sent)) ans = sent;
+    }
+    return ans;
+}
+
+class ScanMulticastReceiverImpl : public ScanMulticastReceiver {
+public:
+    ScanMulticastReceiverImpl();
+    virtual ~ScanMulticastReceiverImpl();
+
+    virtual u_result open(const char * group, int port);
+    virtual void close();
+    virtual u_result waitScan(rplidar_response_measurement_node_hq_t * nodes, size_t & count, _u32 timeout);
+    virtual void getStats(ScanMulticastStats & stats);
+
+protected:
+    DGramSocket *       _socket;
+    SocketAddress       _publisher;
+    std::vector<_u8>    _datagram;
+    ScanReassembler     _reassembler;
+    ScanDecoder         _decoder;
+};
+
+ScanMulticastReceiver * ScanMulticastReceiver::CreateReceiver()
+{
+    return new ScanMulticastReceiverImpl();
+}
+
+void ScanMulticastReceiver::DisposeReceiver(ScanMulticastReceiver * receiver)
+{
+    delete receiver;
+}
+
+ScanMulticastReceiverImpl::ScanMulticastReceiverImpl()
+    : _socket(NULL)
+{
+    _datagram.resize(65536);
+}
+
+ScanMulticastReceiverImpl::~ScanMulticastReceiverImpl()
+{
+    close();
+}
+
+u_result ScanMulticastReceiverImpl::open(const char * group, int port)
+{
+    if (_socket) return RESULT_ALREADY_DONE;
+
+    SocketAddress groupAddress;
+    if (IS_FAIL(groupAddress.setAddressFromString(group))) return RESULT_INVALID_DATA;
+
+    _socket = DGramSocket::CreateSocket();
+    if (!_socket) return RESULT_OPERATION_FAIL;
+
+    SocketAddress localAddress;
+    localAddress.setAnyAddress();
+    localAddress.setPort(port);
+    if (IS_FAIL(_socket->bind(localAddress)) || IS_FAIL(_socket->joinMulticastGroup(groupAddress))) {
+        close();
+        return RESULT_OPERATION_FAIL;
+    }
+    return RESULT_OK;
+}
+
+void ScanMulticastReceiverImpl::close()
+{
+    if (!_socket) return;
+    _socket->dispose();
+    _socket = NULL;
+}
+
+u_result ScanMulticastReceiverImpl::waitScan(rplidar_response_measurement_node_hq_t * nodes, size_t & count, _u32 timeout)
+{
+    if (!_socket) return RESULT_OPERATION_FAIL;
+
+    size_t maxCount = count;
+    count = 0;
+    _u32 startTs = getms();
+    _u32 waitTime = 0;
+
+    while (waitTime <= timeout) {
+        u_result ans = _socket->waitforData(timeout - waitTime);
+        if (ans == RESULT_OPERATION_TIMEOUT) break;
+        if (IS_FAIL(ans)) return ans;
+
+        size_t len;
+        ans = _socket->recvFrom(&_datagram[0], _datagram.size(), len, &_publisher);
+        if (IS_FAIL(ans)) return ans;
+
+        waitTime = getms() - startTs;
+        if (_reassembler.push(&_datagram[0], len) != RESULT_OK) continue;
+
+        size_t frameSize;
+        const _u8 * frame = _reassembler.getFrame(frameSize);
+        size_t consumed;
+        count = maxCount;
+        ans = _decoder.decode(frame, frameSize, nodes, count, consumed);
+        if (IS_OK(ans)) return ans;
+        if (ans == RESULT_INSUFFICIENT_MEMORY) return ans;
+
+        count = 0;
+        if (_decoder.isKeyframeNeeded()) {
+            _u8 request = SCAN_STREAM_KEYFRAME_REQUEST;
+            _socket->sendTo(_publisher, &request, sizeof(request));
+        }
+    }
+    return RESULT_OPERATION_TIMEOUT;
+}
+
+void ScanMulticastReceiverImpl::getStats(ScanMulticastStats & stats)
+{
+    _reassembler.getStats(stats);
+}
+
+}}}
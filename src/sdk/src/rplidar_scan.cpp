@@ -0,0 +1,120 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include <algorithm>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+// a non empty array, so that the accessors of an unused scan stay valid
+static const size_t INITIAL_CAPACITY = 16;
+
+Scan::Scan()
+    : timestamp_us(0)
+    , _count(0)
+    , _capacity(0)
+{
+    reserve(INITIAL_CAPACITY);
+}
+
+size_t Scan::ExpectedSize(float us_per_sample)
+{
+    if (us_per_sample <= 0) return MAX_NODES;
+    size_t count = (size_t)(1000000 / (us_per_sample * MIN_REVOLUTION_HZ)) + 1;
+    return (count < MAX_NODES) ? count : MAX_NODES;
+}
+
+void Scan::reserve(size_t count)
+{
+    if (count > MAX_NODES) count = MAX_NODES;
+    if (count <= _capacity) return;
+    _angles.resize(count);
+    _distances.resize(count);
+    _qualities.resize(count);
+    _capacity = count;
+}
+
+void Scan::resize(size_t count)
+{
+    if (count > _capacity) reserve(count);
+    _count = (count < _capacity) ? count : _capacity;
+}
+
+void Scan::swap(Scan & other)
+{
+    _angles.swap(other._angles);
+    _distances.swap(other._distances);
+    _qualities.swap(other._qualities);
+    std::swap(_count, other._count);
+    std::swap(_capacity, other._capacity);
+    std::swap(timestamp_us, other.timestamp_us);
+}
+
+void Scan::push_back(const rplidar_response_measurement_node_hq_t & node)
+{
+    if (_count == _capacity) {
+        if (_capacity == MAX_NODES) return;
+        reserve(_capacity * 2);
+    }
+    _angles[_count] = node.angle_z_q14;
+    _distances[_count] = node.dist_mm_q2;
+    _qualities[_count] = node.quality;
+    ++_count;
+}
+
+void Scan::assign(const rplidar_response_measurement_node_hq_t * nodes, size_t count)
+{
+    if (count > MAX_NODES) count = MAX_NODES;
+    reserve(count);
+    for (size_t pos = 0; pos < count; ++pos) {
+        _angles[pos] = nodes[pos].angle_z_q14;
+        _distances[pos] = nodes[pos].dist_mm_q2;
+        _qualities[pos] = nodes[pos].quality;
+    }
+    _count = count;
+}
+
+void Scan::copyTo(rplidar_response_measurement_node_hq_t * nodes, size_t & count) const
+{
+    if (count > _count) count = _count;
+    for (size_t pos = 0; pos < count; ++pos) {
+        nodes[pos].angle_z_q14 = _angles[pos];
+        nodes[pos].dist_mm_q2 = _distances[pos];
+        nodes[pos].quality = _qualities[pos];
+        nodes[pos].flag = pos ? RPLIDAR_RESP_MEASUREMENT_INVERSE_SYNCBIT : RPLIDAR_RESP_MEASUREMENT_SYNCBIT;
+    }
+}
+
+}}}
@@ -0,0 +1,368 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <string>
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+static const _u32 SHM_MAGIC = 0x4d485352; // "RSHM"
+static const _u32 SHM_VERSION = 1;
+
+// layout of the shared memory, followed by the slots
+struct ScanShmHeader {
+    _u32    magic;          // written last by the publisher, once the rest is initialized
+    _u32    version;
+    _u32    slot_count;
+    _u32    slot_capacity;
+    _u32    slot_size;      // bytes between two slots
+    _u32    closed;
+    _u32    futex_word;     // incremented for each revolution, the readers sleep on it
+    _u32    reserved;
+    _u64    revolution;     // latest revolution completely written
+    _u8     padding[24];
+};
+
+struct ScanShmSlot {
+    _u32    sequence;       // odd while the slot is being written
+    _u32    count;
+    _u64    revolution;
+    _u64    timestamp_us;
+    _u64    reserved;
+    rplidar_response_measurement_node_hq_t nodes[1];
+};
+
+static inline long futex(_u32 * word, int op, _u32 value, const timespec * timeout)
+{
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+static inline ScanShmSlot * slotAt(ScanShmHeader * header, size_t slot)
+{
+    return reinterpret_cast<ScanShmSlot *>(reinterpret_cast<_u8 *>(header) + sizeof(ScanShmHeader) + slot * header->slot_size);
+}
+
+class ScanShmPublisherImpl : public ScanShmPublisher {
+public:
+    ScanShmPublisherImpl();
+    virtual ~ScanShmPublisherImpl();
+
+    virtual u_result open(const char * name, size_t slotCount, size_t maxNodes);
+    virtual void close();
+    virtual u_result publishScan(const rplidar_response_measurement_node_hq_t * nodes, size_t count, _u64 timestamp_us);
+
+protected:
+    ScanShmHeader *     _header;
+    size_t              _size;
+    std::string         _name;
+};
+
+ScanShmPublisher * ScanShmPublisher::CreatePublisher()
+{
+    return new ScanShmPublisherImpl();
+}
+
+void ScanShmPublisher::DisposePublisher(ScanShmPublisher * publisher)
+{
+    delete publisher;
+}
+
+ScanShmPublisherImpl::ScanShmPublisherImpl()
+    : _header(NULL)
+    , _size(0)
+{
+}
+
+ScanShmPublisherImpl::~ScanShmPublisherImpl()
+{
+    close();
+}
+
+u_result ScanShmPublisherImpl::open(const char * name, size_t slotCount, size_t maxNodes)
+{
+    if (_header) return RESULT_ALREADY_DONE;
+    if (!slotCount || !maxNodes) return RESULT_INVALID_DATA;
+
+    // slots aligned on cache lines
+    size_t slotSize = (sizeof(ScanShmSlot) + (maxNodes - 1) * sizeof(rplidar_response_measurement_node_hq_t) + 63) & ~(size_t)63;
+    size_t size = sizeof(ScanShmHeader) + slotCount * slotSize;
+
+    // the readers of a previous publisher keep their mapping, they are told to re-open
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return RESULT_OPERATION_FAIL;
+    if (ftruncate(fd, size) != 0) {
+        ::close(fd);
+        shm_unlink(name);
+        return RESULT_OPERATION_FAIL;
+    }
+    void * addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        shm_unlink(name);
+        return RESULT_OPERATION_FAIL;
+    }
+
+    _header = static_cast<ScanShmHeader *>(addr);
+    _size = size;
+    _name = name;
+
+    // the memory is zero filled by ftruncate
+    _header->version = SHM_VERSION;
+    _header->slot_count = (_u32)slotCount;
+    _header->slot_capacity = (_u32)maxNodes;
+    _header->slot_size = (_u32)slotSize;
+    __atomic_store_n(&_header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    return RESULT_OK;
+}
+
+void ScanShmPublisherImpl::close()
+{
+    if (!_header) return;
+
+    __atomic_store_n(&_header->closed, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&_header->futex_word, 1, __ATOMIC_SEQ_CST);
+    futex(&_header->futex_word, FUTEX_WAKE, INT_MAX, NULL);
+
+    munmap(_header, _size);
+    shm_unlink(_name.c_str());
+    _header = NULL;
+}
+
+u_result ScanShmPublisherImpl::publishScan(const rplidar_response_measurement_node_hq_t * nodes, size_t count, _u64 timestamp_us)
+{
+    if (!_header) return RESULT_OPERATION_FAIL;
+    if (count > _header->slot_capacity) return RESULT_INSUFFICIENT_MEMORY;
+
+    _u64 revolution = _header->revolution + 1;
+    ScanShmSlot * slot = slotAt(_header, revolution % _header->slot_count);
+
+    // sequence lock: odd while the slot is inconsistent
+    __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->count = (_u32)count;
+    slot->revolution = revolution;
+    slot->timestamp_us = timestamp_us;
+    memcpy(slot->nodes, nodes, count * sizeof(rplidar_response_measurement_node_hq_t));
+
+    __atomic_store_n(&slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&_header->revolution, revolution, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&_header->futex_word, 1, __ATOMIC_SEQ_CST);
+    futex(&_header->futex_word, FUTEX_WAKE, INT_MAX, NULL);
+    return RESULT_OK;
+}
+
+class ScanShmReaderImpl : public ScanShmReader {
+public:
+    ScanShmReaderImpl();
+    virtual ~ScanShmReaderImpl();
+
+    virtual u_result open(const char * name);
+    virtual void close();
+    virtual u_result waitScan(ScanShmView & view, _u32 timeout);
+    virtual bool isValid(const ScanShmView & view);
+    virtual u_result readScan(rplidar_response_measurement_node_hq_t * nodes, size_t & count, _u64 & timestamp_us, _u32 timeout);
+    virtual _u64 getMissedScanCount();
+
+protected:
+    bool _tryAcquire(_u64 revolution, ScanShmView & view);
+
+    ScanShmHeader *     _header;
+    size_t              _size;
+    _u64                _lastRevolution;
+    _u64                _missedCount;
+};
+
+ScanShmReader * ScanShmReader::CreateReader()
+{
+    return new ScanShmReaderImpl();
+}
+
+void ScanShmReader::DisposeReader(ScanShmReader * reader)
+{
+    delete reader;
+}
+
+ScanShmReaderImpl::ScanShmReaderImpl()
+    : _header(NULL)
+    , _size(0)
+    , _lastRevolution(0)
+    , _missedCount(0)
+{
+}
+
+ScanShmReaderImpl::~ScanShmReaderImpl()
+{
+    close();
+}
+
+u_result ScanShmReaderImpl::open(const char * name)
+{
+    if (_header) return RESULT_ALREADY_DONE;
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return RESULT_OPERATION_FAIL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ScanShmHeader)) {
+        ::close(fd);
+        return RESULT_OPERATION_FAIL;
+    }
+    void * addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) return RESULT_OPERATION_FAIL;
+
+    ScanShmHeader * header = static_cast<ScanShmHeader *>(addr);
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || header->version != SHM_VERSION
+        || sizeof(ScanShmHeader) + (size_t)header->slot_count * header->slot_size > (size_t)st.st_size) {
+        munmap(addr, st.st_size);
+        return RESULT_FORMAT_NOT_SUPPORT;
+    }
+
+    _header = header;
+    _size = st.st_size;
+    // only the revolutions published from now on are returned
+    _lastRevolution = __atomic_load_n(&_header->revolution, __ATOMIC_ACQUIRE);
+    _missedCount = 0;
+    return RESULT_OK;
+}
+
+void ScanShmReaderImpl::close()
+{
+    if (!_header) return;
+    munmap(_header, _size);
+    _header = NULL;
+}
+
+bool ScanShmReaderImpl::_tryAcquire(_u64 revolution, ScanShmView & view)
+{
+    const ScanShmSlot * slot = slotAt(_header, revolution % _header->slot_count);
+
+    _u32 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1) return false;
+
+    view.revolution = slot->revolution;
+    view.timestamp_us = slot->timestamp_us;
+    view.count = std::min<size_t>(slot->count, _header->slot_capacity);
+    view.nodes = slot->nodes;
+    view.slot = (_u32)(revolution % _header->slot_count);
+    view.sequence = sequence;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return view.revolution == revolution && __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+u_result ScanShmReaderImpl::waitScan(ScanShmView & view, _u32 timeout)
+{
+    if (!_header) return RESULT_OPERATION_FAIL;
+
+    _u32 startTs = getms();
+    while (true) {
+        // read before checking for a revolution, so that a publication in between is not slept through
+        _u32 futexWord = __atomic_load_n(&_header->futex_word, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&_header->closed, __ATOMIC_ACQUIRE)) return RESULT_OPERATION_STOP;
+
+        _u64 revolution = __atomic_load_n(&_header->revolution, __ATOMIC_ACQUIRE);
+        if (revolution != _lastRevolution) {
+            // only the latest revolution matters, the slot may only be overwritten by a later one
+            if (_tryAcquire(revolution, view)) {
+                _missedCount += revolution - _lastRevolution - 1;
+                _lastRevolution = revolution;
+                return RESULT_OK;
+            }
+            continue;
+        }
+
+        _u32 waitTime = getms() - startTs;
+        if (waitTime >= timeout) return RESULT_OPERATION_TIMEOUT;
+
+        timespec ts;
+        ts.tv_sec = (timeout - waitTime) / 1000;
+        ts.tv_nsec = ((timeout - waitTime) % 1000) * 1000000;
+        futex(&_header->futex_word, FUTEX_WAIT, futexWord, &ts);
+    }
+}
+
+bool ScanShmReaderImpl::isValid(const ScanShmView & view)
+{
+    if (!_header) return false;
+    const ScanShmSlot * slot = slotAt(_header, view.slot);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == view.sequence;
+}
+
+u_result ScanShmReaderImpl::readScan(rplidar_response_measurement_node_hq_t * nodes, size_t & count, _u64 & timestamp_us, _u32 timeout)
+{
+    size_t maxCount = count;
+    count = 0;
+
+    ScanShmView view;
+    u_result ans = waitScan(view, timeout);
+    if (IS_FAIL(ans)) return ans;
+
+    while (true) {
+        if (view.count > maxCount) return RESULT_INSUFFICIENT_MEMORY;
+        memcpy(nodes, view.nodes, view.count * sizeof(rplidar_response_measurement_node_hq_t));
+        timestamp_us = view.timestamp_us;
+        if (isValid(view)) break;
+
+        // overwritten while copying: the reader is very late, take the latest revolution instead
+        ans = waitScan(view, timeout);
+        if (IS_FAIL(ans)) return ans;
+    }
+
+    count = view.count;
+    return RESULT_OK;
+}
+
+_u64 ScanShmReaderImpl::getMissedScanCount()
+{
+    return _missedCount;
+}
+
+}}}
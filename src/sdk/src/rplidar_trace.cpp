@@ -0,0 +1,277 @@
+/*
+ *  RPLIDAR SDK
+ *
+ *  Copyright (c) 2009 - 2014 RoboPeak Team
+ *  http://www.robopeak.com
+ *  Copyright (c) 2014 - 2019 Shanghai Slamtec Co., Ltd.
+ *  http://www.slamtec.com
+ *
+ */
+/*
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR 
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "sdkcommon.h"
+#include "hal/locker.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace rp { namespace standalone{ namespace rplidar {
+
+namespace {
+
+struct TraceEvent {
+    const char *    name;
+    _u64            start_us;
+    _u64            end_us;
+};
+
+// written by its owner thread only, read by the dumps at any time
+struct TraceRing {
+    bool        owned;
+    _u32        id;
+    _u64        head;       // events recorded, the last TRACE_RING_SIZE ones are kept
+    char        threadName[32];
+    TraceEvent  events[Tracer::TRACE_RING_SIZE];
+};
+
+// the head of a ring is published by its owner with a release store, the dumps read it with acquire loads
+#if defined(__GNUC__) || defined(__clang__)
+inline _u64 loadAcquire(const _u64 & value)
+{
+    return __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+}
+
+inline void storeRelease(_u64 & value, _u64 newValue)
+{
+    __atomic_store_n(&value, newValue, __ATOMIC_RELEASE);
+}
+
+inline void fenceAcquire()
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+#elif defined(_WIN32)
+inline _u64 loadAcquire(const _u64 & value)
+{
+    _u64 result = *(const volatile _u64 *)&value;
+    MemoryBarrier();
+    return result;
+}
+
+inline void storeRelease(_u64 & value, _u64 newValue)
+{
+    MemoryBarrier();
+    *(volatile _u64 *)&value = newValue;
+}
+
+inline void fenceAcquire()
+{
+    MemoryBarrier();
+}
+#else
+inline _u64 loadAcquire(const _u64 & value) { return *(const volatile _u64 *)&value; }
+inline void storeRelease(_u64 & value, _u64 newValue) { *(volatile _u64 *)&value = newValue; }
+inline void fenceAcquire() {}
+#endif
+
+rp::hal::Locker     ringsLock;
+TraceRing *         rings[Tracer::MAX_TRACED_THREADS];
+_u32                nextRingId = 0;
+
+#if defined(_MSC_VER)
+__declspec(thread) TraceRing * threadRing = NULL;
+__declspec(thread) bool threadUntraced = false;
+__declspec(thread) const char * threadName = NULL;
+#else
+__thread TraceRing * threadRing = NULL;
+__thread bool threadUntraced = false;    // all the rings were taken when the thread asked
+__thread const char * threadName = NULL;
+#endif
+#ifndef _WIN32
+// releases the ring of an exiting thread, its events stay in the dumps until the ring is reused
+pthread_key_t       ringKey;
+pthread_once_t      ringKeyOnce = PTHREAD_ONCE_INIT;
+
+void releaseRing(void * ring)
+{
+    rp::hal::AutoLocker l(ringsLock);
+    reinterpret_cast<TraceRing *>(ring)->owned = false;
+}
+
+void createRingKey()
+{
+    pthread_key_create(&ringKey, releaseRing);
+}
+#endif
+
+TraceRing * claimRing()
+{
+    rp::hal::AutoLocker l(ringsLock);
+    TraceRing * ring = NULL;
+    // a new ring keeps the spans of the exited threads a little longer
+    for (size_t pos = 0; pos < Tracer::MAX_TRACED_THREADS && !ring; ++pos) {
+        if (!rings[pos]) {
+            rings[pos] = new TraceRing();
+            ring = rings[pos];
+        }
+    }
+    for (size_t pos = 0; pos < Tracer::MAX_TRACED_THREADS && !ring; ++pos) {
+        if (!rings[pos]->owned) ring = rings[pos];
+    }
+    if (!ring) return NULL;
+
+    ring->owned = true;
+    ring->id = ++nextRingId;
+    storeRelease(ring->head, 0);
+    if (threadName) {
+        strncpy(ring->threadName, threadName, sizeof(ring->threadName) - 1);
+        ring->threadName[sizeof(ring->threadName) - 1] = 0;
+    } else {
+        snprintf(ring->threadName, sizeof(ring->threadName), "thread %u", ring->id);
+    }
+#ifndef _WIN32
+    pthread_once(&ringKeyOnce, createRingKey);
+    pthread_setspecific(ringKey, ring);
+#endif
+    return ring;
+}
+
+TraceRing * currentRing()
+{
+    if (!threadRing && !threadUntraced) {
+        threadRing = claimRing();
+        threadUntraced = !threadRing;
+    }
+    return threadRing;
+}
+
+void appendEscaped(std::string & out, const char * text)
+{
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\') out += '\\';
+        if ((unsigned char)*text >= 0x20) out += *text;
+    }
+}
+
+}
+
+bool Tracer::_enabled = false;
+
+void Tracer::Enable(bool enable)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_store_n(&_enabled, enable, __ATOMIC_RELAXED);
+#else
+    _enabled = enable;
+#endif
+}
+
+void Tracer::SetThreadName(const char * name)
+{
+    // the ring is only claimed by the first span
+    threadName = name;
+    if (!threadRing) return;
+    rp::hal::AutoLocker l(ringsLock);
+    strncpy(threadRing->threadName, name, sizeof(threadRing->threadName) - 1);
+    threadRing->threadName[sizeof(threadRing->threadName) - 1] = 0;
+}
+
+_u64 Tracer::Now()
+{
+    return getus();
+}
+
+void Tracer::Record(const char * name, _u64 start_us, _u64 end_us)
+{
+    TraceRing * ring = currentRing();
+    if (!ring) return;
+
+    _u64 head = ring->head;
+    TraceEvent & event = ring->events[head % TRACE_RING_SIZE];
+    event.name = name;
+    event.start_us = start_us;
+    event.end_us = end_us;
+    storeRelease(ring->head, head + 1);
+}
+
+void Tracer::DumpChromeTrace(std::string & out)
+{
+    std::vector<TraceEvent> events(TRACE_RING_SIZE);
+    char buffer[128];
+    bool first = true;
+
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    // the lock keeps the rings from being reused, the owners keep recording
+    rp::hal::AutoLocker l(ringsLock);
+    for (size_t pos = 0; pos < MAX_TRACED_THREADS && rings[pos]; ++pos) {
+        TraceRing * ring = rings[pos];
+
+        _u64 head = loadAcquire(ring->head);
+        _u64 copied = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        for (_u64 index = copied; index < head; ++index) {
+            events[index - copied] = ring->events[index % TRACE_RING_SIZE];
+        }
+        // the events overwritten during the copy are dropped, a reused ring is skipped
+        fenceAcquire();
+        _u64 newHead = loadAcquire(ring->head);
+        if (newHead < head) continue;
+        _u64 begin = copied;
+        if (newHead >= TRACE_RING_SIZE && newHead - TRACE_RING_SIZE + 1 > begin) begin = newHead - TRACE_RING_SIZE + 1;
+
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+            first ? "" : ",", ring->id);
+        out += buffer;
+        appendEscaped(out, ring->threadName);
+        out += "\"}}";
+        first = false;
+
+        for (_u64 index = begin; index < head; ++index) {
+            const TraceEvent & event = events[index - copied];
+            out += ",{\"name\":\"";
+            appendEscaped(out, event.name);
+            snprintf(buffer, sizeof(buffer), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu}",
+                ring->id, (unsigned long long)event.start_us, (unsigned long long)(event.end_us - event.start_us));
+            out += buffer;
+        }
+    }
+    out += "]}\n";
+}
+
+u_result Tracer::DumpChromeTrace(const char * path)
+{
+    std::string trace;
+    DumpChromeTrace(trace);
+
+    FILE * file = fopen(path, "w");
+    if (!file) return RESULT_OPERATION_FAIL;
+    size_t written = fwrite(trace.data(), 1, trace.size(), file);
+    fclose(file);
+    return (written == trace.size()) ? RESULT_OK : RESULT_OPERATION_FAIL;
+}
+
+}}}